@@ -188,5 +188,16 @@ void si_set_own_data( song_info_t *si, const char *own_data )
 	si->m_own_data = strdup(own_data == NULL ? "" : own_data);
 } /* End of 'si_set_own_data' function */
 
+/* Estimate amount of memory held by song info */
+size_t si_size( song_info_t *si )
+{
+	if (si == NULL)
+		return 0;
+	return sizeof(*si) + strlen(si->m_name) + strlen(si->m_artist) +
+		strlen(si->m_album) + strlen(si->m_year) + strlen(si->m_track) +
+		strlen(si->m_comments) + strlen(si->m_own_data) +
+		strlen(si->m_genre) + 8;
+} /* End of 'si_size' function */
+
 /* End of 'song_info.h' file */
 
@@ -0,0 +1,386 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Parallel directory walker implementation.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include "types.h"
+#include "dirwalk.h"
+#include "file_utils.h"
+#include "player.h"
+#include "pmng.h"
+#include "song.h"
+#include "util.h"
+
+/* A name read from a directory */
+typedef struct
+{
+	char *m_name;
+	int m_type;
+} dw_name_t;
+
+static void *dw_thread( void *arg );
+
+/* Create a directory node */
+static dw_node_t *dw_node_new( char *path )
+{
+	dw_node_t *node = (dw_node_t *)malloc(sizeof(*node));
+	if (node == NULL)
+		return NULL;
+	memset(node, 0, sizeof(*node));
+	node->m_path = path;
+	return node;
+} /* End of 'dw_node_new' function */
+
+/* Free a directory node with its subdirectories and the songs which
+ * have not been taken */
+static void dw_node_free( dw_node_t *node )
+{
+	int i;
+
+	for ( i = 0; i < node->m_num_entries; i ++ )
+	{
+		dw_entry_t *e = &node->m_entries[i];
+		if (e->m_song != NULL)
+			song_free(e->m_song);
+		if (e->m_dir != NULL)
+			dw_node_free(e->m_dir);
+		free(e->m_path);
+	}
+	free(node->m_entries);
+	free(node->m_path);
+	free(node);
+} /* End of 'dw_node_free' function */
+
+/* Start walking a directory tree */
+dw_t *dw_new( const char *path, int num_threads, int flags )
+{
+	dw_t *dw;
+	char *ext;
+
+	dw = (dw_t *)malloc(sizeof(*dw));
+	if (dw == NULL)
+		return NULL;
+	memset(dw, 0, sizeof(*dw));
+	dw->m_flags = flags;
+	pthread_mutex_init(&dw->m_mutex, NULL);
+	pthread_cond_init(&dw->m_job_cond, NULL);
+	pthread_cond_init(&dw->m_done_cond, NULL);
+
+	/* Extensions are looked up by the threads instead of searching
+	 * the plugins list for every file */
+	dw->m_exts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	for ( ext = pmng_first_media_ext(player_pmng); ext != NULL;
+			ext = pmng_next_media_ext(ext) )
+		g_hash_table_insert(dw->m_exts, g_ascii_strdown(ext, -1), GINT_TO_POINTER(1));
+
+	dw->m_root = dw_node_new(strdup(path));
+	if (dw->m_root == NULL || dw->m_root->m_path == NULL)
+	{
+		dw_free(dw);
+		return NULL;
+	}
+	dw->m_jobs = dw->m_root;
+
+	if (num_threads > DW_MAX_THREADS)
+		num_threads = DW_MAX_THREADS;
+	for ( ; dw->m_num_threads < num_threads; dw->m_num_threads ++ )
+	{
+		if (pthread_create(&dw->m_threads[dw->m_num_threads], NULL,
+					dw_thread, dw))
+			break;
+	}
+	if (dw->m_num_threads == 0)
+	{
+		dw_free(dw);
+		return NULL;
+	}
+	return dw;
+} /* End of 'dw_new' function */
+
+/* Stop walking and free all the data */
+void dw_free( dw_t *dw )
+{
+	int i;
+
+	pthread_mutex_lock(&dw->m_mutex);
+	dw->m_stop = TRUE;
+	pthread_cond_broadcast(&dw->m_job_cond);
+	pthread_cond_broadcast(&dw->m_done_cond);
+	pthread_mutex_unlock(&dw->m_mutex);
+	for ( i = 0; i < dw->m_num_threads; i ++ )
+		pthread_join(dw->m_threads[i], NULL);
+
+	if (dw->m_root != NULL)
+		dw_node_free(dw->m_root);
+	g_hash_table_destroy(dw->m_exts);
+	pthread_cond_destroy(&dw->m_job_cond);
+	pthread_cond_destroy(&dw->m_done_cond);
+	pthread_mutex_destroy(&dw->m_mutex);
+	free(dw);
+} /* End of 'dw_free' function */
+
+/* Wait until a directory is read. Returns immediately if it is ready */
+void dw_wait( dw_t *dw, dw_node_t *node )
+{
+	pthread_mutex_lock(&dw->m_mutex);
+	while (!node->m_done && !dw->m_stop)
+		pthread_cond_wait(&dw->m_done_cond, &dw->m_mutex);
+	pthread_mutex_unlock(&dw->m_mutex);
+} /* End of 'dw_wait' function */
+
+/* Check if a file is a play list */
+static bool_t dw_is_playlist( char *name )
+{
+	char *ext;
+
+	if (pmng_is_playlist_prefix(player_pmng, name) != NULL)
+		return TRUE;
+	ext = strrchr(name, '.');
+	if (ext == NULL || !(*++ext))
+		return FALSE;
+	return (pmng_is_playlist_extension(player_pmng, ext) != NULL);
+} /* End of 'dw_is_playlist' function */
+
+/* Check if a file has a supported extension (the way
+ * 'song_new_from_file' does it, so that it need not be checked again) */
+static bool_t dw_is_media( dw_t *dw, const char *path )
+{
+	const char *ext = strrchr(path, '.');
+	char lower[32];
+	size_t i;
+
+	ext = (ext == NULL) ? "" : ext + 1;
+	for ( i = 0; ext[i] != 0 && i < sizeof(lower) - 1; i ++ )
+		lower[i] = g_ascii_tolower(ext[i]);
+	if (ext[i] != 0)
+		return FALSE;
+	lower[i] = 0;
+	return (g_hash_table_lookup(dw->m_exts, lower) != NULL);
+} /* End of 'dw_is_media' function */
+
+/* Compare names the way 'alphasort' does */
+static int dw_name_cmp( const void *a, const void *b )
+{
+	return strcoll(((const dw_name_t *)a)->m_name, ((const dw_name_t *)b)->m_name);
+} /* End of 'dw_name_cmp' function */
+
+/* Read directory names. Entry types are taken from 'd_type' and only
+ * resolved with 'fstatat' for links and unknown types. Names are
+ * returned sorted; NULL is returned if directory is to be added the
+ * usual way */
+static dw_name_t *dw_read_names( dw_t *dw, dw_node_t *node, int *num )
+{
+	dw_name_t *names = NULL;
+	int capacity = 0, dfd;
+	struct dirent *de;
+	DIR *dir;
+
+	*num = 0;
+	dfd = openat(AT_FDCWD, node->m_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dfd < 0 || (dir = fdopendir(dfd)) == NULL)
+	{
+		if (dfd >= 0)
+			close(dfd);
+		logger_error(player_log, 1, _("Unable to read directory %s"), node->m_path);
+		return NULL;
+	}
+
+	while ((de = readdir(dir)) != NULL)
+	{
+		int type = -1;
+
+		if (fu_is_special_dir(de->d_name))
+			continue;
+
+		/* Smart adding looks for play lists among all the files */
+		if ((dw->m_flags & DW_SMART_ADD) && dw_is_playlist(de->d_name))
+		{
+			node->m_serial = TRUE;
+			break;
+		}
+		if ((dw->m_flags & DW_SKIP_HIDDEN) && de->d_name[0] == '.')
+			continue;
+
+		if (de->d_type == DT_REG)
+			type = DW_ENTRY_SONG;
+		else if (de->d_type == DT_DIR)
+			type = DW_ENTRY_DIR;
+		else if (de->d_type == DT_LNK || de->d_type == DT_UNKNOWN)
+		{
+			struct stat st;
+			if (!fstatat(dfd, de->d_name, &st, 0))
+			{
+				if (S_ISREG(st.st_mode))
+					type = DW_ENTRY_SONG;
+				else if (S_ISDIR(st.st_mode))
+					type = DW_ENTRY_DIR;
+			}
+		}
+		if (type < 0)
+			continue;
+
+		if (*num == capacity)
+		{
+			dw_name_t *n;
+			capacity = capacity ? capacity * 2 : 64;
+			n = (dw_name_t *)realloc(names, capacity * sizeof(*names));
+			if (n == NULL)
+				break;
+			names = n;
+		}
+		names[*num].m_name = strdup(de->d_name);
+		names[*num].m_type = type;
+		if (names[*num].m_name != NULL)
+			(*num) ++;
+	}
+	closedir(dir);
+
+	if (node->m_serial)
+	{
+		int i;
+		for ( i = 0; i < *num; i ++ )
+			free(names[i].m_name);
+		free(names);
+		*num = 0;
+		return NULL;
+	}
+	if (*num > 1)
+		qsort(names, *num, sizeof(*names), dw_name_cmp);
+	return names;
+} /* End of 'dw_read_names' function */
+
+/* Read a directory and create its entries. Returns the number of
+ * subdirectories found */
+static int dw_read_dir( dw_t *dw, dw_node_t *node )
+{
+	gint64 start = g_get_monotonic_time(), scanned;
+	dw_name_t *names;
+	int num, i, num_dirs = 0, num_files = 0;
+
+	names = dw_read_names(dw, node, &num);
+	scanned = g_get_monotonic_time();
+	if (names != NULL && num > 0)
+	{
+		node->m_entries = (dw_entry_t *)calloc(num, sizeof(dw_entry_t));
+		for ( i = 0; i < num && node->m_entries != NULL; i ++ )
+		{
+			dw_entry_t *e = &node->m_entries[node->m_num_entries];
+			char *path = util_strcat(node->m_path, "/", names[i].m_name, NULL);
+
+			if (path == NULL)
+				continue;
+			e->m_type = names[i].m_type;
+			if (e->m_type == DW_ENTRY_DIR)
+			{
+				e->m_dir = dw_node_new(path);
+				if (e->m_dir == NULL)
+				{
+					free(path);
+					continue;
+				}
+				num_dirs ++;
+			}
+			else if (dw_is_playlist(path))
+			{
+				e->m_type = DW_ENTRY_OTHER;
+				e->m_path = path;
+			}
+			else
+			{
+				song_metadata_t metadata = SONG_METADATA_EMPTY;
+
+				/* Unsupported files are skipped */
+				e->m_song = dw_is_media(dw, path) ?
+					song_new_from_media(path, &metadata) : NULL;
+				free(path);
+				if (e->m_song == NULL)
+					continue;
+				e->m_song->m_flags |= SONG_SCHEDULE;
+				num_files ++;
+			}
+			node->m_num_entries ++;
+		}
+	}
+	for ( i = 0; i < num; i ++ )
+		free(names[i].m_name);
+	free(names);
+
+	pthread_mutex_lock(&dw->m_mutex);
+	dw->m_num_dirs ++;
+	dw->m_num_files += num_files;
+	dw->m_scan_time += scanned - start;
+	dw->m_song_time += g_get_monotonic_time() - scanned;
+	pthread_mutex_unlock(&dw->m_mutex);
+	return num_dirs;
+} /* End of 'dw_read_dir' function */
+
+/* Thread function */
+static void *dw_thread( void *arg )
+{
+	dw_t *dw = (dw_t *)arg;
+
+	pthread_mutex_lock(&dw->m_mutex);
+	for ( ;; )
+	{
+		dw_node_t *node;
+		int num_dirs, i;
+
+		/* Quit when there is no work and nobody can make more */
+		while (!dw->m_stop && dw->m_jobs == NULL && dw->m_num_busy > 0)
+			pthread_cond_wait(&dw->m_job_cond, &dw->m_mutex);
+		if (dw->m_stop || dw->m_jobs == NULL)
+			break;
+		node = dw->m_jobs;
+		dw->m_jobs = node->m_next_job;
+		dw->m_num_busy ++;
+		pthread_mutex_unlock(&dw->m_mutex);
+
+		num_dirs = dw_read_dir(dw, node);
+
+		pthread_mutex_lock(&dw->m_mutex);
+		dw->m_num_busy --;
+
+		/* Push subdirectories so that the first one is taken first */
+		for ( i = node->m_num_entries - 1; i >= 0; i -- )
+		{
+			dw_node_t *child = node->m_entries[i].m_dir;
+			if (child == NULL)
+				continue;
+			child->m_next_job = dw->m_jobs;
+			dw->m_jobs = child;
+		}
+		node->m_done = TRUE;
+		pthread_cond_broadcast(&dw->m_done_cond);
+		if (num_dirs > 0 || (dw->m_jobs == NULL && dw->m_num_busy == 0))
+			pthread_cond_broadcast(&dw->m_job_cond);
+	}
+	pthread_mutex_unlock(&dw->m_mutex);
+	return NULL;
+} /* End of 'dw_thread' function */
+
+/* End of 'dirwalk.c' file */
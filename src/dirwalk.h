@@ -0,0 +1,117 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Interface for parallel directory walker.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#ifndef __SG_MPFC_DIRWALK_H__
+#define __SG_MPFC_DIRWALK_H__
+
+#include <pthread.h>
+#include <glib.h>
+#include "types.h"
+#include "main_types.h"
+
+/* Maximal number of walker threads */
+#define DW_MAX_THREADS 32
+
+/* Directory entry types */
+#define DW_ENTRY_SONG	0
+#define DW_ENTRY_DIR	1
+#define DW_ENTRY_OTHER	2
+
+/* Walker flags */
+#define DW_SKIP_HIDDEN	0x01
+#define DW_SMART_ADD	0x02
+
+struct tag_dw_node_t;
+
+/* Directory entry */
+typedef struct
+{
+	int m_type;
+
+	/* Song created for a media file (taken by the consumer) */
+	song_t *m_song;
+
+	/* Subdirectory */
+	struct tag_dw_node_t *m_dir;
+
+	/* Full path of an entry that must be added the usual way
+	 * (e.g. a play list file) */
+	char *m_path;
+} dw_entry_t;
+
+/* Directory */
+typedef struct tag_dw_node_t
+{
+	char *m_path;
+
+	/* Entries in the order they are added */
+	dw_entry_t *m_entries;
+	int m_num_entries;
+
+	/* Set when entries are ready */
+	bool_t m_done;
+
+	/* Set if the directory has to be added the usual way (smart adding
+	 * may choose a play list in it) */
+	bool_t m_serial;
+
+	/* Next directory in the jobs stack */
+	struct tag_dw_node_t *m_next_job;
+} dw_node_t;
+
+/* Walker */
+typedef struct
+{
+	dw_node_t *m_root;
+	int m_flags;
+
+	/* Supported media extensions (lower case) */
+	GHashTable *m_exts;
+
+	/* Directories waiting to be read. Stack makes the threads go
+	 * depth-first, in the order the consumer needs the directories */
+	dw_node_t *m_jobs;
+	int m_num_busy;
+	bool_t m_stop;
+
+	pthread_t m_threads[DW_MAX_THREADS];
+	int m_num_threads;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_job_cond, m_done_cond;
+
+	/* Statistics (times are in us, summed over the threads) */
+	int m_num_dirs, m_num_files;
+	gint64 m_scan_time, m_song_time;
+} dw_t;
+
+/* Start walking a directory tree */
+dw_t *dw_new( const char *path, int num_threads, int flags );
+
+/* Stop walking and free all the data */
+void dw_free( dw_t *dw );
+
+/* Wait until a directory is read. Returns immediately if it is ready */
+void dw_wait( dw_t *dw, dw_node_t *node );
+
+#endif
+
+/* End of 'dirwalk.h' file */
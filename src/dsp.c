@@ -0,0 +1,377 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Built-in audio effects implementation.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include "types.h"
+#include "cfg.h"
+#include "dsp.h"
+#include "player.h"
+
+/* Equalizer bands center frequencies and quality (one octave wide) */
+static const float dsp_eq_freqs[DSP_EQ_BANDS] =
+	{ 31.25f, 62.5f, 125.f, 250.f, 500.f, 1000.f, 2000.f, 4000.f, 8000.f, 16000.f };
+#define DSP_EQ_Q 1.41
+
+/* Filter state below this is flushed to zero to avoid denormals */
+#define DSP_DENORMAL 1e-15f
+
+/* Create effects settings from the configuration */
+dsp_t *dsp_new( void )
+{
+	dsp_t *d = (dsp_t *)malloc(sizeof(*d));
+	if (d == NULL)
+		return NULL;
+	memset(d, 0, sizeof(*d));
+	pthread_mutex_init(&d->m_mutex, NULL);
+	dsp_configure(d);
+	return d;
+} /* End of 'dsp_new' function */
+
+/* Free effects settings */
+void dsp_free( dsp_t *d )
+{
+	pthread_mutex_destroy(&d->m_mutex);
+	free(d);
+} /* End of 'dsp_free' function */
+
+/* Re-read settings from the configuration */
+void dsp_configure( dsp_t *d )
+{
+	char *eq = cfg_get_var(cfg_list, "equalizer");
+	float gains[DSP_EQ_BANDS];
+	float preamp = cfg_get_var_float(cfg_list, "preamp");
+	float limit = cfg_get_var_float(cfg_list, "limiter-threshold");
+	bool_t eq_on = FALSE;
+	int i;
+
+	/* Gains are given in dB separated by commas or spaces */
+	memset(gains, 0, sizeof(gains));
+	for ( i = 0; eq != NULL && *eq && i < DSP_EQ_BANDS; i ++ )
+	{
+		char *end;
+
+		gains[i] = (float)g_ascii_strtod(eq, &end);
+		if (end == eq)
+			break;
+		if (gains[i] != 0)
+			eq_on = TRUE;
+		for ( eq = end; *eq == ',' || *eq == ' '; eq ++ );
+	}
+
+	pthread_mutex_lock(&d->m_mutex);
+	memcpy(d->m_eq_gains, gains, sizeof(gains));
+	d->m_preamp = powf(10.f, preamp / 20.f);
+	d->m_limit = powf(10.f, limit / 20.f);
+	if (d->m_limit > 0.99f)
+		d->m_limit = 0.99f;
+	d->m_enabled[DSP_EFFECT_EQUALIZER] = eq_on;
+	d->m_enabled[DSP_EFFECT_PREAMP] = (preamp != 0);
+	d->m_enabled[DSP_EFFECT_LIMITER] = cfg_get_var_bool(cfg_list, "limiter");
+	d->m_gen ++;
+	pthread_mutex_unlock(&d->m_mutex);
+} /* End of 'dsp_configure' function */
+
+/* Create stream state */
+dsp_stream_t *dsp_stream_new( dsp_t *d )
+{
+	dsp_stream_t *s = (dsp_stream_t *)malloc(sizeof(*s));
+	if (s == NULL)
+		return NULL;
+	memset(s, 0, sizeof(*s));
+	s->m_dsp = d;
+	s->m_gen = d->m_gen - 1;
+	s->m_preamp = s->m_limit = 1.f;
+	return s;
+} /* End of 'dsp_stream_new' function */
+
+/* Clear filters state */
+static void dsp_stream_reset( dsp_stream_t *s )
+{
+	memset(s->m_z1, 0, sizeof(s->m_z1));
+	memset(s->m_z2, 0, sizeof(s->m_z2));
+} /* End of 'dsp_stream_reset' function */
+
+/* Compute peaking filters coefficients for the stream rate */
+static void dsp_stream_update_eq( dsp_stream_t *s )
+{
+	int b;
+
+	for ( b = 0; b < DSP_EQ_BANDS; b ++ )
+	{
+		dsp_biquad_t *q = &s->m_eq[b];
+		double a, w, alpha, a0;
+
+		/* Bands close to the Nyquist frequency are skipped */
+		s->m_eq_active[b] = (s->m_eq_gains[b] != 0 && s->m_rate > 0 &&
+				dsp_eq_freqs[b] < 0.45 * s->m_rate);
+		if (!s->m_eq_active[b])
+			continue;
+
+		a = pow(10., s->m_eq_gains[b] / 40.);
+		w = 2. * M_PI * dsp_eq_freqs[b] / s->m_rate;
+		alpha = sin(w) / (2. * DSP_EQ_Q);
+		a0 = 1. + alpha / a;
+		q->m_b0 = (float)((1. + alpha * a) / a0);
+		q->m_b1 = q->m_a1 = (float)(-2. * cos(w) / a0);
+		q->m_b2 = (float)((1. - alpha * a) / a0);
+		q->m_a2 = (float)((1. - alpha / a) / a0);
+	}
+} /* End of 'dsp_stream_update_eq' function */
+
+/* Set stream format */
+void dsp_stream_set_format( dsp_stream_t *s, int rate, int channels )
+{
+	if (rate == s->m_rate && channels == s->m_channels)
+		return;
+	s->m_rate = rate;
+	s->m_channels = channels;
+	dsp_stream_update_eq(s);
+	dsp_stream_reset(s);
+} /* End of 'dsp_stream_set_format' function */
+
+/* Pick up changed settings */
+static void dsp_stream_sync( dsp_stream_t *s )
+{
+	dsp_t *d = s->m_dsp;
+
+	if (s->m_gen == d->m_gen)
+		return;
+	pthread_mutex_lock(&d->m_mutex);
+	memcpy(s->m_eq_gains, d->m_eq_gains, sizeof(s->m_eq_gains));
+	memcpy(s->m_enabled, d->m_enabled, sizeof(s->m_enabled));
+	s->m_preamp = d->m_preamp;
+	s->m_limit = d->m_limit;
+	s->m_gen = d->m_gen;
+	pthread_mutex_unlock(&d->m_mutex);
+	dsp_stream_update_eq(s);
+} /* End of 'dsp_stream_sync' function */
+
+/* Equalizer. Filters are recursive in time, so the inner loop goes
+ * over the channels of a frame */
+static void dsp_equalizer( dsp_stream_t *s, float *restrict data, int frames )
+{
+	int ch = s->m_channels, b, i, c;
+
+	if (ch <= 0 || ch > DSP_MAX_CHANNELS)
+		return;
+
+	for ( b = 0; b < DSP_EQ_BANDS; b ++ )
+	{
+		const dsp_biquad_t q = s->m_eq[b];
+		float *restrict z1 = s->m_z1[b], *restrict z2 = s->m_z2[b];
+		float *restrict p = data;
+
+		if (!s->m_eq_active[b])
+			continue;
+		for ( i = 0; i < frames; i ++, p += ch )
+			for ( c = 0; c < ch; c ++ )
+			{
+				float x = p[c], y = q.m_b0 * x + z1[c];
+				z1[c] = q.m_b1 * x - q.m_a1 * y + z2[c];
+				z2[c] = q.m_b2 * x - q.m_a2 * y;
+				p[c] = y;
+			}
+
+		for ( c = 0; c < ch; c ++ )
+		{
+			if (fabsf(z1[c]) < DSP_DENORMAL)
+				z1[c] = 0;
+			if (fabsf(z2[c]) < DSP_DENORMAL)
+				z2[c] = 0;
+		}
+	}
+} /* End of 'dsp_equalizer' function */
+
+/* Pre-amplifier */
+static void dsp_preamp( dsp_stream_t *s, float *restrict data, int n )
+{
+	const float g = s->m_preamp;
+	int i;
+
+	for ( i = 0; i < n; i ++ )
+		data[i] *= g;
+} /* End of 'dsp_preamp' function */
+
+/* Soft limiter: samples above the threshold are smoothly compressed
+ * towards full scale. Written without branches so that it vectorizes */
+static void dsp_limiter( dsp_stream_t *s, float *restrict data, int n )
+{
+	const float t = s->m_limit, k = 1.f - t;
+	int i;
+
+	for ( i = 0; i < n; i ++ )
+	{
+		float x = data[i], a = fabsf(x);
+		float over = (a > t) ? a - t : 0.f;
+		data[i] = copysignf(a - over + k * over / (k + over), x);
+	}
+} /* End of 'dsp_limiter' function */
+
+/* Apply a single effect regardless of the settings */
+void dsp_apply_effect( dsp_stream_t *s, int effect, float *data, int frames )
+{
+	switch (effect)
+	{
+	case DSP_EFFECT_EQUALIZER:
+		dsp_equalizer(s, data, frames);
+		break;
+	case DSP_EFFECT_PREAMP:
+		dsp_preamp(s, data, frames * s->m_channels);
+		break;
+	case DSP_EFFECT_LIMITER:
+		dsp_limiter(s, data, frames * s->m_channels);
+		break;
+	}
+} /* End of 'dsp_apply_effect' function */
+
+/* Process interleaved float samples in place. Returns FALSE if all
+ * the effects are off (data is not touched then) */
+bool_t dsp_process( dsp_stream_t *s, float *data, int frames )
+{
+	bool_t active = FALSE;
+	int i;
+
+	dsp_stream_sync(s);
+	if (s->m_channels <= 0)
+		return FALSE;
+	for ( i = 0; i < DSP_NUM_EFFECTS; i ++ )
+		if (s->m_enabled[i])
+		{
+			dsp_apply_effect(s, i, data, frames);
+			active = TRUE;
+		}
+	return active;
+} /* End of 'dsp_process' function */
+
+/* Get effect name */
+const char *dsp_effect_name( int effect )
+{
+	static const char *names[DSP_NUM_EFFECTS] =
+		{ "equalizer", "preamp", "limiter" };
+	return (effect >= 0 && effect < DSP_NUM_EFFECTS) ? names[effect] : NULL;
+} /* End of 'dsp_effect_name' function */
+
+/* Process buffers in place on the streaming thread */
+static GstPadProbeReturn dsp_on_buffer( GstPad *pad, GstPadProbeInfo *info,
+		gpointer data )
+{
+	dsp_stream_t *s = (dsp_stream_t *)data;
+	GstBuffer *buf;
+	GstMapInfo map;
+	int i;
+
+	/* Don't touch the data if all effects are off */
+	dsp_stream_sync(s);
+	for ( i = 0; i < DSP_NUM_EFFECTS && !s->m_enabled[i]; i ++ );
+	if (i == DSP_NUM_EFFECTS || s->m_channels <= 0)
+		return GST_PAD_PROBE_OK;
+
+	/* Buffer is usually not shared, so this does not copy */
+	buf = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+	GST_PAD_PROBE_INFO_DATA(info) = buf;
+	if (!gst_buffer_map(buf, &map, GST_MAP_READ | GST_MAP_WRITE))
+		return GST_PAD_PROBE_OK;
+	dsp_process(s, (float *)map.data,
+			map.size / (sizeof(float) * s->m_channels));
+	gst_buffer_unmap(buf, &map);
+	return GST_PAD_PROBE_OK;
+} /* End of 'dsp_on_buffer' function */
+
+/* Track stream format and discontinuities */
+static GstPadProbeReturn dsp_on_event( GstPad *pad, GstPadProbeInfo *info,
+		gpointer data )
+{
+	dsp_stream_t *s = (dsp_stream_t *)data;
+	GstEvent *ev = GST_PAD_PROBE_INFO_EVENT(info);
+
+	if (GST_EVENT_TYPE(ev) == GST_EVENT_CAPS)
+	{
+		GstCaps *caps;
+		GstAudioInfo ai;
+
+		gst_event_parse_caps(ev, &caps);
+		gst_audio_info_init(&ai);
+		if (gst_audio_info_from_caps(&ai, caps))
+			dsp_stream_set_format(s, GST_AUDIO_INFO_RATE(&ai),
+					GST_AUDIO_INFO_CHANNELS(&ai));
+	}
+	else if (GST_EVENT_TYPE(ev) == GST_EVENT_FLUSH_STOP)
+		dsp_stream_reset(s);
+	return GST_PAD_PROBE_OK;
+} /* End of 'dsp_on_event' function */
+
+/* Process data flowing through a pad (it must carry interleaved F32).
+ * Stream state lives as long as the probe does */
+void dsp_attach( dsp_t *d, GstPad *pad )
+{
+	dsp_stream_t *s = dsp_stream_new(d);
+	if (s == NULL)
+		return;
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+			dsp_on_event, s, NULL);
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, dsp_on_buffer, s, free);
+} /* End of 'dsp_attach' function */
+
+/* Create a filter element converting data to float and processing it:
+ * audioconvert ! capsfilter */
+GstElement *dsp_filter_new( dsp_t *d )
+{
+	GstElement *bin, *convert, *filter;
+	GstCaps *caps;
+	GstPad *pad;
+
+	bin = gst_bin_new("effects");
+	convert = gst_element_factory_make("audioconvert", NULL);
+	filter = gst_element_factory_make("capsfilter", NULL);
+	if (bin == NULL || convert == NULL || filter == NULL)
+	{
+		logger_error(player_log, 1, _("gstreamer: unable to create effects filter"));
+		if (convert)
+			gst_object_unref(convert);
+		if (filter)
+			gst_object_unref(filter);
+		if (bin)
+			gst_object_unref(bin);
+		return NULL;
+	}
+
+	caps = gst_caps_from_string("audio/x-raw,format=F32LE,layout=interleaved");
+	g_object_set(G_OBJECT(filter), "caps", caps, NULL);
+	gst_caps_unref(caps);
+	gst_bin_add_many(GST_BIN(bin), convert, filter, NULL);
+	gst_element_link(convert, filter);
+
+	pad = gst_element_get_static_pad(convert, "sink");
+	gst_element_add_pad(bin, gst_ghost_pad_new("sink", pad));
+	gst_object_unref(pad);
+	pad = gst_element_get_static_pad(filter, "src");
+	dsp_attach(d, pad);
+	gst_element_add_pad(bin, gst_ghost_pad_new("src", pad));
+	gst_object_unref(pad);
+	return bin;
+} /* End of 'dsp_filter_new' function */
+
+/* End of 'dsp.c' file */
@@ -0,0 +1,117 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Interface for built-in audio effects.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#ifndef __SG_MPFC_DSP_H__
+#define __SG_MPFC_DSP_H__
+
+#include <pthread.h>
+#include <gst/gst.h>
+#include "types.h"
+
+/* Effects in the order they are applied */
+#define DSP_EFFECT_EQUALIZER	0
+#define DSP_EFFECT_PREAMP		1
+#define DSP_EFFECT_LIMITER		2
+#define DSP_NUM_EFFECTS			3
+
+/* Equalizer bands (octaves from 31 Hz to 16 kHz) */
+#define DSP_EQ_BANDS 10
+
+/* Maximal number of channels processed by the equalizer */
+#define DSP_MAX_CHANNELS 8
+
+/* Biquad filter coefficients (normalized so that a0 is 1) */
+typedef struct
+{
+	float m_b0, m_b1, m_b2, m_a1, m_a2;
+} dsp_biquad_t;
+
+/* Effects settings. They are changed by the interface thread and
+ * picked up by the streams on the next buffer */
+typedef struct
+{
+	float m_eq_gains[DSP_EQ_BANDS];
+	float m_preamp, m_limit;
+	bool_t m_enabled[DSP_NUM_EFFECTS];
+
+	/* Incremented on every change */
+	volatile unsigned m_gen;
+
+	pthread_mutex_t m_mutex;
+} dsp_t;
+
+/* Effects chain state of a stream */
+typedef struct
+{
+	/* Settings copy and its generation */
+	dsp_t *m_dsp;
+	float m_eq_gains[DSP_EQ_BANDS];
+	float m_preamp, m_limit;
+	bool_t m_enabled[DSP_NUM_EFFECTS];
+	unsigned m_gen;
+
+	/* Stream format */
+	int m_rate, m_channels;
+
+	/* Equalizer coefficients for the stream rate and filters state.
+	 * State is kept channel-wise contiguous, so that the inner loop over
+	 * channels vectorizes */
+	dsp_biquad_t m_eq[DSP_EQ_BANDS];
+	bool_t m_eq_active[DSP_EQ_BANDS];
+	float m_z1[DSP_EQ_BANDS][DSP_MAX_CHANNELS];
+	float m_z2[DSP_EQ_BANDS][DSP_MAX_CHANNELS];
+} dsp_stream_t;
+
+/* Create effects settings from the configuration */
+dsp_t *dsp_new( void );
+
+/* Free effects settings */
+void dsp_free( dsp_t *d );
+
+/* Re-read settings from the configuration */
+void dsp_configure( dsp_t *d );
+
+/* Create stream state */
+dsp_stream_t *dsp_stream_new( dsp_t *d );
+
+/* Set stream format */
+void dsp_stream_set_format( dsp_stream_t *s, int rate, int channels );
+
+/* Process interleaved float samples in place. Returns FALSE if all
+ * the effects are off (data is not touched then) */
+bool_t dsp_process( dsp_stream_t *s, float *data, int frames );
+
+/* Apply a single effect regardless of the settings */
+void dsp_apply_effect( dsp_stream_t *s, int effect, float *data, int frames );
+
+/* Get effect name */
+const char *dsp_effect_name( int effect );
+
+/* Process data flowing through a pad (it must carry interleaved F32) */
+void dsp_attach( dsp_t *d, GstPad *pad );
+
+/* Create a filter element converting data to float and processing it */
+GstElement *dsp_filter_new( dsp_t *d );
+
+#endif
+
+/* End of 'dsp.h' file */
@@ -194,6 +194,7 @@ void help_init_player( help_screen_t *help )
 	help_add(help, _("C:\t\t Centrize view"));
 	help_add(help, _("/:\t\t Search"));
 	help_add(help, _("\\:\t\t Advanced search"));
+	help_add(help, _("F:\t\t Filter play list"));
 	help_add(help, _("n:\t\t Go to next search match"));
 	help_add(help, _("N:\t\t Go to previous search match"));
 	help_add(help, _("R:\t\t Set/unset shuffle play mode"));
@@ -203,6 +204,7 @@ void help_init_player( help_screen_t *help )
 	help_add(help, _("U:\t\t Undo"));
 	help_add(help, _("D:\t\t Redo"));
 	help_add(help, _("I:\t\t Reload songs information"));
+	help_add(help, _("gr:\t\t Analyse play list loudness"));
 	help_add(help, _("ps:\t\t Set play bounds"));
 	help_add(help, _("p<Ret>:\t\t Set play bounds and play"));
 	help_add(help, _("pc:\t\t Clear play bounds"));
@@ -23,87 +23,163 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <glib.h>
 #include "types.h"
+#include "cfg.h"
 #include "info_rw_thread.h"
 #include "player.h"
 #include "song.h"
 #include "util.h"
 
-/* Thread queue */
-irw_queue_t *irw_head, *irw_tail;
+/* Thread queues, one per priority. Song flags concerning the info
+ * (SONG_SCHEDULE, SONG_INFO_READ and SONG_INFO_WRITE) are changed
+ * under the mutex only once the song is in a play list. Workers
+ * broadcast 'irw_done_cond' after each song */
+irw_queue_t *irw_heads[IRW_NUM_PRIOS], *irw_tails[IRW_NUM_PRIOS];
 pthread_mutex_t irw_mutex;
+static pthread_cond_t irw_cond, irw_done_cond;
 
-/* Thread info */
-pthread_t irw_tid = 0;
+/* Queued songs (song -> queue node) and songs being processed */
+static GHashTable *irw_queued = NULL, *irw_busy = NULL;
+
+/* Threads info */
+static pthread_t irw_tids[IRW_MAX_WORKERS];
+static int irw_num_workers = 0;
 bool_t irw_stop_thread = FALSE;
 
+/* Statistics */
+static int irw_queue_len = 0, irw_max_queue_len = 0, irw_num_active = 0;
+static int irw_num_read = 0;
+static gint64 irw_active_since = 0, irw_active_time = 0;
+
 /* Initialize info read/write thread */
 bool_t irw_init( void )
 {
+	int i, num = cfg_get_var_int(cfg_list, "info-workers");
+
 	/* Initialize queue */
-	irw_head = irw_tail = NULL;
+	for ( i = 0; i < IRW_NUM_PRIOS; i ++ )
+		irw_heads[i] = irw_tails[i] = NULL;
+	irw_stop_thread = FALSE;
 	pthread_mutex_init(&irw_mutex, NULL);
+	pthread_cond_init(&irw_cond, NULL);
+	pthread_cond_init(&irw_done_cond, NULL);
+	irw_queued = g_hash_table_new(g_direct_hash, g_direct_equal);
+	irw_busy = g_hash_table_new(g_direct_hash, g_direct_equal);
 
-	/* Initialize thread */
-	if (pthread_create(&irw_tid, NULL, irw_thread, NULL))
-		return FALSE;
-	return TRUE;
+	/* Initialize threads */
+	if (num < 1)
+		num = 1;
+	else if (num > IRW_MAX_WORKERS)
+		num = IRW_MAX_WORKERS;
+	for ( irw_num_workers = 0; irw_num_workers < num; irw_num_workers ++ )
+	{
+		if (pthread_create(&irw_tids[irw_num_workers], NULL, irw_thread, NULL))
+			break;
+	}
+	return (irw_num_workers > 0);
 } /* End of 'irw_init' function */
 
+/* Free queue nodes */
+static void irw_free_queue( irw_queue_t *q )
+{
+	while (q != NULL)
+	{
+		irw_queue_t *next = q->m_next;
+		song_free(q->m_song);
+		free(q);
+		q = next;
+	}
+} /* End of 'irw_free_queue' function */
+
 /* Free thread */
 void irw_free( void )
 {
-	irw_queue_t *q;
+	int i;
+
+	/* Stop threads */
+	irw_lock();
+	irw_stop_thread = TRUE;
+	pthread_cond_broadcast(&irw_cond);
+	pthread_cond_broadcast(&irw_done_cond);
+	irw_unlock();
+	for ( i = 0; i < irw_num_workers; i ++ )
+		pthread_join(irw_tids[i], NULL);
+	irw_num_workers = 0;
 
-	/* Stop thread */
-	if (irw_tid)
+	if (irw_num_read > 0)
 	{
-		irw_stop_thread = TRUE;
-		pthread_join(irw_tid, NULL);
-		irw_tid = 0;
+		logger_message(player_log, 0,
+				_("Info read %d songs in %.2f s (%.0f songs/s), "
+				  "maximal queue length is %d"),
+				irw_num_read, irw_active_time / 1e6,
+				irw_active_time > 0 ? irw_num_read * 1e6 / irw_active_time : 0.,
+				irw_max_queue_len);
 	}
 
 	/* Free queue */
-	pthread_mutex_destroy(&irw_mutex);
-	for ( q = irw_head; q != NULL; )
+	for ( i = 0; i < IRW_NUM_PRIOS; i ++ )
 	{
-		irw_queue_t *next = q->m_next;
-		song_free(q->m_song);
-		free(q);
-		q = next;
+		irw_free_queue(irw_heads[i]);
+		irw_heads[i] = irw_tails[i] = NULL;
 	}
+	if (irw_queued != NULL)
+	{
+		g_hash_table_destroy(irw_queued);
+		g_hash_table_destroy(irw_busy);
+		irw_queued = irw_busy = NULL;
+	}
+	pthread_cond_destroy(&irw_cond);
+	pthread_cond_destroy(&irw_done_cond);
+	pthread_mutex_destroy(&irw_mutex);
 } /* End of 'irw_free' function */
 
-/* Add song to the queue */
-void irw_push( song_t *song, song_flags_t flag )
+/* Insert node to the tail of the queue with given priority */
+static void irw_link( irw_queue_t *q, int prio )
 {
-	irw_queue_t *node, *q;
+	q->m_prio = prio;
+	q->m_next = NULL;
+	q->m_prev = irw_tails[prio];
+	if (irw_tails[prio] != NULL)
+		irw_tails[prio]->m_next = q;
+	else
+		irw_heads[prio] = q;
+	irw_tails[prio] = q;
+} /* End of 'irw_link' function */
+
+/* Remove node from its queue */
+static void irw_unlink( irw_queue_t *q )
+{
+	if (q->m_prev != NULL)
+		q->m_prev->m_next = q->m_next;
+	else
+		irw_heads[q->m_prio] = q->m_next;
+	if (q->m_next != NULL)
+		q->m_next->m_prev = q->m_prev;
+	else
+		irw_tails[q->m_prio] = q->m_prev;
+} /* End of 'irw_unlink' function */
+
+/* Add song to the queue (queue must be locked). Song is no longer
+ * scheduled after that */
+static void irw_push_locked( song_t *song, song_flags_t flag )
+{
+	irw_queue_t *node;
 
 	/* Check if this song is not in queue */
-	irw_lock();
-	for ( q = irw_head; q != NULL; q = q->m_next )
+	node = (irw_queue_t *)g_hash_table_lookup(irw_queued, song);
+	if (node != NULL)
 	{
-		if (q->m_song == song)
+		/* If we want to write info and song in the queue has no this
+		 * flag yet, move it to the writing queue */
+		if (flag & SONG_INFO_WRITE && !(node->m_flags & SONG_INFO_WRITE))
 		{
-			/* If we want to write info and song in the queue has no this
-			 * flag yet, move it to the queue head */
-			if (flag & SONG_INFO_WRITE && !(song->m_flags & SONG_INFO_WRITE))
-			{
-				if (q->m_prev != NULL)
-					q->m_prev->m_next = q->m_next;
-				if (q->m_next != NULL)
-					q->m_next->m_prev = q->m_prev;
-				else
-					irw_tail = q->m_prev;
-				q->m_prev = NULL;
-				q->m_next = irw_head;
-				irw_head->m_prev = q;
-				irw_head = q;
-			}
-			song->m_flags |= flag;
-			irw_unlock();
-			return;
+			irw_unlink(node);
+			irw_link(node, IRW_PRIO_WRITE);
 		}
+		node->m_flags |= flag;
+		song->m_flags = (song->m_flags | flag) & ~SONG_SCHEDULE;
+		return;
 	}
 
 	/* Create new queue node */
@@ -111,94 +187,168 @@ void irw_push( song_t *song, song_flags_t flag )
 	if (node == NULL)
 		return;
 	node->m_song = song_add_ref(song);
-	node->m_song->m_flags |= flag;
+	node->m_flags = flag;
+	song->m_flags = (song->m_flags | flag) & ~SONG_SCHEDULE;
+	irw_link(node, (flag & SONG_INFO_WRITE) ? IRW_PRIO_WRITE : IRW_PRIO_READ);
+	g_hash_table_insert(irw_queued, song, node);
+	irw_queue_len ++;
+	if (irw_queue_len > irw_max_queue_len)
+		irw_max_queue_len = irw_queue_len;
+	pthread_cond_signal(&irw_cond);
+} /* End of 'irw_push_locked' function */
+
+/* Add song to the queue */
+void irw_push( song_t *song, song_flags_t flag )
+{
+	irw_lock();
+	irw_push_locked(song, flag);
+	irw_unlock();
+} /* End of 'irw_push' function */
 
-	/* If we want to write info - move node to the head */
-	if (flag & SONG_INFO_WRITE)
+/* Queue song for reading its info if it is scheduled for that */
+void irw_push_scheduled( song_t *song )
+{
+	irw_lock();
+	if (song->m_flags & SONG_SCHEDULE)
+		irw_push_locked(song, SONG_INFO_READ);
+	irw_unlock();
+} /* End of 'irw_push_scheduled' function */
+
+/* Wait until info of the song queued for reading is read */
+void irw_wait_read( song_t *song )
+{
+	irw_lock();
+	while ((song->m_flags & SONG_INFO_READ) && !irw_stop_thread)
+		pthread_cond_wait(&irw_done_cond, &irw_mutex);
+	irw_unlock();
+} /* End of 'irw_wait_read' function */
+
+/* Make given songs be read before the other ones. Songs which were
+ * prioritized before go back to the head of the reading queue */
+void irw_prioritize( song_t **songs, int num )
+{
+	irw_queue_t *q;
+	int i;
+
+	irw_lock();
+	while ((q = irw_tails[IRW_PRIO_VISIBLE]) != NULL)
 	{
-		node->m_prev = NULL;
-		node->m_next = irw_head;
-		if (irw_head != NULL)
-			irw_head->m_prev = node;
+		irw_unlink(q);
+		q->m_prio = IRW_PRIO_READ;
+		q->m_prev = NULL;
+		q->m_next = irw_heads[IRW_PRIO_READ];
+		if (q->m_next != NULL)
+			q->m_next->m_prev = q;
 		else
-			irw_tail = node;
-		irw_head = node;
+			irw_tails[IRW_PRIO_READ] = q;
+		irw_heads[IRW_PRIO_READ] = q;
 	}
-	/* Else - move node to the tail */
-	else
+	for ( i = 0; i < num; i ++ )
 	{
-		node->m_next = NULL;
-		node->m_prev = irw_tail;
-		if (irw_tail != NULL)
-			irw_tail->m_next = node;
-		else
-			irw_head = node;
-		irw_tail = node;
+		q = (irw_queue_t *)g_hash_table_lookup(irw_queued, songs[i]);
+		if (q == NULL || q->m_prio != IRW_PRIO_READ)
+			continue;
+		irw_unlink(q);
+		irw_link(q, IRW_PRIO_VISIBLE);
 	}
 	irw_unlock();
-} /* End of 'irw_push' function */
+} /* End of 'irw_prioritize' function */
 
-/* Get song from the queue */
-song_t *irw_pop( void )
+/* Take a song which is not being processed from the queue (queue
+ * must be locked) */
+static song_t *irw_take( int prio, song_flags_t *flags )
 {
-	song_t *s = NULL;
-	irw_queue_t *next;
+	irw_queue_t *q;
 
-	irw_lock();
-	if (irw_head != NULL)
+	for ( q = irw_heads[prio]; q != NULL; q = q->m_next )
 	{
-		s = irw_head->m_song;
-		next = irw_head->m_next;
-		free(irw_head);
-		irw_head = next;
-		if (irw_head == NULL)
-			irw_tail = NULL;
-		else
-			irw_head->m_prev = NULL;
+		song_t *s = q->m_song;
+		if (g_hash_table_contains(irw_busy, s))
+			continue;
+
+		irw_unlink(q);
+		*flags = q->m_flags;
+		free(q);
+		g_hash_table_remove(irw_queued, s);
+		g_hash_table_add(irw_busy, s);
+		irw_queue_len --;
+		return s;
 	}
-	irw_unlock();
+	return NULL;
+} /* End of 'irw_take' function */
+
+/* Get song from the queue and the actions requested for it. The song
+ * is marked as being processed until 'irw_release' is called (queue
+ * must be locked) */
+song_t *irw_pop( song_flags_t *flags )
+{
+	song_t *s = NULL;
+	int i;
+
+	for ( i = 0; i < IRW_NUM_PRIOS && s == NULL; i ++ )
+		s = irw_take(i, flags);
 	return s;
 } /* End of 'irw_pop' function */
 
+/* Finish processing song taken from the queue (queue must be locked).
+ * Song flags are left only for the actions requested again meanwhile */
+static void irw_release( song_t *s )
+{
+	irw_queue_t *q;
+
+	g_hash_table_remove(irw_busy, s);
+	q = (irw_queue_t *)g_hash_table_lookup(irw_queued, s);
+	s->m_flags = (s->m_flags & ~(SONG_INFO_READ | SONG_INFO_WRITE)) |
+		((q != NULL) ? q->m_flags : 0);
+	if (q != NULL)
+		pthread_cond_signal(&irw_cond);
+	pthread_cond_broadcast(&irw_done_cond);
+} /* End of 'irw_release' function */
+
 /* Thread function */
 void *irw_thread( void *arg )
 {
-	for ( ; !irw_stop_thread; )
+	irw_lock();
+	while (!irw_stop_thread)
 	{
-		for ( ;; )
+		song_flags_t flags;
+		song_t *s;
+
+		/* Get next task */
+		s = irw_pop(&flags);
+		if (s == NULL)
+		{
+			pthread_cond_wait(&irw_cond, &irw_mutex);
+			continue;
+		}
+		if (irw_num_active ++ == 0)
+			irw_active_since = g_get_monotonic_time();
+		irw_unlock();
+
+		/* Write song info */
+		if (flags & SONG_INFO_WRITE)
+		{
+			song_write_info(s);
+		}
+
+		/* Read song info */
+		else if (flags & SONG_INFO_READ)
 		{
-			song_flags_t flags;
-			song_t *s;
-
-			/* Get next task */
-			s = irw_pop();
-			if (s == NULL)
-				break;
-			flags = s->m_flags;
-
-			/* Read song info */
-			if (s->m_flags & SONG_INFO_READ)
-			{
-				song_update_info(s);
-				wnd_invalidate(player_wnd);
-			}
-
-			/* Write song info */
-			if (s->m_flags & SONG_INFO_WRITE)
-			{
-				song_write_info(s);
-			}
-
-			/* Release song reference */
-			song_free(s);
-
-			/* If we have not written info - leave cycle to be able to stop
-			 * the thread */
-			if (!(flags & SONG_INFO_WRITE))
-				break;
+			song_update_info(s);
+			wnd_invalidate(player_wnd);
 		}
-		util_wait();
+
+		irw_lock();
+		if (!(flags & SONG_INFO_WRITE) && (flags & SONG_INFO_READ))
+			irw_num_read ++;
+		if (-- irw_num_active == 0)
+			irw_active_time += g_get_monotonic_time() - irw_active_since;
+		irw_release(s);
+
+		/* Release song reference */
+		song_free(s);
 	}
+	irw_unlock();
 	return NULL;
 } /* End of 'irw_thread' function */
 
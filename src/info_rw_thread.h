@@ -27,6 +27,16 @@
 #include "types.h"
 #include "song.h"
 
+/* Maximal number of worker threads */
+#define IRW_MAX_WORKERS 16
+
+/* Queue priorities: info is written first, then read for the songs
+ * on screen and then for all the others */
+#define IRW_PRIO_WRITE		0
+#define IRW_PRIO_VISIBLE	1
+#define IRW_PRIO_READ		2
+#define IRW_NUM_PRIOS		3
+
 /* Songs queue */
 typedef struct tag_irw_queue_t 
 {
@@ -35,6 +45,12 @@ typedef struct tag_irw_queue_t
 
 	/* Next and previous songs in the queue */
 	struct tag_irw_queue_t *m_next, *m_prev;
+
+	/* Queue the node is in */
+	int m_prio;
+
+	/* Requested actions (SONG_INFO_READ and SONG_INFO_WRITE) */
+	song_flags_t m_flags;
 } irw_queue_t;
 
 /* Initialize info read/write thread */
@@ -46,8 +62,17 @@ void irw_free( void );
 /* Add song to the queue */
 void irw_push( song_t *song, song_flags_t flag );
 
-/* Get song from the queue */
-song_t *irw_pop( void );
+/* Queue song for reading its info if it is scheduled for that */
+void irw_push_scheduled( song_t *song );
+
+/* Wait until info of the song queued for reading is read */
+void irw_wait_read( song_t *song );
+
+/* Make given songs be read before the other ones */
+void irw_prioritize( song_t **songs, int num );
+
+/* Get song from the queue (queue must be locked) */
+song_t *irw_pop( song_flags_t *flags );
 
 /* Thread function */
 void *irw_thread( void *arg );
@@ -0,0 +1,208 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Playback latency statistics implementation.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <gst/gst.h>
+#include "types.h"
+#include "latency.h"
+#include "player.h"
+
+/* Event histogram */
+typedef struct
+{
+	guint64 m_buckets[LAT_NUM_BUCKETS];
+	guint64 m_count;
+	gint64 m_min, m_max, m_sum;
+} lat_hist_t;
+
+static lat_hist_t lat_hists[LAT_NUM_REQS][LAT_NUM_EVENTS];
+
+/* Current request start, its kind and the events still awaited for it */
+static gint64 lat_start_time = 0;
+static int lat_req = LAT_REQ_USER;
+static bool_t lat_pending[LAT_NUM_EVENTS];
+
+/* Time the last track ended at (0 if no track is awaited) */
+static gint64 lat_end_time = 0;
+
+/* Set while the first sink buffer is awaited, so that the sink probe
+ * does nothing most of the time */
+static volatile gint lat_want_buffer = 0;
+
+static pthread_mutex_t lat_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Add a value to the histogram (mutex must be locked) */
+static void lat_add( int req, int event, gint64 us )
+{
+	lat_hist_t *h = &lat_hists[req][event];
+	int b = 0;
+
+	if (us < 0)
+		us = 0;
+	while (b < LAT_NUM_BUCKETS - 1 && us >= ((gint64)1 << b))
+		b ++;
+	h->m_buckets[b] ++;
+	if (h->m_count == 0 || us < h->m_min)
+		h->m_min = us;
+	if (us > h->m_max)
+		h->m_max = us;
+	h->m_sum += us;
+	h->m_count ++;
+} /* End of 'lat_add' function */
+
+/* Start measuring a play request of kind 'req' received at 'stamp' */
+void lat_start( gint64 stamp, int req )
+{
+	int i;
+
+	pthread_mutex_lock(&lat_mutex);
+	lat_start_time = stamp;
+	lat_req = req;
+	for ( i = 0; i < LAT_NUM_EVENTS; i ++ )
+		lat_pending[i] = (i != LAT_TRACK_GAP);
+	g_atomic_int_set(&lat_want_buffer, 1);
+	pthread_mutex_unlock(&lat_mutex);
+} /* End of 'lat_start' function */
+
+/* Record an event of the current request (only the first one counts) */
+void lat_mark( int event )
+{
+	gint64 now = g_get_monotonic_time();
+
+	pthread_mutex_lock(&lat_mutex);
+	if (lat_pending[event])
+	{
+		lat_pending[event] = FALSE;
+		lat_add(lat_req, event, now - lat_start_time);
+	}
+	if (event == LAT_FIRST_BUFFER && lat_end_time != 0)
+	{
+		lat_add(LAT_REQ_AUTO, LAT_TRACK_GAP, now - lat_end_time);
+		lat_end_time = 0;
+	}
+	pthread_mutex_unlock(&lat_mutex);
+} /* End of 'lat_mark' function */
+
+/* Note that a track has ended and the next one is awaited */
+void lat_track_end( void )
+{
+	pthread_mutex_lock(&lat_mutex);
+	lat_end_time = g_get_monotonic_time();
+	g_atomic_int_set(&lat_want_buffer, 1);
+	pthread_mutex_unlock(&lat_mutex);
+} /* End of 'lat_track_end' function */
+
+/* Catch the first buffer going to the sink */
+static GstPadProbeReturn lat_on_buffer( GstPad *pad, GstPadProbeInfo *info,
+		gpointer data )
+{
+	if (g_atomic_int_get(&lat_want_buffer) &&
+			g_atomic_int_compare_and_exchange(&lat_want_buffer, 1, 0))
+		lat_mark(LAT_FIRST_BUFFER);
+	return GST_PAD_PROBE_OK;
+} /* End of 'lat_on_buffer' function */
+
+/* Watch buffers flowing to the audio sink through a pad */
+void lat_attach_pad( GstPad *pad )
+{
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, lat_on_buffer, NULL, NULL);
+} /* End of 'lat_attach_pad' function */
+
+/* Get a percentile estimate from the histogram (upper bucket bound
+ * clamped to the actual maximum) */
+static gint64 lat_percentile( lat_hist_t *h, int percent )
+{
+	guint64 need = (h->m_count * percent + 99) / 100, acc = 0;
+	int b;
+
+	for ( b = 0; b < LAT_NUM_BUCKETS; b ++ )
+	{
+		acc += h->m_buckets[b];
+		if (acc >= need)
+		{
+			gint64 bound = ((gint64)1 << b) - 1;
+			return MIN(bound, h->m_max);
+		}
+	}
+	return h->m_max;
+} /* End of 'lat_percentile' function */
+
+/* Get event statistics for a request kind */
+void lat_get_stats( int req, int event, lat_stats_t *stats )
+{
+	lat_hist_t *h = &lat_hists[req][event];
+
+	memset(stats, 0, sizeof(*stats));
+	pthread_mutex_lock(&lat_mutex);
+	if (h->m_count > 0)
+	{
+		stats->m_count = h->m_count;
+		stats->m_min = h->m_min;
+		stats->m_max = h->m_max;
+		stats->m_sum = h->m_sum;
+		stats->m_p50 = lat_percentile(h, 50);
+		stats->m_p95 = lat_percentile(h, 95);
+	}
+	pthread_mutex_unlock(&lat_mutex);
+} /* End of 'lat_get_stats' function */
+
+/* Get event name */
+const char *lat_event_name( int event )
+{
+	static const char *names[LAT_NUM_EVENTS] = { "command-applied",
+		"pipeline-created", "playing", "first-buffer", "first-position",
+		"track-gap" };
+	return (event >= 0 && event < LAT_NUM_EVENTS) ? names[event] : NULL;
+} /* End of 'lat_event_name' function */
+
+/* Get request kind name */
+const char *lat_req_name( int req )
+{
+	static const char *names[LAT_NUM_REQS] = { "user", "auto" };
+	return (req >= 0 && req < LAT_NUM_REQS) ? names[req] : NULL;
+} /* End of 'lat_req_name' function */
+
+/* Write statistics summary to the log */
+void lat_log_summary( void )
+{
+	int r, i;
+
+	for ( r = 0; r < LAT_NUM_REQS; r ++ )
+		for ( i = 0; i < LAT_NUM_EVENTS; i ++ )
+		{
+			lat_stats_t s;
+
+			lat_get_stats(r, i, &s);
+			if (s.m_count == 0)
+				continue;
+			logger_message(player_log, 0,
+					_("Latency %s %s: %llu samples, min %.1f ms, median %.1f ms, "
+						"95%% %.1f ms, max %.1f ms, mean %.1f ms"),
+					lat_req_name(r), lat_event_name(i), 
+					(unsigned long long)s.m_count,
+					s.m_min / 1000., s.m_p50 / 1000., s.m_p95 / 1000.,
+					s.m_max / 1000., s.m_sum / 1000. / s.m_count);
+		}
+} /* End of 'lat_log_summary' function */
+
+/* End of 'latency.c' file */
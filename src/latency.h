@@ -0,0 +1,82 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Interface for playback latency statistics.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#ifndef __SG_MPFC_LATENCY_H__
+#define __SG_MPFC_LATENCY_H__
+
+#include <gst/gst.h>
+#include "types.h"
+
+/* Measured events. All but the track gap are timed from the moment
+ * the play request has been received */
+#define LAT_CMD_APPLIED			0
+#define LAT_PIPELINE_CREATED	1
+#define LAT_PLAYING				2
+#define LAT_FIRST_BUFFER		3
+#define LAT_FIRST_POSITION		4
+#define LAT_TRACK_GAP			5
+#define LAT_NUM_EVENTS			6
+
+/* Request kinds kept apart: play requests of the user and the advances
+ * to the next track at the end of one. Track gap is an advance event */
+#define LAT_REQ_USER			0
+#define LAT_REQ_AUTO			1
+#define LAT_NUM_REQS			2
+
+/* Histogram buckets: bucket i holds values (in us) below 2^i */
+#define LAT_NUM_BUCKETS 32
+
+/* Event statistics (times are in us) */
+typedef struct
+{
+	guint64 m_count;
+	gint64 m_min, m_max, m_sum;
+	gint64 m_p50, m_p95;
+} lat_stats_t;
+
+/* Start measuring a play request of kind 'req' received at 'stamp' */
+void lat_start( gint64 stamp, int req );
+
+/* Record an event of the current request (only the first one counts) */
+void lat_mark( int event );
+
+/* Note that a track has ended and the next one is awaited */
+void lat_track_end( void );
+
+/* Watch buffers flowing to the audio sink through a pad */
+void lat_attach_pad( GstPad *pad );
+
+/* Get event statistics for a request kind */
+void lat_get_stats( int req, int event, lat_stats_t *stats );
+
+/* Get event name */
+const char *lat_event_name( int event );
+
+/* Get request kind name */
+const char *lat_req_name( int req );
+
+/* Write statistics summary to the log */
+void lat_log_summary( void );
+
+#endif
+
+/* End of 'latency.h' file */
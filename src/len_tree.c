@@ -0,0 +1,151 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Song lengths tree implementation.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "len_tree.h"
+
+/* Lowest set bit of a node index */
+#define LTREE_LOWBIT(i) ((i) & (-(i)))
+
+/* Create an empty tree */
+ltree_t *ltree_new( void )
+{
+	ltree_t *t = (ltree_t *)malloc(sizeof(*t));
+	if (t == NULL)
+		return NULL;
+	t->m_tree = NULL;
+	t->m_len = t->m_capacity = 0;
+	return t;
+} /* End of 'ltree_new' function */
+
+/* Free tree */
+void ltree_free( ltree_t *t )
+{
+	if (t == NULL)
+		return;
+	free(t->m_tree);
+	free(t);
+} /* End of 'ltree_free' function */
+
+/* Make room for 'len' songs */
+static bool_t ltree_reserve( ltree_t *t, int len )
+{
+	song_time_t *tree;
+	int capacity;
+
+	if (len <= t->m_capacity)
+		return TRUE;
+	capacity = (t->m_capacity < 16) ? 16 : t->m_capacity * 2;
+	if (capacity < len)
+		capacity = len;
+
+	/* Node 0 is not used */
+	tree = (song_time_t *)realloc(t->m_tree, sizeof(*tree) * (capacity + 1));
+	if (tree == NULL)
+		return FALSE;
+	t->m_tree = tree;
+	t->m_capacity = capacity;
+	return TRUE;
+} /* End of 'ltree_reserve' function */
+
+/* Get total length of the first 'num' songs */
+static song_time_t ltree_prefix( ltree_t *t, int num )
+{
+	song_time_t sum = 0;
+
+	for ( ; num > 0; num -= LTREE_LOWBIT(num) )
+		sum += t->m_tree[num];
+	return sum;
+} /* End of 'ltree_prefix' function */
+
+/* Build tree for songs array in O(n) */
+bool_t ltree_build( ltree_t *t, song_t **songs, int num )
+{
+	int i;
+
+	t->m_len = 0;
+	if (!ltree_reserve(t, num))
+		return FALSE;
+
+	/* Every node passes its sum to the parent, which covers it */
+	for ( i = 1; i <= num; i ++ )
+		t->m_tree[i] = songs[i - 1]->m_len;
+	for ( i = 1; i <= num; i ++ )
+	{
+		int parent = i + LTREE_LOWBIT(i);
+		if (parent <= num)
+			t->m_tree[parent] += t->m_tree[i];
+	}
+	t->m_len = num;
+	return TRUE;
+} /* End of 'ltree_build' function */
+
+/* Add songs to the end */
+bool_t ltree_append( ltree_t *t, song_t **songs, int num )
+{
+	int i;
+
+	if (!ltree_reserve(t, t->m_len + num))
+		return FALSE;
+
+	/* A new node covers the song and a range already in the tree */
+	for ( i = 0; i < num; i ++ )
+	{
+		int node = t->m_len + 1;
+		t->m_tree[node] = songs[i]->m_len + ltree_prefix(t, node - 1) - 
+			ltree_prefix(t, node - LTREE_LOWBIT(node));
+		t->m_len = node;
+	}
+	return TRUE;
+} /* End of 'ltree_append' function */
+
+/* Set length of song at a position */
+void ltree_set( ltree_t *t, int pos, song_time_t len )
+{
+	song_time_t delta;
+	int node;
+
+	if (pos < 0 || pos >= t->m_len)
+		return;
+	delta = len - ltree_sum(t, pos, pos);
+	if (delta == 0)
+		return;
+	for ( node = pos + 1; node <= t->m_len; node += LTREE_LOWBIT(node) )
+		t->m_tree[node] += delta;
+} /* End of 'ltree_set' function */
+
+/* Get total length of songs at positions from 'start' to 'end'
+ * (inclusive) */
+song_time_t ltree_sum( ltree_t *t, int start, int end )
+{
+	if (start < 0)
+		start = 0;
+	if (end >= t->m_len)
+		end = t->m_len - 1;
+	if (start > end)
+		return 0;
+	return ltree_prefix(t, end + 1) - ltree_prefix(t, start);
+} /* End of 'ltree_sum' function */
+
+/* End of 'len_tree.c' file */
@@ -0,0 +1,59 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Interface for song lengths tree.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#ifndef __SG_MPFC_LEN_TREE_H__
+#define __SG_MPFC_LEN_TREE_H__
+
+#include "types.h"
+#include "main_types.h"
+
+/* Binary indexed (Fenwick) tree over lengths of a songs array. Node i
+ * (counting from 1) keeps the sum of lengths of songs (i - lowbit(i), i],
+ * so both prefix sums and updates take O(log n) */
+typedef struct tag_ltree_t
+{
+	song_time_t *m_tree;
+	int m_len, m_capacity;
+} ltree_t;
+
+/* Create an empty tree */
+ltree_t *ltree_new( void );
+
+/* Free tree */
+void ltree_free( ltree_t *t );
+
+/* Build tree for songs array in O(n) */
+bool_t ltree_build( ltree_t *t, song_t **songs, int num );
+
+/* Add songs to the end */
+bool_t ltree_append( ltree_t *t, song_t **songs, int num );
+
+/* Set length of song at a position */
+void ltree_set( ltree_t *t, int pos, song_time_t len );
+
+/* Get total length of songs at positions from 'start' to 'end'
+ * (inclusive) */
+song_time_t ltree_sum( ltree_t *t, int start, int end );
+
+#endif
+
+/* End of 'len_tree.h' file */
@@ -40,12 +40,19 @@ typedef enum
 
 typedef int64_t song_time_t;
 
+/* Song identifier. Every song gets a unique one when created (0 is
+ * never used) */
+typedef uint64_t song_id_t;
+
 /* Song type */
 typedef struct tag_song_t
 {
 	/* Song title */
 	str_t *m_title;
 
+	/* Song identifier */
+	song_id_t m_id;
+
 	/* Full name in an URI form (with prefix and escaped special symbols) */
 	char *m_fullname;
 
@@ -93,6 +100,19 @@ typedef struct tag_song_metadata_t
 
 #define SONG_METADATA_EMPTY { NULL, -1, NULL, -1, -1 }
 
+/* Filtered play list view */
+typedef struct tag_plist_view_t
+{
+	/* Filter string */
+	char *m_filter;
+
+	/* Positions of the matching songs in the list (ascending) and
+	 * their ids, by which they are found after the list has changed */
+	int *m_pos;
+	song_id_t *m_ids;
+	int m_len;
+} plist_view_t;
+
 /* Play list type */
 typedef struct
 {
@@ -114,8 +134,41 @@ typedef struct
 	/* List size */
 	int m_len;
 
-	/* Songs list */
+	/* Songs list and the number of allocated entries (grows
+	 * geometrically) */
 	song_t **m_list;
+	int m_capacity;
+
+	/* Search index */
+	struct tag_sidx_t *m_sidx;
+
+	/* Changes whenever songs are added, removed or moved */
+	unsigned m_gen;
+
+	/* Filter views stack. The top is the current view; each of the
+	 * others has a filter contained in the next one's, so it can be
+	 * restored when filter gets shorter */
+	plist_view_t *m_views;
+	int m_num_views, m_views_capacity;
+
+	/* Size of scrolled part of the view */
+	int m_view_scrolled;
+
+	/* List state the views were made for and ids of songs added or
+	 * retitled since then (the latter under the global lock) */
+	unsigned m_view_gen;
+	struct _GHashTable *m_view_pending;
+
+	/* Song lengths tree and the list state it has been built for */
+	struct tag_ltree_t *m_lens;
+	unsigned m_lens_gen;
+
+	/* Ids of songs whose length has changed (under the global lock) */
+	struct _GHashTable *m_len_pending;
+
+	/* Song id -> its position + 1. Kept up to date by every change of
+	 * the songs order */
+	struct _GHashTable *m_id_index;
 
 	/* Mutex for synchronization play list operations */
 	pthread_mutex_t m_mutex;
@@ -0,0 +1,330 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Song metadata cache implementation.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include "types.h"
+#include "md_cache.h"
+#include "player.h"
+#include "util.h"
+
+/* Number of song info strings stored */
+#define MDC_NUM_STRINGS 8
+
+/* Records are kept either in the mapped file or in the memory. Both
+ * are indexed by file name (which points into the record) */
+static GHashTable *mdc_table = NULL;
+static void *mdc_map = NULL;
+static size_t mdc_map_size = 0;
+static char *mdc_file_name = NULL;
+static bool_t mdc_dirty = FALSE;
+static int mdc_hits = 0, mdc_misses = 0;
+static pthread_mutex_t mdc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Get song info string fields in the order they are stored */
+static void mdc_info_fields( song_info_t *si, char ***fields )
+{
+	fields[0] = &si->m_artist;
+	fields[1] = &si->m_name;
+	fields[2] = &si->m_album;
+	fields[3] = &si->m_year;
+	fields[4] = &si->m_genre;
+	fields[5] = &si->m_comments;
+	fields[6] = &si->m_track;
+	fields[7] = &si->m_own_data;
+} /* End of 'mdc_info_fields' function */
+
+/* Get file name of a record */
+static inline char *mdc_record_name( mdc_record_t *r )
+{
+	return (char *)(r + 1);
+} /* End of 'mdc_record_name' function */
+
+/* Free a record if it is not in the mapped file */
+static void mdc_record_free( gpointer data )
+{
+	char *r = (char *)data;
+
+	if (mdc_map == NULL || r < (char *)mdc_map ||
+			r >= (char *)mdc_map + mdc_map_size)
+		free(r);
+} /* End of 'mdc_record_free' function */
+
+/* Check that a record in the mapped file is well formed */
+static bool_t mdc_record_valid( mdc_record_t *r, size_t avail )
+{
+	char *p, *end;
+	int i;
+
+	if (avail < sizeof(*r) || r->m_size < sizeof(*r) ||
+			r->m_size > avail || (r->m_size & 7))
+		return FALSE;
+
+	/* File name and all the strings must end within the record */
+	p = mdc_record_name(r);
+	end = (char *)r + r->m_size;
+	for ( i = 0; i <= MDC_NUM_STRINGS; i ++ )
+	{
+		char *z = memchr(p, 0, end - p);
+		if (z == NULL)
+			return FALSE;
+		p = z + 1;
+	}
+	return TRUE;
+} /* End of 'mdc_record_valid' function */
+
+/* Load cache from file */
+bool_t mdc_init( const char *file_name )
+{
+	struct stat st;
+	mdc_header_t *h;
+	size_t offset;
+	guint32 i;
+	int fd;
+
+	mdc_table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+			mdc_record_free);
+	mdc_file_name = strdup(file_name);
+	if (mdc_table == NULL || mdc_file_name == NULL)
+		return FALSE;
+
+	/* No cache yet */
+	fd = open(file_name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return TRUE;
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(mdc_header_t))
+	{
+		close(fd);
+		return TRUE;
+	}
+	mdc_map_size = st.st_size;
+	mdc_map = mmap(NULL, mdc_map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mdc_map == MAP_FAILED)
+	{
+		mdc_map = NULL;
+		mdc_map_size = 0;
+		return TRUE;
+	}
+
+	h = (mdc_header_t *)mdc_map;
+	if (memcmp(h->m_magic, MDC_MAGIC, sizeof(h->m_magic)))
+	{
+		logger_error(player_log, 0, _("Metadata cache %s is invalid"), file_name);
+		return TRUE;
+	}
+
+	/* Index records */
+	offset = sizeof(*h);
+	for ( i = 0; i < h->m_num_records; i ++ )
+	{
+		mdc_record_t *r = (mdc_record_t *)((char *)mdc_map + offset);
+		if (!mdc_record_valid(r, mdc_map_size - offset))
+		{
+			logger_error(player_log, 0, _("Metadata cache %s is damaged"),
+					file_name);
+			mdc_dirty = TRUE;
+			break;
+		}
+		g_hash_table_replace(mdc_table, mdc_record_name(r), r);
+		offset += r->m_size;
+	}
+	logger_message(player_log, 1, _("Loaded %u metadata cache entries"),
+			g_hash_table_size(mdc_table));
+	return TRUE;
+} /* End of 'mdc_init' function */
+
+/* Write the cache to file */
+static void mdc_save( void )
+{
+	mdc_header_t h;
+	GHashTableIter iter;
+	gpointer r;
+	char *tmp_name;
+	FILE *fd;
+	bool_t ok;
+
+	tmp_name = util_strcat(mdc_file_name, ".tmp", NULL);
+	if (tmp_name == NULL)
+		return;
+	fd = fopen(tmp_name, "wb");
+	if (fd == NULL)
+	{
+		free(tmp_name);
+		return;
+	}
+
+	memcpy(h.m_magic, MDC_MAGIC, sizeof(h.m_magic));
+	h.m_num_records = g_hash_table_size(mdc_table);
+	h.m_reserved = 0;
+	ok = (fwrite(&h, sizeof(h), 1, fd) == 1);
+	g_hash_table_iter_init(&iter, mdc_table);
+	while (ok && g_hash_table_iter_next(&iter, NULL, &r))
+		ok = (fwrite(r, ((mdc_record_t *)r)->m_size, 1, fd) == 1);
+	ok = (fclose(fd) == 0) && ok;
+
+	/* Replace the old file only when the new one is complete */
+	if (!ok || rename(tmp_name, mdc_file_name))
+	{
+		logger_error(player_log, 0, _("Unable to save metadata cache %s"),
+				mdc_file_name);
+		unlink(tmp_name);
+	}
+	free(tmp_name);
+} /* End of 'mdc_save' function */
+
+/* Save cache and free it */
+void mdc_free( void )
+{
+	if (mdc_table == NULL)
+		return;
+
+	logger_message(player_log, 0, _("Metadata cache: %d hits, %d misses"),
+			mdc_hits, mdc_misses);
+	if (mdc_dirty)
+		mdc_save();
+
+	/* Table has to go before the mapping its records are checked against */
+	g_hash_table_destroy(mdc_table);
+	mdc_table = NULL;
+	if (mdc_map != NULL)
+	{
+		munmap(mdc_map, mdc_map_size);
+		mdc_map = NULL;
+		mdc_map_size = 0;
+	}
+	free(mdc_file_name);
+	mdc_file_name = NULL;
+	mdc_dirty = FALSE;
+} /* End of 'mdc_free' function */
+
+/* Get cached info for a file with the given state. Returns NULL if
+ * there is no valid entry */
+song_info_t *mdc_lookup( const char *file_name, const struct stat *st,
+		song_time_t *len )
+{
+	song_info_t *si = NULL;
+	mdc_record_t *r;
+
+	if (mdc_table == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&mdc_mutex);
+	r = (mdc_record_t *)g_hash_table_lookup(mdc_table, file_name);
+	if (r != NULL && r->m_file_size == st->st_size &&
+			r->m_mtime == st->st_mtim.tv_sec &&
+			r->m_mtime_nsec == st->st_mtim.tv_nsec)
+		si = si_new();
+	if (si != NULL)
+	{
+		char **fields[MDC_NUM_STRINGS];
+		char *p = mdc_record_name(r);
+		int i;
+
+		mdc_info_fields(si, fields);
+		for ( i = 0; i < MDC_NUM_STRINGS; i ++ )
+		{
+			p += strlen(p) + 1;
+			if (!(r->m_str_mask & (1 << i)))
+				continue;
+			free(*fields[i]);
+			*fields[i] = strdup(p);
+		}
+		si->m_flags = r->m_info_flags;
+		(*len) = r->m_len;
+		mdc_hits ++;
+	}
+	else
+		mdc_misses ++;
+	pthread_mutex_unlock(&mdc_mutex);
+	return si;
+} /* End of 'mdc_lookup' function */
+
+/* Put info read from a file with the given state to the cache */
+void mdc_store( const char *file_name, const struct stat *st,
+		song_info_t *si, song_time_t len )
+{
+	char **fields[MDC_NUM_STRINGS];
+	size_t size, name_len = strlen(file_name) + 1;
+	mdc_record_t *r;
+	char *p;
+	int i;
+
+	if (mdc_table == NULL || si == NULL)
+		return;
+
+	/* Build the record exactly the way it is stored in file */
+	mdc_info_fields(si, fields);
+	size = sizeof(*r) + name_len;
+	for ( i = 0; i < MDC_NUM_STRINGS; i ++ )
+		size += (*fields[i] == NULL ? 0 : strlen(*fields[i])) + 1;
+	size = (size + 7) & ~(size_t)7;
+	r = (mdc_record_t *)calloc(1, size);
+	if (r == NULL)
+		return;
+	r->m_size = size;
+	r->m_file_size = st->st_size;
+	r->m_mtime = st->st_mtim.tv_sec;
+	r->m_mtime_nsec = st->st_mtim.tv_nsec;
+	r->m_len = len;
+	r->m_info_flags = si->m_flags;
+	p = mdc_record_name(r);
+	memcpy(p, file_name, name_len);
+	p += name_len;
+	for ( i = 0; i < MDC_NUM_STRINGS; i ++ )
+	{
+		if (*fields[i] != NULL)
+		{
+			size_t l = strlen(*fields[i]);
+			memcpy(p, *fields[i], l);
+			p += l;
+			r->m_str_mask |= (1 << i);
+		}
+		p ++;
+	}
+
+	pthread_mutex_lock(&mdc_mutex);
+	g_hash_table_replace(mdc_table, mdc_record_name(r), r);
+	mdc_dirty = TRUE;
+	pthread_mutex_unlock(&mdc_mutex);
+} /* End of 'mdc_store' function */
+
+/* Remove file entry */
+void mdc_invalidate( const char *file_name )
+{
+	if (mdc_table == NULL)
+		return;
+
+	pthread_mutex_lock(&mdc_mutex);
+	if (g_hash_table_remove(mdc_table, file_name))
+		mdc_dirty = TRUE;
+	pthread_mutex_unlock(&mdc_mutex);
+} /* End of 'mdc_invalidate' function */
+
+/* End of 'md_cache.c' file */
@@ -0,0 +1,83 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Interface for song metadata cache.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#ifndef __SG_MPFC_MD_CACHE_H__
+#define __SG_MPFC_MD_CACHE_H__
+
+#include <sys/stat.h>
+#include <glib.h>
+#include "types.h"
+#include "main_types.h"
+#include "song_info.h"
+
+/* Cache file signature */
+#define MDC_MAGIC "MPFCMDC1"
+
+/* Cache file header. Records follow it */
+typedef struct
+{
+	char m_magic[8];
+	guint32 m_num_records;
+	guint32 m_reserved;
+} mdc_header_t;
+
+/* Record header. It is followed by the file name and song info strings
+ * (all zero-terminated); records are aligned to 8 bytes, so the cache
+ * file may be used mapped into memory as is */
+typedef struct
+{
+	guint32 m_size;
+
+	/* Bit i is set if i-th info string is present */
+	guint32 m_str_mask;
+
+	/* File state the info has been read for */
+	gint64 m_file_size;
+	gint64 m_mtime;
+	gint64 m_mtime_nsec;
+
+	song_time_t m_len;
+	guint32 m_info_flags;
+	guint32 m_reserved;
+} mdc_record_t;
+
+/* Load cache from file */
+bool_t mdc_init( const char *file_name );
+
+/* Save cache and free it */
+void mdc_free( void );
+
+/* Get cached info for a file with the given state. Returns NULL if
+ * there is no valid entry */
+song_info_t *mdc_lookup( const char *file_name, const struct stat *st,
+		song_time_t *len );
+
+/* Put info read from a file with the given state to the cache */
+void mdc_store( const char *file_name, const struct stat *st,
+		song_info_t *si, song_time_t len );
+
+/* Remove file entry */
+void mdc_invalidate( const char *file_name );
+
+#endif
+
+/* End of 'md_cache.h' file */
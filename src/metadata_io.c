@@ -20,10 +20,13 @@
  * MA 02111-1307, USA.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <gst/gst.h>
 #include <tag_c.h>
+#include "md_cache.h"
 #include "metadata_io.h"
 #include "util.h"
 	
@@ -196,9 +199,29 @@ finally:
 	return si;
 } /* End of 'md_get_info_gst' function */
 	
+/* Make TagLib return strings owned by the caller. Its own list of
+ * strings to free is global and can't be used by several threads */
+static pthread_once_t md_taglib_once = PTHREAD_ONCE_INIT;
+
+static void md_taglib_init( void )
+{
+	taglib_set_string_management_enabled(FALSE);
+} /* End of 'md_taglib_init' function */
+
+/* Set song info field from a string returned by TagLib */
+static void md_set_taglib_str( song_info_t *si,
+		void (*setter)( song_info_t *, const char * ), char *str )
+{
+	setter(si, str);
+	if (str != NULL)
+		taglib_free(str);
+} /* End of 'md_set_taglib_str' function */
+
 /* Get song information using taglib */
 static song_info_t *md_get_info_taglib( const char *file_name, song_time_t *len )
 {
+	pthread_once(&md_taglib_once, md_taglib_init);
+
 	TagLib_File *file = taglib_file_new(file_name);
 	if (!file)
 		return NULL;
@@ -211,11 +234,11 @@ static song_info_t *md_get_info_taglib( const char *file_name, song_time_t *len
 	TagLib_Tag *tag = taglib_file_tag(file);
 
 	song_info_t *si = si_new();
-	si_set_name(si, taglib_tag_title(tag));
-	si_set_artist(si, taglib_tag_artist(tag));
-	si_set_album(si, taglib_tag_album(tag));
-	si_set_comments(si, taglib_tag_comment(tag));
-	si_set_genre(si, taglib_tag_genre(tag));
+	md_set_taglib_str(si, si_set_name, taglib_tag_title(tag));
+	md_set_taglib_str(si, si_set_artist, taglib_tag_artist(tag));
+	md_set_taglib_str(si, si_set_album, taglib_tag_album(tag));
+	md_set_taglib_str(si, si_set_comments, taglib_tag_comment(tag));
+	md_set_taglib_str(si, si_set_genre, taglib_tag_genre(tag));
 
 	unsigned year = taglib_tag_year(tag);
 	if (year > 0)
@@ -235,7 +258,6 @@ static song_info_t *md_get_info_taglib( const char *file_name, song_time_t *len
 
 	(*len) = SECONDS_TO_TIME(taglib_audioproperties_length(taglib_file_audioproperties(file)));
 
-	taglib_tag_free_strings();
 	taglib_file_free(file);
 	return si;
 } /* End of 'md_get_info_taglib' function */
@@ -243,18 +265,27 @@ static song_info_t *md_get_info_taglib( const char *file_name, song_time_t *len
 /* Get song information function */
 song_info_t *md_get_info( const char *file_name, const char *full_uri, song_time_t *len )
 {
+	song_info_t *si = NULL;
+	struct stat st;
+	bool_t cached = FALSE;
+
 	(*len) = 0;
 	
 	if (file_name)
 	{
-		song_info_t *si = md_get_info_taglib(file_name, len);
-		if (si)
+		/* Files which have not changed are not read again */
+		cached = !stat(file_name, &st);
+		if (cached && (si = mdc_lookup(file_name, &st, len)) != NULL)
 			return si;
+
+		si = md_get_info_taglib(file_name, len);
 	}
 
-	if (full_uri)
-		return md_get_info_gst(full_uri, len);
-	return NULL;
+	if (si == NULL && full_uri)
+		si = md_get_info_gst(full_uri, len);
+	if (si != NULL && cached)
+		mdc_store(file_name, &st, si, *len);
+	return si;
 } /* End of 'md_get_info' function */
 
 /* Save song information function */
@@ -0,0 +1,208 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Play queue implementation.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <glib.h>
+#include "types.h"
+#include "play_queue.h"
+
+/* Create a queue */
+pq_t *pq_new( void )
+{
+	pq_t *q = (pq_t *)malloc(sizeof(*q));
+	if (q == NULL)
+		return NULL;
+
+	q->m_ring = NULL;
+	q->m_head = q->m_len = q->m_capacity = 0;
+	q->m_taken = 0;
+
+	/* Keys point into the entries, which the table owns */
+	q->m_index = g_hash_table_new_full(g_int64_hash, g_int64_equal, 
+			NULL, free);
+	if (q->m_index == NULL)
+	{
+		free(q);
+		return NULL;
+	}
+	pthread_mutex_init(&q->m_mutex, NULL);
+	return q;
+} /* End of 'pq_new' function */
+
+/* Free queue */
+void pq_free( pq_t *q )
+{
+	if (q == NULL)
+		return;
+
+	g_hash_table_destroy(q->m_index);
+	free(q->m_ring);
+	pthread_mutex_destroy(&q->m_mutex);
+	free(q);
+} /* End of 'pq_free' function */
+
+/* Make room for one more entry (queue must be locked) */
+static bool_t pq_grow( pq_t *q )
+{
+	pq_entry_t **ring;
+	int capacity, i;
+
+	if (q->m_len < q->m_capacity)
+		return TRUE;
+	capacity = (q->m_capacity == 0) ? 16 : q->m_capacity * 2;
+	ring = (pq_entry_t **)malloc(sizeof(*ring) * capacity);
+	if (ring == NULL)
+		return FALSE;
+
+	/* Unwrap the ring */
+	for ( i = 0; i < q->m_len; i ++ )
+		ring[i] = q->m_ring[(q->m_head + i) % q->m_capacity];
+	free(q->m_ring);
+	q->m_ring = ring;
+	q->m_head = 0;
+	q->m_capacity = capacity;
+	return TRUE;
+} /* End of 'pq_grow' function */
+
+/* Add song to the end. Returns FALSE if it is already queued */
+bool_t pq_push( pq_t *q, song_id_t id )
+{
+	pq_entry_t *e;
+	bool_t ok = FALSE;
+
+	pthread_mutex_lock(&q->m_mutex);
+	if (id != 0 && g_hash_table_lookup(q->m_index, &id) == NULL &&
+			pq_grow(q) && (e = (pq_entry_t *)malloc(sizeof(*e))) != NULL)
+	{
+		e->m_id = id;
+		e->m_seq = q->m_taken + q->m_len;
+		q->m_ring[(q->m_head + q->m_len) % q->m_capacity] = e;
+		q->m_len ++;
+		g_hash_table_insert(q->m_index, &e->m_id, e);
+		ok = TRUE;
+	}
+	pthread_mutex_unlock(&q->m_mutex);
+	return ok;
+} /* End of 'pq_push' function */
+
+/* Take the first song. Returns 0 if queue is empty */
+song_id_t pq_pop( pq_t *q )
+{
+	song_id_t id = 0;
+
+	pthread_mutex_lock(&q->m_mutex);
+	if (q->m_len > 0)
+	{
+		pq_entry_t *e = q->m_ring[q->m_head];
+		id = e->m_id;
+		q->m_head = (q->m_head + 1) % q->m_capacity;
+		q->m_len --;
+		q->m_taken ++;
+
+		/* This frees the entry */
+		g_hash_table_remove(q->m_index, &id);
+	}
+	pthread_mutex_unlock(&q->m_mutex);
+	return id;
+} /* End of 'pq_pop' function */
+
+/* Forget songs removed from the play list, so that places of the
+ * songs after them stay right */
+void pq_remove( pq_t *q, song_t **songs, int num )
+{
+	int i, j, removed = 0;
+
+	pthread_mutex_lock(&q->m_mutex);
+	for ( i = 0; i < num && removed < q->m_len; i ++ )
+	{
+		pq_entry_t *e = (pq_entry_t *)g_hash_table_lookup(q->m_index, 
+				&songs[i]->m_id);
+		if (e == NULL)
+			continue;
+
+		/* Entry is freed below, when it is dropped from the ring */
+		g_hash_table_steal(q->m_index, &e->m_id);
+		e->m_id = 0;
+		removed ++;
+	}
+
+	/* Close the gaps and number the rest again */
+	if (removed > 0)
+	{
+		for ( i = 0, j = 0; i < q->m_len; i ++ )
+		{
+			pq_entry_t *e = q->m_ring[(q->m_head + i) % q->m_capacity];
+			if (e->m_id == 0)
+			{
+				free(e);
+				continue;
+			}
+			e->m_seq = q->m_taken + j;
+			q->m_ring[(q->m_head + j) % q->m_capacity] = e;
+			j ++;
+		}
+		q->m_len = j;
+	}
+	pthread_mutex_unlock(&q->m_mutex);
+} /* End of 'pq_remove' function */
+
+/* Get id of song at a place (counting from 0). Returns 0 if there is
+ * no such place */
+song_id_t pq_get( pq_t *q, int index )
+{
+	song_id_t id = 0;
+
+	pthread_mutex_lock(&q->m_mutex);
+	if (index >= 0 && index < q->m_len)
+		id = q->m_ring[(q->m_head + index) % q->m_capacity]->m_id;
+	pthread_mutex_unlock(&q->m_mutex);
+	return id;
+} /* End of 'pq_get' function */
+
+/* Get the number of queued songs */
+int pq_len( pq_t *q )
+{
+	int len;
+
+	pthread_mutex_lock(&q->m_mutex);
+	len = q->m_len;
+	pthread_mutex_unlock(&q->m_mutex);
+	return len;
+} /* End of 'pq_len' function */
+
+/* Get place of a song in the queue (counting from 1). Returns 0 if
+ * song is not queued */
+int pq_find( pq_t *q, song_id_t id )
+{
+	pq_entry_t *e;
+	int place = 0;
+
+	pthread_mutex_lock(&q->m_mutex);
+	e = (pq_entry_t *)g_hash_table_lookup(q->m_index, &id);
+	if (e != NULL)
+		place = (int)(e->m_seq - q->m_taken) + 1;
+	pthread_mutex_unlock(&q->m_mutex);
+	return place;
+} /* End of 'pq_find' function */
+
+/* End of 'play_queue.c' file */
@@ -0,0 +1,85 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Interface for play queue.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#ifndef __SG_MPFC_PLAY_QUEUE_H__
+#define __SG_MPFC_PLAY_QUEUE_H__
+
+#include <pthread.h>
+#include <glib.h>
+#include "types.h"
+#include "main_types.h"
+
+/* Queue entry */
+typedef struct
+{
+	song_id_t m_id;
+
+	/* Number of songs taken from the queue before this one */
+	guint64 m_seq;
+} pq_entry_t;
+
+/* Queue of songs to be played next. Songs are kept by ids, so the
+ * queue stays valid whatever happens to the play list */
+typedef struct tag_pq_t
+{
+	/* Ring of entries */
+	pq_entry_t **m_ring;
+	int m_head, m_len, m_capacity;
+
+	/* Number of songs taken from the queue so far */
+	guint64 m_taken;
+
+	/* Song id -> its entry */
+	GHashTable *m_index;
+
+	pthread_mutex_t m_mutex;
+} pq_t;
+
+/* Create a queue */
+pq_t *pq_new( void );
+
+/* Free queue */
+void pq_free( pq_t *q );
+
+/* Add song to the end. Returns FALSE if it is already queued */
+bool_t pq_push( pq_t *q, song_id_t id );
+
+/* Take the first song. Returns 0 if queue is empty */
+song_id_t pq_pop( pq_t *q );
+
+/* Forget songs removed from the play list */
+void pq_remove( pq_t *q, song_t **songs, int num );
+
+/* Get id of song at a place (counting from 0). Returns 0 if there is
+ * no such place */
+song_id_t pq_get( pq_t *q, int index );
+
+/* Get the number of queued songs */
+int pq_len( pq_t *q );
+
+/* Get place of a song in the queue (counting from 1). Returns 0 if
+ * song is not queued */
+int pq_find( pq_t *q, song_id_t id );
+
+#endif
+
+/* End of 'play_queue.h' file */
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <glib-unix.h>
 #include <gst/gst.h>
 #include <gst/audio/streamvolume.h>
 #include <gst/audio/audio.h>
@@ -41,9 +42,11 @@
 #include "logger.h"
 #include "logger_view.h"
 #include "main_types.h"
+#include "md_cache.h"
 #include "player.h"
 #include "plist.h"
 #include "pmng.h"
+#include "search_index.h"
 #include "server.h"
 #include "test.h"
 #include "undo.h"
@@ -63,6 +66,17 @@
 #include "wnd_repval.h"
 #include "info_rw_thread.h"
 #include "genp.h"
+#include "dsp.h"
+#include "latency.h"
+#include "prefetch.h"
+#include "rg_analyzer.h"
+#include "xfade.h"
+
+/* Standby pipeline states */
+#define PLAYER_STANDBY_NONE			0
+#define PLAYER_STANDBY_PREROLLING	1
+#define PLAYER_STANDBY_SEEKING		2
+#define PLAYER_STANDBY_READY		3
 
 /*****
  *
@@ -99,9 +113,169 @@ volatile bool_t player_end_track = FALSE;
 /* Player context */
 player_context_t *player_context = NULL;
 
-bool_t player_end_of_stream = FALSE;
 GstElement *player_pipeline = NULL;
 
+/* Are we running the decode benchmark instead of the interface? */
+static bool_t player_bench = FALSE;
+
+/* Pipeline has to be recreated before playing next track */
+volatile bool_t player_pipeline_invalid = FALSE;
+
+/* Standby pipeline pre-rolling the predicted next song */
+static GstElement *player_standby = NULL;
+static GSource *player_standby_bus_watch = NULL;
+static song_t *player_standby_song = NULL;
+static int player_standby_state = PLAYER_STANDBY_NONE;
+
+/* Song pre-picked for the next shuffle step */
+static int player_shuffle_next = -1;
+
+/* ReplayGain volume scale of the song being played */
+static double player_rgain_scale = 1.;
+
+/* Bus watch source and currently watched audio pad */
+static GSource *player_bus_watch = NULL;
+static GstPad *player_audio_pad = NULL;
+
+/* Output buffering measured when playback last started (in us) */
+static volatile gint64 player_out_buffer_time = 0, player_out_latency_time = 0;
+
+/* Player thread main context and loop */
+static GMainContext *player_main_ctx = NULL;
+static GMainLoop *player_main_loop = NULL;
+
+/* Player thread commands */
+#define PLAYER_CMD_SYNC			0
+#define PLAYER_CMD_QUIT			1
+#define PLAYER_CMD_PLAY			2
+#define PLAYER_CMD_START_PLAY	3
+#define PLAYER_CMD_RESUME		4
+#define PLAYER_CMD_PAUSE_RESUME	5
+#define PLAYER_CMD_STOP			6
+#define PLAYER_CMD_END_PLAY		7
+#define PLAYER_CMD_SKIP			8
+#define PLAYER_CMD_SEEK			9
+#define PLAYER_CMD_VOLUME		10
+#define PLAYER_CMD_STATUS		11
+#define PLAYER_CMD_TIME_BACK	12
+
+/* A command with its parameters */
+typedef struct
+{
+	/* Ring slot sequence number (see 'player_cmd_push') */
+	volatile gint m_seq;
+
+	int m_type;
+	int m_int;
+	song_time_t m_time;
+	double m_val;
+	bool_t m_flag;
+
+	/* Request time */
+	gint64 m_stamp;
+
+	/* Set when a synchronous command has been applied */
+	volatile bool_t *m_done;
+} player_cmd_t;
+
+/* Command channel to the player thread: a ring any thread may put 
+ * commands to without locking. The player thread applies them in order.
+ * Pipe is only used to wake the thread up */
+#define PLAYER_CMD_RING_SIZE 256
+static player_cmd_t player_cmd_ring[PLAYER_CMD_RING_SIZE];
+static volatile gint player_cmd_tail = 0;
+static guint player_cmd_head = 0;
+static volatile gint player_cmd_wakeup = 0;
+static int player_cmd_pipe[2] = { -1, -1 };
+
+/* Request time of the command being applied (0 if none) */
+static gint64 player_cmd_stamp = 0;
+
+/* Synchronous commands completion notification */
+static pthread_mutex_t player_cmd_done_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t player_cmd_done_cond = PTHREAD_COND_INITIALIZER;
+
+/* Player thread identity */
+static pthread_t player_thread_self;
+static volatile bool_t player_thread_running = FALSE;
+
+/* Incremented on each play request so that the thread can see that track
+ * has to be restarted */
+static volatile unsigned player_track_gen = 0;
+
+/* State of the track being played in the player thread */
+static bool_t player_track_active = FALSE;
+static unsigned player_active_gen = 0;
+static int player_applied_status = PLAYER_STATUS_STOPPED;
+
+/* Track waits for the pipeline to pre-roll before it is sought to its
+ * start time and played (this is done from the bus handler) */
+static bool_t player_start_pending = FALSE;
+
+/* Position update timer */
+static GSource *player_time_timer = NULL;
+
+/* Position service. Pipeline is sampled rarely and the position is
+ * interpolated by the monotonic clock in between. Changes are published
+ * when the position crosses a granularity step */
+static volatile bool_t player_pos_valid = FALSE;
+static gint64 player_pos_sample = 0, player_pos_sample_time = 0;
+static gint64 player_pos_step = -1;
+static gint64 player_pos_granularity = GST_SECOND;
+static gint64 player_pos_sample_interval = G_USEC_PER_SEC;
+
+/* Song being played by the pipeline now */
+static song_t *player_song_played = NULL;
+
+/* Next track chosen in advance at 'about-to-finish' for gapless playback.
+ * If the song's URI was handed to playbin, transition is completed when
+ * the new stream starts */
+static pthread_mutex_t player_gapless_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool_t player_gapless_decided = FALSE;
+static bool_t player_gapless_queued = FALSE;
+static int player_gapless_index = -1;
+static song_t *player_gapless_song = NULL;
+
+/* Crossfade engine (used instead of playbin when crossfade is on) and
+ * timer completing the transition to the faded in song */
+static xfade_t *player_xfade = NULL;
+static GSource *player_xfade_timer = NULL;
+
+/* When the crossfade timer fires (monotonic time) and the time it had
+ * left when play was paused (-1 if it is not suspended) */
+static gint64 player_xfade_deadline = 0;
+static gint64 player_xfade_left = -1;
+
+/* Seek request waiting to be sent to the pipeline. Requests arriving
+ * before it is served replace the target. Request time is that of the
+ * first request not served yet */
+static song_time_t player_seek_to = -1;
+static gint64 player_seek_request_time = 0;
+static int player_seek_num_requests = 0;
+
+/* Seek being done by the pipeline and timer delaying the next one */
+static bool_t player_seek_in_flight = FALSE;
+static gint64 player_seek_issue_time = 0, player_seek_issued_request = 0;
+static int player_seek_issued_num = 0;
+static GSource *player_seek_timer = NULL;
+
+/* Seek latency sample is closed by the first buffer reaching the sink
+ * after the flush of the seek. Probe waits for the flush (state 1) and 
+ * then for the buffer (state 2); it does nothing while not armed (state 0) */
+static volatile gint player_seek_probe_state = 0;
+static gint64 player_seek_probe_issue = 0, player_seek_probe_request = 0;
+static int player_seek_probe_num = 0;
+static pthread_mutex_t player_seek_probe_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Time after which a seek not confirmed by the pipeline is considered done */
+#define PLAYER_SEEK_TIMEOUT (G_USEC_PER_SEC)
+
+/* Built-in effects settings */
+static dsp_t *player_dsp = NULL;
+
+/* Time (in ns) before the fade start at which the next song is prepared */
+#define PLAYER_XFADE_LEAD (2 * GST_SECOND)
+
 /* Edit boxes history lists */
 editbox_history_t *player_hist_lists[PLAYER_NUM_HIST_LISTS];
 
@@ -153,9 +327,8 @@ logger_view_t *player_logview = NULL;
 /* Standard value for edit boxes width */
 #define PLAYER_EB_WIDTH	(2 * WND_WIDTH(player_wnd) / 3)
 
-/* enqueued songs */
-int queued_songs[PLAYER_MAX_ENQUEUED];
-int num_queued_songs = 0;
+/* Queue of songs to be played next */
+pq_t *player_queue = NULL;
 
 /* Main thread ID */
 pthread_t player_main_tid = 0; 
@@ -167,9 +340,31 @@ static void player_info_dialog_set_if_readonly( dialog_t *dlg );
 static bool_t player_handle_var_title_format( cfg_node_t *var, char *value, void *data );
 static bool_t player_handle_color_scheme( cfg_node_t *var, char *value, void *data );
 static bool_t player_handle_kbind_scheme( cfg_node_t *var, char *value, void *data );
+static bool_t player_handle_dsp( cfg_node_t *var, char *value, void *data );
 static void player_audio_setup_dlg( void );
 static void player_welcome_dialog( void );
 static void player_utf8_dialog( void );
+static void player_set_cur_song( int song, song_time_t start_time );
+static void player_do_end_play( bool_t rem_cur_song );
+static void player_send_cmd( int type );
+static bool_t player_cmd_forward( int type, int ival, song_time_t time,
+		double val, bool_t flag, bool_t wait );
+static void player_track_finished( void );
+static void player_gapless_switch( void );
+static void player_standby_prepare( void );
+static void player_standby_bus_call( GstMessage *msg );
+static void player_on_segment_done( void );
+static void player_track_stop( void );
+static int player_time_update_interval( void );
+static void player_report_output_latency( void );
+static void player_start_time_timer( void );
+static int player_xfade_duration( void );
+static void player_xfade_on_error( GstObject *src );
+static void player_apply_seek( void );
+static void player_seek_done( void );
+static void player_attach_seek_probe( GstPad *pad );
+static void player_start_done( void );
+static void player_sync( void );
 
 /*****
  *
@@ -206,7 +401,7 @@ static void player_load_state( void )
 	if (cfg_get_var_int(cfg_list, "play-from-stop"))
 	{
 		logger_debug(player_log, "Playing from stop");
-		player_context->m_status = js_get_int(js_root, "player-status", PLAYER_STATUS_STOPPED);
+		player_set_status(js_get_int(js_root, "player-status", PLAYER_STATUS_STOPPED));
 		player_start = js_get_int(js_root, "player-start", 0) - 1;
 		player_end = js_get_int(js_root, "player-end", 0) - 1;
 		if (player_context->m_status != PLAYER_STATUS_STOPPED)
@@ -251,6 +446,38 @@ static void player_save_state( void )
 	player_save_cfg();
 }
 
+/* Initialize what the decode benchmark needs: plugins (for play list
+ * formats) and the play list */
+static bool_t player_init_bench( void )
+{
+	plist_set_t *set;
+	int i;
+
+	player_bench = TRUE;
+	player_pmng = pmng_init(cfg_list, player_log, NULL);
+	if (player_pmng == NULL)
+	{
+		logger_fatal(player_log, 0, _("Unable to initialize plugin manager"));
+		return FALSE;
+	}
+	player_plist = plist_new(0);
+	if (player_plist == NULL || !irw_init())
+	{
+		logger_fatal(player_log, 0, _("Play list initialization failed"));
+		return FALSE;
+	}
+
+	/* Songs info is not needed, so its reading is cancelled */
+	player_store_undo = FALSE;
+	set = plist_set_new(FALSE);
+	for ( i = 0; i < player_num_files; i ++ )
+		plist_set_add(set, player_files[i]);
+	plist_add_set(player_plist, set);
+	plist_set_free(set);
+	irw_free();
+	return TRUE;
+} /* End of 'player_init_bench' function */
+
 /* Initialize player */
 bool_t player_init( int argc, char *argv[] )
 {
@@ -306,12 +533,29 @@ bool_t player_init( int argc, char *argv[] )
 	player_context->m_status = PLAYER_STATUS_STOPPED;
 	player_context->m_volume = VOLUME_DEF;
 
+	/* Initialize player thread command channel */
+	if (pipe(player_cmd_pipe))
+	{
+		logger_fatal(player_log, 0, _("Unable to create player command channel"));
+		return FALSE;
+	}
+	/* Read end is drained until it is empty, so it must not block
+	 * either */
+	fcntl(player_cmd_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(player_cmd_pipe[1], F_SETFL, O_NONBLOCK);
+	for ( i = 0; i < PLAYER_CMD_RING_SIZE; i ++ )
+		player_cmd_ring[i].m_seq = i;
+
 	/* Parse command line */
 	logger_debug(player_log, "In player_init");
 	logger_debug(player_log, "Parsing command line");
 	if (!player_parse_cmd_line(argc, argv))
 		return FALSE;
 
+	/* Decode benchmark runs without the interface */
+	if (cfg_get_var_bool(cfg_list, "bench"))
+		return player_init_bench();
+
 	/* Initialize window system */
 	logger_debug(player_log, "Initializing window system");
 	wnd_root = wnd_init(cfg_list, player_log);
@@ -356,6 +600,15 @@ bool_t player_init( int argc, char *argv[] )
 	player_pmng->m_player_wnd = player_wnd;
 	player_pmng->m_player_context = player_context;
 
+	/* Load metadata cache */
+	if (cfg_get_var_bool(cfg_list, "metadata-cache"))
+	{
+		char *name = util_strcat(player_cfg_dir, "/metadata_cache", NULL);
+		if (name == NULL || !mdc_init(name))
+			logger_error(player_log, 0, _("Unable to initialize metadata cache"));
+		free(name);
+	}
+
 	/* Initialize info read/write thread */
 	logger_debug(player_log, "Initializing info read/write thread");
 	if (!irw_init())
@@ -365,6 +618,18 @@ bool_t player_init( int argc, char *argv[] )
 		return FALSE;
 	}
 
+	/* Initialize ReplayGain analyzer */
+	logger_debug(player_log, "Initializing ReplayGain analyzer");
+	rga_init();
+
+	/* Initialize effects */
+	player_dsp = dsp_new();
+
+	/* Initialize read-ahead thread */
+	logger_debug(player_log, "Initializing read-ahead thread");
+	if (!prefetch_init())
+		logger_error(player_log, 0, _("Unable to initialize read-ahead thread"));
+
 	/* Initialize undo list */
 	logger_debug(player_log, "Initializing undo list");
 	player_ul = undo_new();
@@ -376,7 +641,8 @@ bool_t player_init( int argc, char *argv[] )
 	/* Create a play list and add files to it */
 	logger_debug(player_log, "Initializing play list");
 	player_plist = plist_new(3);
-	if (player_plist == NULL)
+	player_queue = pq_new();
+	if (player_plist == NULL || player_queue == NULL)
 	{
 		logger_fatal(player_log, 0, _("Play list initialization failed"));
 		return FALSE;
@@ -481,6 +747,10 @@ void player_root_destructor( wnd_t *wnd )
 	/* End playing thread */
 	logger_debug(player_log, "Doing irw_free");
 	irw_free();
+	logger_debug(player_log, "Doing rga_free");
+	rga_free();
+	logger_debug(player_log, "Doing prefetch_free");
+	prefetch_free();
 	logger_debug(player_log, "Setting next song to NULL");
 	if (player_tid)
 	{
@@ -488,11 +758,18 @@ void player_root_destructor( wnd_t *wnd )
 		player_end_play(FALSE);
 		player_end_track = TRUE;
 		player_end_thread = TRUE;
+		player_send_cmd(PLAYER_CMD_QUIT);
 		pthread_join(player_tid, NULL);
 		logger_debug(player_log, "Player thread terminated");
 		player_end_thread = FALSE;
 		player_tid = 0;
 	}
+	if (player_cmd_pipe[0] >= 0)
+	{
+		close(player_cmd_pipe[0]);
+		close(player_cmd_pipe[1]);
+		player_cmd_pipe[0] = player_cmd_pipe[1] = -1;
+	}
 	
 	/* Stop general plugins */
 	pmng_stop_general_plugins(player_pmng);
@@ -540,9 +817,19 @@ void player_deinit( void )
 		plist_free(player_plist);
 		player_plist = NULL;
 	}
+	pq_free(player_queue);
+	player_queue = NULL;
 	logger_debug(player_log, "Freeing undo information");
 	undo_free(player_ul);
 	player_ul = NULL;
+	logger_debug(player_log, "Saving metadata cache");
+	mdc_free();
+	lat_log_summary();
+	if (player_dsp != NULL)
+	{
+		dsp_free(player_dsp);
+		player_dsp = NULL;
+	}
 	if (player_context != NULL)
 	{
 		free(player_context);
@@ -565,6 +852,9 @@ void player_deinit( void )
 /* Run player */
 bool_t player_run( void )
 {
+	if (player_bench)
+		return test_decode_benchmark(player_plist);
+
 	/* Run window message loop */
 	wnd_main(wnd_root);
 	wnd_root = NULL;
@@ -677,6 +967,10 @@ bool_t player_init_cfg( void )
 			player_handle_color_scheme);
 	cfg_new_var(cfg_list, "kbind-scheme", 0, NULL, 
 			player_handle_kbind_scheme);
+	cfg_new_var(cfg_list, "equalizer", 0, NULL, player_handle_dsp);
+	cfg_new_var(cfg_list, "preamp", 0, NULL, player_handle_dsp);
+	cfg_new_var(cfg_list, "limiter", 0, NULL, player_handle_dsp);
+	cfg_new_var(cfg_list, "limiter-threshold", 0, NULL, player_handle_dsp);
 
 	/* Set default variable values */
 	log_file = util_strcat(getenv("HOME"), "/.mpfc/log", NULL);
@@ -688,6 +982,30 @@ bool_t player_init_cfg( void )
 	cfg_set_var_bool(cfg_list, "autosave-plugins-params", TRUE);
 	cfg_set_var_bool(cfg_list, "search-nocase", TRUE);
 	cfg_set_var_bool(cfg_list, "view-follows-cur-song", TRUE);
+	cfg_set_var_bool(cfg_list, "gapless-play", TRUE);
+	cfg_set_var_int(cfg_list, "time-update-interval", 100);
+	cfg_set_var_int(cfg_list, "position-granularity", 1000);
+	cfg_set_var_int(cfg_list, "position-sample-interval", 1000);
+	cfg_set_var_bool(cfg_list, "preroll-next", FALSE);
+	cfg_set_var_int(cfg_list, "crossfade-duration", 0);
+	cfg_set_var(cfg_list, "crossfade-curve", "equal-power");
+	cfg_set_var_int(cfg_list, "crossfade-buffer", 1000);
+	cfg_set_var(cfg_list, "rgain-mode", "off");
+	cfg_set_var_int(cfg_list, "rgain-preamp", 0);
+	cfg_set_var_int(cfg_list, "rgain-workers", 2);
+	cfg_set_var_int(cfg_list, "info-workers", 4);
+	cfg_set_var_bool(cfg_list, "lazy-info", FALSE);
+	cfg_set_var_int(cfg_list, "prefetch-count", 2);
+	cfg_set_var_int(cfg_list, "prefetch-budget", 64);
+	cfg_set_var(cfg_list, "seek-mode", "accurate");
+	cfg_set_var_int(cfg_list, "seek-min-interval", 100);
+	cfg_set_var_int(cfg_list, "undo-budget", 64);
+	cfg_set_var_int(cfg_list, "scan-threads", 4);
+	cfg_set_var_bool(cfg_list, "metadata-cache", TRUE);
+	cfg_set_var(cfg_list, "limiter-threshold", "-1");
+	cfg_set_var(cfg_list, "output-profile", "default");
+	cfg_set_var_int(cfg_list, "output-buffer-time", 40);
+	cfg_set_var_int(cfg_list, "output-latency-time", 10);
 
 	/* Read configuration files */
 	cfg_rcfile_read(cfg_list, player_cfg_autosave_file);
@@ -879,16 +1197,18 @@ wnd_msg_retcode_t player_on_action( wnd_t *wnd, char *action, int repval )
 	/* Enter visual mode */
 	else if (!strcasecmp(action, "visual"))
 	{
-		player_plist->m_visual = !player_plist->m_visual;
+		/* Selection is a range of list positions, and in a filtered
+		 * list it would take the hidden songs too */
+		if (PLIST_FILTERED(player_plist) && !player_plist->m_visual)
+			logger_message(player_log, 1,
+					_("Visual mode is not available while the play list is filtered"));
+		else
+			player_plist->m_visual = !player_plist->m_visual;
 	}
 	/* Resume playing */
 	else if (!strcasecmp(action, "play"))
 	{
-		if (player_context->m_status != PLAYER_STATUS_PAUSED)
-			player_play(player_plist->m_cur_song, 0);
-		player_context->m_status = PLAYER_STATUS_PLAYING;
-
-		pmng_hook(player_pmng, "player-status");
+		player_resume();
 	}
 	/* Pause */
 	else if (!strcasecmp(action, "pause"))
@@ -953,6 +1273,11 @@ wnd_msg_retcode_t player_on_action( wnd_t *wnd, char *action, int repval )
 	{
 		player_advanced_search_dialog();
 	}
+	/* Filter play list */
+	else if (!strcasecmp(action, "filter"))
+	{
+		player_filter_dialog();
+	}
 	/* Find next/previous search match */
 	else if (!strcasecmp(action, "next_match") ||
 			!strcasecmp(action, "prev_match"))
@@ -1023,6 +1348,11 @@ wnd_msg_retcode_t player_on_action( wnd_t *wnd, char *action, int repval )
 	{
 		player_info_reload_dialog();
 	}
+	/* Analyse play list loudness */
+	else if (!strcasecmp(action, "rgain_analyze"))
+	{
+		rga_push_plist(player_plist);
+	}
 	/* Set play boundaries */
 	else if (!strcasecmp(action, "set_play_bounds"))
 	{
@@ -1039,7 +1369,7 @@ wnd_msg_retcode_t player_on_action( wnd_t *wnd, char *action, int repval )
 		PLIST_GET_SEL(player_plist, player_start, player_end);
 		if (player_plist->m_len > 0)
 		{
-			player_context->m_status = PLAYER_STATUS_PLAYING;
+			player_set_status(PLAYER_STATUS_PLAYING);
 			player_play(player_start, 0);
 		}
 	}
@@ -1133,8 +1463,8 @@ wnd_msg_retcode_t player_on_mouse_ldown( wnd_t *wnd, int x, int y,
 			y < player_plist->m_start_pos + PLIST_HEIGHT)
 	{
 		int was_pos = player_plist->m_sel_end;
-		plist_move(player_plist, y - player_plist->m_start_pos + 
-				player_plist->m_scrolled, FALSE);
+		plist_move(player_plist, plist_row_pos(player_plist, 
+					y - player_plist->m_start_pos), FALSE);
 		if (was_pos != player_plist->m_sel_end)
 			player_last_pos = was_pos;
 		wnd_invalidate(wnd);
@@ -1174,8 +1504,8 @@ wnd_msg_retcode_t player_on_mouse_mdown( wnd_t *wnd, int x, int y,
 			y < player_plist->m_start_pos + PLIST_HEIGHT)
 	{
 		int was_pos = player_plist->m_sel_end;
-		plist_centrize(player_plist, y - player_plist->m_start_pos + 
-				player_plist->m_scrolled);
+		plist_centrize(player_plist, plist_row_pos(player_plist, 
+					y - player_plist->m_start_pos));
 		if (was_pos != player_plist->m_sel_end)
 			player_last_pos = was_pos;
 		wnd_invalidate(wnd);
@@ -1191,11 +1521,11 @@ wnd_msg_retcode_t player_on_mouse_ldouble( wnd_t *wnd, int x, int y,
 	if (y >= player_plist->m_start_pos && 
 			y < player_plist->m_start_pos + PLIST_HEIGHT)
 	{
-		int s = y - player_plist->m_start_pos + player_plist->m_scrolled;
+		int s = plist_row_pos(player_plist, y - player_plist->m_start_pos);
 
 		if (s >= 0 && s < player_plist->m_len)
 		{
-			player_context->m_status = PLAYER_STATUS_PLAYING;
+			player_set_status(PLAYER_STATUS_PLAYING);
 			player_play(s, 0);
 			wnd_invalidate(wnd);
 		}
@@ -1401,9 +1731,31 @@ void player_on_log_msg( logger_t *log, void *data,
  *
  *****/
 
+/* Seek pipeline to the song time. Slices are played as segments ending
+ * exactly at the slice end */
+static bool_t player_seek_pipeline( GstElement *pipeline, song_t *s, 
+		song_time_t t, GstSeekFlags flags )
+{
+	guint64 tm = player_translate_time(s, t, TRUE);
+
+	logger_debug(player_log, "gstreamer: seeking to time %lld", tm);
+	if (s->m_end_time > -1)
+	{
+		logger_debug(player_log, "gstreamer: segment ends at %lld", s->m_end_time);
+		return gst_element_seek(pipeline, 1.0, GST_FORMAT_TIME, 
+				flags | GST_SEEK_FLAG_SEGMENT | 
+				((flags & GST_SEEK_FLAG_KEY_UNIT) ? 0 : GST_SEEK_FLAG_ACCURATE),
+				GST_SEEK_TYPE_SET, tm, GST_SEEK_TYPE_SET, s->m_end_time);
+	}
+	return gst_element_seek(pipeline, 1.0, GST_FORMAT_TIME, flags,
+			GST_SEEK_TYPE_SET, tm, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+} /* End of 'player_seek_pipeline' function */
+
 /* Seek song */
 void player_seek( song_time_t val, bool_t rel )
 {
+	if (player_cmd_forward(PLAYER_CMD_SEEK, 0, val, 0, rel, FALSE))
+		return;
 	if (player_plist->m_cur_song == -1)
 		return;
 
@@ -1416,14 +1768,20 @@ void player_seek( song_time_t val, bool_t rel )
 		new_time = s->m_len;
 
 	player_save_time();
-	guint64 tm = player_translate_time(s, new_time, TRUE);
-	logger_debug(player_log, "gstreamer: seeking to time %lld", tm);
-	if (!gst_element_seek(player_pipeline, 1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH,
-			GST_SEEK_TYPE_SET, tm, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE))
+
+	/* Pipeline is sought when player_sync() applies the request */
+	if (player_seek_to < 0)
 	{
-		logger_error(player_log, 1, _("gstreamer: gst_element_seek returned FALSE"));
+		player_seek_request_time = player_cmd_stamp ? player_cmd_stamp :
+			g_get_monotonic_time();
+		player_seek_num_requests = 0;
 	}
+	player_seek_to = new_time;
+	player_seek_num_requests ++;
+	player_send_cmd(PLAYER_CMD_SYNC);
+
 	player_context->m_cur_time = new_time;
+	player_pos_valid = FALSE;
 	wnd_invalidate(player_wnd);
 	logger_debug(player_log, "after player_seek timer is %lld", player_context->m_cur_time);
 
@@ -1435,23 +1793,37 @@ void player_play( int song, song_time_t start_time )
 {
 	song_t *s;
 
+	if (player_cmd_forward(PLAYER_CMD_PLAY, song, start_time, 0, FALSE, FALSE))
+		return;
+
 	/* End current playing */
-	player_end_play(FALSE);
+	player_do_end_play(FALSE);
 
 	/* Check that we have anything to play */
 	if (song < 0 || song >= player_plist->m_len ||
 			(s = player_plist->m_list[song]) == NULL)
 	{
 		player_plist->m_cur_song = -1;
+		player_send_cmd(PLAYER_CMD_SYNC);
 		return;
 	}
 
-	/* Start new playing thread */
+	/* Let player thread start the new track */
+	player_set_cur_song(song, start_time);
+	player_track_gen ++;
+	player_send_cmd(PLAYER_CMD_SYNC);
+//	player_context->m_status = PLAYER_STATUS_PLAYING;
+} /* End of 'player_play' function */
+
+/* Make song current without touching the pipeline */
+static void player_set_cur_song( int song, song_time_t start_time )
+{
+	song_t *s = player_plist->m_list[song];
+
 	cfg_set_var(cfg_list, "cur-song-name", song_get_short_name(s));
 	cfg_set_var(cfg_list, "cur-song-title", STR_TO_CPTR(s->m_title));
 	player_plist->m_cur_song = song;
 	player_context->m_cur_time = start_time;
-//	player_context->m_status = PLAYER_STATUS_PLAYING;
 
 	/* Move cursor to current song */
 	if (cfg_get_var_bool(cfg_list, "view-follows-cur-song") && 
@@ -1463,10 +1835,20 @@ void player_play( int song, song_time_t start_time )
 		if (was_pos != player_plist->m_sel_end)
 			player_last_pos = was_pos;
 	}
-} /* End of 'player_play' function */
+} /* End of 'player_set_cur_song' function */
 
 /* End playing song */
 void player_end_play( bool_t rem_cur_song )
+{
+	/* Callers rely on the current song being reset on return */
+	if (player_cmd_forward(PLAYER_CMD_END_PLAY, 0, 0, 0, rem_cur_song, TRUE))
+		return;
+	player_do_end_play(rem_cur_song);
+	player_send_cmd(PLAYER_CMD_SYNC);
+} /* End of 'player_end_play' function */
+
+/* End playing song without notifying player thread */
+static void player_do_end_play( bool_t rem_cur_song )
 {
 	int was_song = player_plist->m_cur_song;
 	
@@ -1478,7 +1860,7 @@ void player_end_play( bool_t rem_cur_song )
 		player_plist->m_cur_song = was_song;
 	cfg_set_var(cfg_list, "cur-song-name", "");
 	cfg_set_var(cfg_list, "cur-song-title", "");
-} /* End of 'player_end_play' function */
+} /* End of 'player_do_end_play' function */
 
 /* Go to next track */
 void player_next_track( void )
@@ -1502,6 +1884,8 @@ void player_set_track( int track )
 /* Set volume */
 void player_set_vol( double vol, bool_t rel )
 {
+	if (player_cmd_forward(PLAYER_CMD_VOLUME, 0, 0, vol, rel, FALSE))
+		return;
 	player_context->m_volume = (rel) ? player_context->m_volume + vol : vol;
 	if (player_context->m_volume < VOLUME_MIN)
 		player_context->m_volume = VOLUME_MIN;
@@ -1522,17 +1906,175 @@ void player_update_vol( void )
 				GST_STREAM_VOLUME_FORMAT_CUBIC, GST_STREAM_VOLUME_FORMAT_LINEAR, v);
 		logger_message(player_log, 1, _("setting volume to %lg%% (linear = %lg%%)"),
 				v * 100, conv * 100);
-		g_object_set(G_OBJECT(player_pipeline), "volume", conv, NULL);
+		conv *= player_rgain_scale;
+		if (player_xfade != NULL)
+			xfade_set_volume(player_xfade, conv);
+		else
+			g_object_set(G_OBJECT(player_pipeline), "volume", conv, NULL);
 	}
 } /* End of 'player_update_vol' function */
 
+/* Update ReplayGain volume scale for the song being played */
+static void player_update_rgain( song_t *s )
+{
+	player_rgain_scale = rga_volume_scale(s->m_filename);
+	player_update_vol();
+} /* End of 'player_update_rgain' function */
+
+/* Get song that is 'num' songs away from 'cur' in sequential play */
+static int player_step_song( int cur, int num, int base, int len )
+{
+	int s;
+
+	if (player_start >= 0 && (cur < player_start || cur > player_end))
+		s = -1;
+	else 
+		s = cur - base;
+	s += num;
+	if (cfg_get_var_int(cfg_list, "loop-play"))
+	{
+		while (s < 0)
+			s += len;
+		s %= len;
+		return s + base;
+	}
+	else if (s < 0 || s >= len)
+		return -1;
+	return s + base;
+} /* End of 'player_step_song' function */
+
+/* Get position of the first queued song, taking it from the queue if
+ * 'take' is set. Songs which are no more in the list are dropped
+ * (play list must be locked) */
+static int player_queue_head( bool_t take )
+{
+	song_id_t id;
+
+	if (player_queue == NULL)
+		return -1;
+	while ((id = pq_get(player_queue, 0)) != 0)
+	{
+		int pos = plist_id_pos(player_plist, id);
+		if (pos < 0 || take)
+			pq_pop(player_queue);
+		if (pos >= 0)
+			return pos;
+	}
+	return -1;
+} /* End of 'player_queue_head' function */
+
+/* Predict the song that next 'player_skip_songs(1, ...)' will choose. 
+ * For shuffle play the choice is made now and kept for skipping. Nothing
+ * is taken from the queue until 'player_next_chosen' is called (play
+ * list must be locked) */
+static int player_predict_next( void )
+{
+	int len, base, cur;
+
+	if (player_plist == NULL || !player_plist->m_len)
+		return -1;
+	if ((cur = player_queue_head(FALSE)) >= 0)
+		return cur;
+
+	cur = player_plist->m_cur_song;
+	len = (player_start < 0) ? player_plist->m_len : 
+		(player_end - player_start + 1);
+	base = (player_start < 0) ? 0 : player_start;
+	if (!cfg_get_var_int(cfg_list, "shuffle-play"))
+		return player_step_song(cur, 1, base, len);
+
+	if (player_shuffle_next < base || player_shuffle_next >= base + len ||
+			player_shuffle_next == cur)
+	{
+		if (len == 1)
+			player_shuffle_next = base;
+		else
+		{
+			player_shuffle_next = cur;
+			while (player_shuffle_next == cur)
+				player_shuffle_next = base + (rand() % len);
+		}
+	}
+	return player_shuffle_next;
+} /* End of 'player_predict_next' function */
+
+/* Note that the song predicted by 'player_predict_next' is going to be
+ * played: take it from the queue and forget the shuffle choice (play
+ * list must be locked) */
+static void player_next_chosen( song_t *s )
+{
+	if (player_queue != NULL && s != NULL && 
+			pq_get(player_queue, 0) == s->m_id)
+		pq_pop(player_queue);
+	player_shuffle_next = -1;
+} /* End of 'player_next_chosen' function */
+
+/* Warm the songs that are going to be played next */
+static void player_prefetch_next( void )
+{
+	song_t *songs[PREFETCH_MAX_FILES];
+	int count = cfg_get_var_int(cfg_list, "prefetch-count");
+	int num = 0, len, base, last, i;
+
+	if (player_plist == NULL || !player_plist->m_len || count <= 0)
+		return;
+	if (count > PREFETCH_MAX_FILES)
+		count = PREFETCH_MAX_FILES;
+
+	/* Queued songs go first */
+	last = player_plist->m_cur_song;
+	for ( i = 0; player_queue != NULL && i < pq_len(player_queue) && 
+			num < count; i ++ )
+	{
+		int pos = plist_find_id(player_plist, pq_get(player_queue, i));
+		if (pos >= 0)
+		{
+			songs[num ++] = player_plist->m_list[pos];
+			last = pos;
+		}
+	}
+
+	/* Only one song ahead is known in shuffle play */
+	if (cfg_get_var_int(cfg_list, "shuffle-play"))
+	{
+		plist_lock(player_plist);
+		if (num == 0 && (last = player_predict_next()) >= 0)
+			songs[num ++] = player_plist->m_list[last];
+		plist_unlock(player_plist);
+	}
+	else
+	{
+		len = (player_start < 0) ? player_plist->m_len : 
+			(player_end - player_start + 1);
+		base = (player_start < 0) ? 0 : player_start;
+		for ( i = 1; num < count; i ++ )
+		{
+			int s = player_step_song(last, i, base, len);
+			if (s < 0 || s == player_plist->m_cur_song || i > len)
+				break;
+			songs[num ++] = player_plist->m_list[s];
+		}
+	}
+	prefetch_schedule(songs, num);
+} /* End of 'player_prefetch_next' function */
+
 /* Skip some songs */
 int player_skip_songs( int num, bool_t play )
 {
 	int len, base, song;
 	
-	if (player_plist == NULL || !player_plist->m_len)
+	if (play && player_cmd_forward(PLAYER_CMD_SKIP, num, 0, 0, FALSE, FALSE))
+		return -1;
+	if (player_plist == NULL)
+		return -1;
+
+	/* Streaming thread chooses songs too, so the list must stay still */
+	plist_lock(player_plist);
+	if (!player_plist->m_len)
+	{
+		plist_unlock(player_plist);
 		return -1;
+	}
 	
 	/* Change current song */
 	song = player_plist->m_cur_song;
@@ -1543,39 +2085,27 @@ int player_skip_songs( int num, bool_t play )
 	{
 		int initial = song;
 
-		while (song == initial)
-			song = base + (rand() % len);
-	}
-	else 
-	{
-		int s, cur = song;
-		if (player_start >= 0 && (cur < player_start || cur > player_end))
-			s = -1;
-		else 
-			s = cur - base;
-		s += num;
-		if (cfg_get_var_int(cfg_list, "loop-play"))
+		/* Use the song predicted for standby pipeline if any */
+		if (player_shuffle_next >= base && player_shuffle_next < base + len &&
+				player_shuffle_next != initial)
+			song = player_shuffle_next;
+		else if (len > 1)
 		{
-			while (s < 0)
-				s += len;
-			s %= len;
-			song = s + base;
+			while (song == initial)
+				song = base + (rand() % len);
 		}
-		else if (s < 0 || s >= len)
-			song = -1;
 		else
-			song = s + base;
+			song = base;
+		player_shuffle_next = -1;
 	}
-	if(num_queued_songs != 0)
+	else 
+		song = player_step_song(song, num, base, len);
 	{
-		int queue_loop;
-		song = queued_songs[0];
-		for(queue_loop = 0;queue_loop < num_queued_songs-1;queue_loop++)
-		{
-			queued_songs[queue_loop] = queued_songs[queue_loop+1];
-		}
-		num_queued_songs--;
+		int queued = player_queue_head(TRUE);
+		if (queued >= 0)
+			song = queued;
 	}
+	plist_unlock(player_plist);
 
 	/* Start or end play */
 	if (play)
@@ -1627,11 +2157,18 @@ static gboolean player_gst_bus_call( GstBus *bus, GstMessage *msg, gpointer data
 	gchar *debug;
 	GError *error;
 
+	if (data != player_pipeline)
+	{
+		if (data == player_standby)
+			player_standby_bus_call(msg);
+		return TRUE;
+	}
+
 	switch (GST_MESSAGE_TYPE(msg))
 	{
 	case GST_MESSAGE_EOS:
 		logger_debug(player_log, "gstreamer: EOS message arrived");
-		player_end_of_stream = TRUE;
+		player_track_finished();
 		break;
 	case GST_MESSAGE_ERROR:
 		gst_message_parse_error(msg, &error, &debug);
@@ -1639,12 +2176,45 @@ static gboolean player_gst_bus_call( GstBus *bus, GstMessage *msg, gpointer data
 
 		logger_error(player_log, 1, _("gstreamer error: %s"), error->message);
 		g_error_free(error);
+		if (player_xfade != NULL)
+			player_xfade_on_error(GST_MESSAGE_SRC(msg));
+		break;
+
+	case GST_MESSAGE_ASYNC_DONE:
+		if (player_xfade != NULL)
+			xfade_on_async_done(player_xfade);
+		if (player_start_pending)
+			player_start_done();
+		player_seek_done();
+		break;
+
+	case GST_MESSAGE_STATE_CHANGED:
+		if (GST_MESSAGE_SRC(msg) == GST_OBJECT(player_pipeline))
+		{
+			GstState state;
+			gst_message_parse_state_changed(msg, NULL, &state, NULL);
+			if (state == GST_STATE_PLAYING)
+			{
+				lat_mark(LAT_PLAYING);
+				player_report_output_latency();
+			}
+		}
 		break;
 
 	case GST_MESSAGE_TAG:
 		player_handle_tag_msg(msg);
 		break;
 
+	case GST_MESSAGE_STREAM_START:
+		if (player_gapless_queued)
+			player_gapless_switch();
+		break;
+
+	case GST_MESSAGE_SEGMENT_DONE:
+		logger_debug(player_log, "gstreamer: SEGMENT_DONE message arrived");
+		player_on_segment_done();
+		break;
+
 	default:
 		break;
 	}
@@ -1684,16 +2254,235 @@ static void player_on_caps_set(GObject *obj, GParamSpec *pspec, gpointer user_da
 static void player_on_audio_changed( GstElement *playbin, gpointer user_data )
 {
 	GstPad *pad = NULL;
+
+	/* Standby pipeline output is not shown until it becomes current */
+	if (playbin != player_pipeline)
+		return;
 	g_signal_emit_by_name(playbin, "get-audio-pad", 0, &pad);
 	if (!pad)
 		return;
+
+	/* Pipeline is reused between tracks, so the pad may be already watched */
+	if (pad == player_audio_pad)
+	{
+		gst_object_unref(pad);
+		return;
+	}
+	if (player_audio_pad)
+		gst_object_unref(player_audio_pad);
+	player_audio_pad = pad;
 	g_signal_connect(pad, "notify::caps", (GCallback)player_on_caps_set, NULL);
+	lat_attach_pad(pad);
+	player_attach_seek_probe(pad);
+	player_on_caps_set(G_OBJECT(pad), NULL, NULL);
 } /* End of 'player_on_audio_changed' function */
 
-/* Player thread function */
-bool_t player_set_audio_sink( void )
+/* Forget the track chosen in advance */
+static void player_gapless_reset( void )
+{
+	pthread_mutex_lock(&player_gapless_mutex);
+	if (player_gapless_song)
+		song_free(player_gapless_song);
+	player_gapless_song = NULL;
+	player_gapless_index = -1;
+	player_gapless_decided = FALSE;
+	player_gapless_queued = FALSE;
+	pthread_mutex_unlock(&player_gapless_mutex);
+} /* End of 'player_gapless_reset' function */
+
+/* Take the track chosen in advance and return its current position 
+ * in the play list (the list may have been edited since choosing) */
+static int player_gapless_take( void )
+{
+	int index;
+	song_t *s;
+
+	pthread_mutex_lock(&player_gapless_mutex);
+	index = player_gapless_index;
+	s = player_gapless_song;
+	player_gapless_song = NULL;
+	player_gapless_index = -1;
+	player_gapless_decided = FALSE;
+	player_gapless_queued = FALSE;
+	pthread_mutex_unlock(&player_gapless_mutex);
+
+	if (s == NULL)
+		return index;
+	plist_lock(player_plist);
+	if (index >= player_plist->m_len || player_plist->m_list[index] != s)
+		index = plist_id_pos(player_plist, s->m_id);
+
+	/* Switch is made now, so the song leaves the queue */
+	player_next_chosen(s);
+	plist_unlock(player_plist);
+	song_free(s);
+	return index;
+} /* End of 'player_gapless_take' function */
+
+/* Handle 'about-to-finish' signal (called from a streaming thread).
+ * Choose the next track the usual way and hand it to playbin so that
+ * it starts right after the current one without reopening the output */
+static void player_on_about_to_finish( GstElement *playbin, gpointer user_data )
+{
+	song_t *played = player_song_played;
+	int index;
+
+	if (!cfg_get_var_bool(cfg_list, "gapless-play") || player_end_track ||
+			playbin != player_pipeline)
+		return;
+
+	/* Slices are stopped by time so the end of file doesn't matter */
+	if (played == NULL || played->m_end_time > -1)
+		return;
+
+	pthread_mutex_lock(&player_gapless_mutex);
+	if (player_gapless_decided)
+	{
+		pthread_mutex_unlock(&player_gapless_mutex);
+		return;
+	}
+
+	/* The choice may be thrown away (e.g. on seek), so the queue is
+	 * left as is until the switch. List is locked till the song is
+	 * referenced since it may be edited on the main thread */
+	plist_lock(player_plist);
+	index = player_predict_next();
+	player_gapless_decided = TRUE;
+	player_gapless_index = index;
+	if (index >= 0)
+		player_gapless_song = song_add_ref(player_plist->m_list[index]);
+	plist_unlock(player_plist);
+	if (index >= 0)
+	{
+		song_t *next = player_gapless_song;
+
+		/* Slice needs a seek to its start, so let it be played
+		 * the regular way */
+		if (next->m_start_time < 0)
+		{
+			logger_debug(player_log, "gstreamer: queueing %s for gapless playback",
+					next->m_fullname);
+			g_object_set(G_OBJECT(playbin), "uri", next->m_fullname, NULL);
+			player_gapless_queued = TRUE;
+		}
+	}
+	pthread_mutex_unlock(&player_gapless_mutex);
+} /* End of 'player_on_about_to_finish' function */
+
+/* Make the song current while the pipeline goes on playing */
+static void player_continue_with( int index )
+{
+	song_t *s = player_plist->m_list[index];
+
+	song_update_info(s);
+	player_save_time();
+	player_set_cur_song(index, 0);
+	player_context->m_bitrate = 0;
+	player_song_played = s;
+	player_pos_valid = FALSE;
+	player_update_rgain(s);
+	prefetch_note_play(s);
+	player_prefetch_next();
+	pmng_hook(player_pmng, "player-status");
+	wnd_invalidate(player_wnd);
+	player_standby_prepare();
+} /* End of 'player_continue_with' function */
+
+/* Complete gapless transition to the queued track */
+static void player_gapless_switch( void )
+{
+	int index = player_gapless_take();
+	song_t *s;
+
+	/* Gap is the time till the next buffer of the new stream */
+	lat_track_end();
+
+	/* Song has been removed from the list */
+	if (index < 0)
+	{
+		player_end_play(TRUE);
+		pmng_hook(player_pmng, "player-status");
+		return;
+	}
+
+	logger_debug(player_log, "Gapless transition to track %s", 
+			player_plist->m_list[index]->m_fullname);
+	player_continue_with(index);
+} /* End of 'player_gapless_switch' function */
+
+/* Is 'next' the slice following 'cur' in the same file? */
+static bool_t player_is_next_slice( song_t *cur, song_t *next )
+{
+	return (cur->m_end_time > -1 && next->m_start_time == cur->m_end_time &&
+			!strcmp(cur->m_fullname, next->m_fullname));
+} /* End of 'player_is_next_slice' function */
+
+/* Handle the end of a slice segment. If the next song is the following
+ * slice of the same file, playing just goes on without flushing.
+ * Otherwise the segment is drained and the track ends with EOS */
+static void player_on_segment_done( void )
+{
+	song_t *cur = player_song_played, *next;
+	int index;
+
+	if (!player_track_active || player_end_track)
+		return;
+
+	/* Queue is taken only for the song which is really played next */
+	plist_lock(player_plist);
+	index = player_predict_next();
+	next = (index >= 0) ? song_add_ref(player_plist->m_list[index]) : NULL;
+	plist_unlock(player_plist);
+	if (next != NULL && next != cur && player_is_next_slice(cur, next))
+	{
+		bool_t has_end = (next->m_end_time > -1);
+
+		logger_debug(player_log, "gstreamer: continuing with slice at %lld", 
+				next->m_start_time);
+		if (gst_element_seek(player_pipeline, 1.0, GST_FORMAT_TIME,
+				GST_SEEK_FLAG_ACCURATE | (has_end ? GST_SEEK_FLAG_SEGMENT : 0),
+				GST_SEEK_TYPE_SET, next->m_start_time, 
+				has_end ? GST_SEEK_TYPE_SET : GST_SEEK_TYPE_NONE, 
+				has_end ? next->m_end_time : GST_CLOCK_TIME_NONE))
+		{
+			plist_lock(player_plist);
+			index = plist_id_pos(player_plist, next->m_id);
+			if (index >= 0)
+				player_next_chosen(next);
+			plist_unlock(player_plist);
+			song_free(next);
+			lat_track_end();
+			if (index >= 0)
+				player_continue_with(index);
+			else
+			{
+				player_track_stop();
+				player_next_track();
+			}
+			return;
+		}
+		logger_error(player_log, 1, _("gstreamer: gst_element_seek returned FALSE"));
+	}
+	if (next != NULL)
+		song_free(next);
+
+	/* Let the audio queued in the sink play out; the next song is
+	 * chosen when the EOS message arrives */
+	logger_debug(player_log, "gstreamer: draining the segment");
+	if (!gst_element_send_event(player_pipeline, gst_event_new_eos()))
+	{
+		player_track_stop();
+		player_next_track();
+	}
+} /* End of 'player_on_segment_done' function */
+
+/* Create a user-specified audio sink. '*sink' is NULL if default 
+ * one is to be used */
+static bool_t player_create_audio_sink( GstElement **sink_ret )
 {
 	char *audio_sink_name = cfg_get_var(cfg_list, "gstreamer.audio-sink");
+
+	*sink_ret = NULL;
 	if (audio_sink_name && *audio_sink_name)
 	{
 		GstElement *sink = gst_element_factory_make(audio_sink_name, "sink");
@@ -1724,7 +2513,7 @@ bool_t player_set_audio_sink( void )
 				}
 			}
 			logger_debug(player_log, "gstreamer: setting audio sink to %s", audio_sink_name);
-			g_object_set(G_OBJECT(player_pipeline), "audio-sink", sink, NULL);
+			*sink_ret = sink;
 		}
 		else
 		{
@@ -1735,220 +2524,1297 @@ bool_t player_set_audio_sink( void )
 	}
 
 	return TRUE;
-}
+} /* End of 'player_create_audio_sink' function */
 
-/* Player thread function */
-void *player_thread( void *arg )
+/* Set a user-specified audio sink to the pipeline */
+bool_t player_set_audio_sink( GstElement *pipeline )
 {
-	logger_debug(player_log, "In player_thread");
+	GstElement *sink;
 
-	/* Main loop */
-	while (!player_end_thread)
-	{
-		song_t *s, *song_played;
-		int ch = 0, freq = 0, real_ch = 0, real_freq = 0;
-		dword fmt = 0, real_fmt = 0;
-		song_info_t si;
-		dword in_flags, out_flags;
-		bool_t song_finished;
-		GMainLoop *loop = NULL;
-		GstBus *bus = NULL;
-		int was_status;
-		char *uri = NULL;
-		int buffer_dur = 0;
-
-		/* Skip to next iteration if there is nothing to play */
-		if (player_plist->m_cur_song < 0 || 
-				player_context->m_status == PLAYER_STATUS_STOPPED)
-		{
-			util_wait();
-			continue;
-		}
+	if (!player_create_audio_sink(&sink))
+		return FALSE;
+	if (sink)
+		g_object_set(G_OBJECT(pipeline), "audio-sink", sink, NULL);
+	return TRUE;
+} /* End of 'player_set_audio_sink' function */
 
-		/* Play track */
-		s = player_plist->m_list[player_plist->m_cur_song];
-		song_played = s;
-		//player_context->m_status = PLAYER_STATUS_PLAYING;
-		player_end_track = FALSE;
-	
-		logger_debug(player_log, "Playing track %s", s->m_fullname);
+/* Check if the low latency output profile is selected */
+static bool_t player_low_latency( void )
+{
+	char *profile = cfg_get_var(cfg_list, "output-profile");
+	return (profile != NULL && !strcasecmp(profile, "low-latency"));
+} /* End of 'player_low_latency' function */
+
+/* Handle an element added somewhere in a pipeline. The actual audio sink
+ * (which may be hidden inside autoaudiosink) is set up and remembered */
+static void player_on_element_added( GstBin *bin, GstBin *sub_bin, 
+		GstElement *element, gpointer data )
+{
+	if (!GST_IS_AUDIO_BASE_SINK(element))
+		return;
 
-		/* Get song length and information */
-		logger_debug(player_log, "Updating song info");
-		song_update_info(s);
+	if (player_low_latency())
+	{
+		int buffer_time = cfg_get_var_int(cfg_list, "output-buffer-time");
+		int latency_time = cfg_get_var_int(cfg_list, "output-latency-time");
 
-		/* Create gstreamer stuff */
-		player_end_of_stream = FALSE;
-		loop = g_main_loop_new(NULL, FALSE);
-		if (!loop)
-		{
-			logger_error(player_log, 1, _("g_main_loop_new failed"));
-			player_context->m_status = PLAYER_STATUS_STOPPED;
-			goto cleanup;
-		}
-		player_pipeline = gst_element_factory_make("playbin", "play");
-		if (!player_pipeline)
-		{
-			logger_error(player_log, 1, _("gstreamer: unable to create playbin"));
-			player_context->m_status = PLAYER_STATUS_STOPPED;
-			goto cleanup;
-		}
+		if (buffer_time <= 0)
+			buffer_time = 40;
+		if (latency_time <= 0 || latency_time > buffer_time)
+			latency_time = MAX(buffer_time / 4, 1);
+		logger_debug(player_log, "gstreamer: low latency output with %d ms buffer "
+				"and %d ms period", buffer_time, latency_time);
+		g_object_set(G_OBJECT(element), 
+				"buffer-time", (gint64)buffer_time * 1000,
+				"latency-time", (gint64)latency_time * 1000, NULL);
+	}
+	g_object_set_data(G_OBJECT(bin), "audio-base-sink", element);
+} /* End of 'player_on_element_added' function */
 
-		/* Set a user-specified audio sink */
-		if (!player_set_audio_sink())
-		{
-			player_context->m_status = PLAYER_STATUS_STOPPED;
-			goto cleanup;
-		}
+/* Handle an element removed from a pipeline */
+static void player_on_element_removed( GstBin *bin, GstBin *sub_bin, 
+		GstElement *element, gpointer data )
+{
+	if (g_object_get_data(G_OBJECT(bin), "audio-base-sink") == element)
+		g_object_set_data(G_OBJECT(bin), "audio-base-sink", NULL);
+} /* End of 'player_on_element_removed' function */
 
-		/* Set fake videosink */
-		GstElement *videosink = gst_element_factory_make("fakesink", "videosink");
-		g_object_set(G_OBJECT(player_pipeline), "video-sink", videosink, NULL);
+/* Watch audio sink of a pipeline */
+static void player_watch_audio_sink( GstElement *pipeline )
+{
+	g_signal_connect(pipeline, "deep-element-added", 
+			(GCallback)player_on_element_added, NULL);
+	g_signal_connect(pipeline, "deep-element-removed", 
+			(GCallback)player_on_element_removed, NULL);
+} /* End of 'player_watch_audio_sink' function */
+
+/* Get the output buffering actually negotiated with the device and
+ * the amount of data currently queued in it (all in microseconds) */
+static bool_t player_get_output_latency( gint64 *buffer_time, 
+		gint64 *latency_time, gint64 *delay )
+{
+	GstAudioBaseSink *sink;
+	GstAudioRingBuffer *rb;
+	bool_t ok = FALSE;
 
-		/* Enable buffering
-		 * Default is 10s of buffering */
-		if ((buffer_dur = cfg_get_var_int_def(cfg_list, "buffer-duration", 10000)))
-		{
-			int pipeline_flags;
-			g_object_get(G_OBJECT(player_pipeline), "flags", &pipeline_flags, NULL);
-			pipeline_flags |= (1 << 8); /* GST_PLAY_FLAG_BUFFERING */
-			g_object_set(G_OBJECT(player_pipeline), "flags", pipeline_flags, NULL);
-			gint64 dur_ns = buffer_dur * 1000000LL;
-			g_object_set(G_OBJECT(player_pipeline), "buffer-duration", dur_ns, NULL);
-		}
+	if (player_pipeline == NULL)
+		return FALSE;
+	sink = (GstAudioBaseSink *)g_object_get_data(G_OBJECT(player_pipeline), 
+			"audio-base-sink");
+	if (sink == NULL)
+		return FALSE;
+
+	GST_OBJECT_LOCK(sink);
+	rb = sink->ringbuffer;
+	if (rb != NULL && gst_audio_ring_buffer_is_acquired(rb))
+	{
+		int rate = GST_AUDIO_INFO_RATE(&rb->spec.info);
+
+		*buffer_time = rb->spec.buffer_time;
+		*latency_time = rb->spec.latency_time;
+		*delay = (rate > 0) ? 
+			(gint64)gst_audio_ring_buffer_delay(rb) * 1000000 / rate : 0;
+		ok = TRUE;
+	}
+	GST_OBJECT_UNLOCK(sink);
+	return ok;
+} /* End of 'player_get_output_latency' function */
+
+/* Measure and log the output latency once the pipeline is playing */
+static void player_report_output_latency( void )
+{
+	gint64 buffer_time, latency_time, delay;
+
+	if (g_object_get_data(G_OBJECT(player_pipeline), "latency-reported") ||
+			!player_get_output_latency(&buffer_time, &latency_time, &delay))
+		return;
+	g_object_set_data(G_OBJECT(player_pipeline), "latency-reported", 
+			GINT_TO_POINTER(1));
+	player_out_buffer_time = buffer_time;
+	player_out_latency_time = latency_time;
+	logger_message(player_log, 0, 
+			_("Output latency (%s profile): %.1f ms buffer, %.1f ms period, "
+				"%.1f ms queued"), player_low_latency() ? "low-latency" : "default",
+			buffer_time / 1000., latency_time / 1000., delay / 1000.);
+} /* End of 'player_report_output_latency' function */
+
+/* Attach pipeline bus watch to the player thread context */
+static GSource *player_bus_watch_new( GstElement *pipeline )
+{
+	GstBus *bus;
+	GSource *watch;
+
+	bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
+	if (!bus)
+	{
+		logger_error(player_log, 1, _("gst_pipeline_get_bus failed"));
+		return NULL;
+	}
+	watch = gst_bus_create_watch(bus);
+	g_source_set_callback(watch, (GSourceFunc)player_gst_bus_call, pipeline, NULL);
+	g_source_attach(watch, player_main_ctx);
+	gst_object_unref(bus);
+	return watch;
+} /* End of 'player_bus_watch_new' function */
 
-		/* Set volume */
-		player_update_vol();
+/* Destroy a pipeline along with its bus watch */
+static void player_pipeline_destroy( GstElement *pipeline, GSource *bus_watch )
+{
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	if (bus_watch)
+	{
+		g_source_destroy(bus_watch);
+		g_source_unref(bus_watch);
+	}
+	gst_object_unref(GST_OBJECT(pipeline));
+} /* End of 'player_pipeline_destroy' function */
+
+/* Create a playbin with the configured output */
+static GstElement *player_pipeline_create( GSource **bus_watch )
+{
+	GstElement *pipeline;
 
-		/* Set bus message handler */
-		bus = gst_pipeline_get_bus(GST_PIPELINE(player_pipeline));
-		if (!bus)
+	*bus_watch = NULL;
+	pipeline = player_playbin_new(NULL);
+	if (!pipeline)
+		return NULL;
+
+	/* Set bus message handler */
+	*bus_watch = player_bus_watch_new(pipeline);
+	player_watch_audio_sink(pipeline);
+	g_signal_connect(pipeline, "audio-changed", (GCallback)player_on_audio_changed, NULL);
+	g_signal_connect(pipeline, "about-to-finish", 
+			(GCallback)player_on_about_to_finish, NULL);
+	return pipeline;
+} /* End of 'player_pipeline_create' function */
+
+/* Create a playbin with the configured output and buffering. Audio sink 
+ * may be given explicitly (the decode benchmark uses it) */
+GstElement *player_playbin_new( GstElement *audio_sink )
+{
+	GstElement *pipeline, *videosink, *filter;
+	int buffer_dur;
+
+	pipeline = gst_element_factory_make("playbin", NULL);
+	if (!pipeline)
+	{
+		logger_error(player_log, 1, _("gstreamer: unable to create playbin"));
+		if (audio_sink)
+			gst_object_unref(audio_sink);
+		return NULL;
+	}
+
+	/* Set a user-specified audio sink */
+	if (audio_sink)
+		g_object_set(G_OBJECT(pipeline), "audio-sink", audio_sink, NULL);
+	else if (!player_set_audio_sink(pipeline))
+	{
+		player_pipeline_destroy(pipeline, NULL);
+		return NULL;
+	}
+
+	/* Set fake videosink */
+	videosink = gst_element_factory_make("fakesink", "videosink");
+	g_object_set(G_OBJECT(pipeline), "video-sink", videosink, NULL);
+
+	/* Pass decoded data through the effects */
+	if (player_dsp != NULL && (filter = dsp_filter_new(player_dsp)) != NULL)
+		g_object_set(G_OBJECT(pipeline), "audio-filter", filter, NULL);
+
+	/* Enable buffering
+	 * Default is 10s of buffering */
+	if ((buffer_dur = cfg_get_var_int_def(cfg_list, "buffer-duration", 10000)))
+	{
+		int pipeline_flags;
+		g_object_get(G_OBJECT(pipeline), "flags", &pipeline_flags, NULL);
+		pipeline_flags |= (1 << 8); /* GST_PLAY_FLAG_BUFFERING */
+		g_object_set(G_OBJECT(pipeline), "flags", pipeline_flags, NULL);
+		gint64 dur_ns = buffer_dur * 1000000LL;
+		g_object_set(G_OBJECT(pipeline), "buffer-duration", dur_ns, NULL);
+	}
+	return pipeline;
+} /* End of 'player_playbin_new' function */
+
+/* Drop the standby pipeline contents. Pipeline itself is kept for reuse
+ * unless 'destroy' is set */
+static void player_standby_drop( bool_t destroy )
+{
+	if (player_standby_song)
+	{
+		song_free(player_standby_song);
+		player_standby_song = NULL;
+	}
+	player_standby_state = PLAYER_STANDBY_NONE;
+	if (!player_standby)
+		return;
+	if (destroy)
+	{
+		player_pipeline_destroy(player_standby, player_standby_bus_watch);
+		player_standby = NULL;
+		player_standby_bus_watch = NULL;
+	}
+	else
+		gst_element_set_state(player_standby, GST_STATE_READY);
+} /* End of 'player_standby_drop' function */
+
+/* Destroy the pipelines */
+static void player_pipeline_free( void )
+{
+	player_standby_drop(TRUE);
+	if (!player_pipeline)
+		return;
+
+	if (player_xfade != NULL)
+	{
+		if (player_bus_watch)
 		{
-			logger_error(player_log, 1, _("gst_pipeline_get_bus failed"));
+			g_source_destroy(player_bus_watch);
+			g_source_unref(player_bus_watch);
 		}
-		gst_bus_add_watch(bus, player_gst_bus_call, NULL);
-		gst_object_unref(bus);
-		g_signal_connect(player_pipeline, "audio-changed", (GCallback)player_on_audio_changed, NULL);
+		xfade_free(player_xfade);
+		player_xfade = NULL;
+	}
+	else
+		player_pipeline_destroy(player_pipeline, player_bus_watch);
+	player_pipeline = NULL;
+	player_bus_watch = NULL;
+	if (player_audio_pad)
+	{
+		gst_object_unref(player_audio_pad);
+		player_audio_pad = NULL;
+	}
+} /* End of 'player_pipeline_free' function */
 
-		g_object_set(G_OBJECT(player_pipeline), "uri", song_played->m_fullname, NULL);
+/* Create the crossfade engine pipeline */
+static bool_t player_xfade_new( void )
+{
+	GstElement *sink;
+	GstPad *pad;
 
-		/* Start playing */
-		gst_element_set_state(player_pipeline, GST_STATE_PLAYING);
-		gst_element_get_state(player_pipeline, NULL, NULL, GST_CLOCK_TIME_NONE);
+	if (!player_create_audio_sink(&sink))
+		return FALSE;
+	player_xfade = xfade_new(sink, player_main_ctx, 
+			cfg_get_var_int(cfg_list, "crossfade-buffer"));
+	if (player_xfade == NULL)
+		return FALSE;
+	player_pipeline = player_xfade->m_pipeline;
+	player_bus_watch = player_bus_watch_new(player_pipeline);
+
+	/* Given sink is already in the pipeline, automatic one is created later */
+	if (sink != NULL)
+		player_on_element_added(GST_BIN(player_pipeline), NULL, sink, NULL);
+	player_watch_audio_sink(player_pipeline);
+
+	/* Mixer produces float data, so effects are applied to its output */
+	if (player_dsp != NULL)
+	{
+		pad = gst_element_get_static_pad(player_xfade->m_mixer, "src");
+		dsp_attach(player_dsp, pad);
+		gst_object_unref(pad);
+	}
+
+	/* Show the mixed output format */
+	pad = gst_element_get_static_pad(player_xfade->m_volume, "src");
+	player_audio_pad = pad;
+	g_signal_connect(pad, "notify::caps", (GCallback)player_on_caps_set, NULL);
+	lat_attach_pad(pad);
+	player_attach_seek_probe(pad);
+	return TRUE;
+} /* End of 'player_xfade_new' function */
+
+/* Create the pipeline. It lives across tracks until audio setup changes */
+static bool_t player_pipeline_new( void )
+{
+	if (player_xfade_duration() > 0)
+	{
+		if (!player_xfade_new())
+			return FALSE;
+		player_pipeline_invalid = FALSE;
+		return TRUE;
+	}
+
+	player_pipeline = player_pipeline_create(&player_bus_watch);
+	if (!player_pipeline)
+		return FALSE;
+	player_pipeline_invalid = FALSE;
+	return TRUE;
+} /* End of 'player_pipeline_new' function */
+
+/* Start pre-rolling the predicted next song in the standby pipeline */
+static void player_standby_prepare( void )
+{
+	int next;
+	song_t *s;
 
-		/* Seek to start time */
-		logger_debug(player_log, "start time is %lld", song_played->m_start_time);
-		logger_debug(player_log, "cur_time is %lld", player_context->m_cur_time);
-		if (player_context->m_cur_time > 0 || song_played->m_start_time > -1)
+	if (!cfg_get_var_bool(cfg_list, "preroll-next") || player_xfade != NULL)
+		return;
+
+	plist_lock(player_plist);
+	next = player_predict_next();
+	s = (next >= 0 && next < player_plist->m_len) ? 
+		song_add_ref(player_plist->m_list[next]) : NULL;
+	plist_unlock(player_plist);
+	logger_debug(player_log, "standby: predicted next track is %d", next);
+	if (s == NULL)
+	{
+		player_standby_drop(FALSE);
+		return;
+	}
+	if (s == player_standby_song)
+	{
+		song_free(s);
+		return;
+	}
+
+	player_standby_drop(FALSE);
+	if (!player_standby)
+	{
+		player_standby = player_pipeline_create(&player_standby_bus_watch);
+		if (!player_standby)
 		{
-			guint64 tm = player_translate_time(song_played, player_context->m_cur_time, TRUE);
-			logger_debug(player_log, "gstreamer: seeking to time %lld", tm);
-			if (!gst_element_seek(player_pipeline, 1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH,
-					GST_SEEK_TYPE_SET, tm, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE))
-			{
-				logger_error(player_log, 1, _("gstreamer: gst_element_seek returned FALSE"));
-			}
+			song_free(s);
+			return;
 		}
+	}
 
-		/* Play */
-		logger_debug(player_log, "Going into track playing cycle");
-		song_finished = FALSE;
-		was_status = PLAYER_STATUS_PLAYING;
-		while (!player_end_track)
-		{
-			g_main_context_iteration(NULL, FALSE);
+	logger_debug(player_log, "standby: pre-rolling %s", s->m_fullname);
+	song_update_info(s);
+	player_standby_song = s;
+	player_standby_state = PLAYER_STANDBY_PREROLLING;
+	g_object_set(G_OBJECT(player_standby), "uri", s->m_fullname, NULL);
+	if (gst_element_set_state(player_standby, GST_STATE_PAUSED) == 
+			GST_STATE_CHANGE_FAILURE)
+	{
+		logger_debug(player_log, "standby: unable to pre-roll");
+		player_standby_drop(FALSE);
+	}
+} /* End of 'player_standby_prepare' function */
 
-			if (player_context->m_status != was_status)
+/* Handle standby pipeline bus message */
+static void player_standby_bus_call( GstMessage *msg )
+{
+	switch (GST_MESSAGE_TYPE(msg))
+	{
+	case GST_MESSAGE_ASYNC_DONE:
+		if (player_standby_state == PLAYER_STANDBY_PREROLLING &&
+				(player_standby_song->m_start_time > 0 || 
+				 player_standby_song->m_end_time > -1))
+		{
+			logger_debug(player_log, "standby: seeking to the song start");
+			player_standby_state = PLAYER_STANDBY_SEEKING;
+			if (!player_seek_pipeline(player_standby, player_standby_song, 0,
+					GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE))
 			{
-				switch (player_context->m_status)
-				{
-				case PLAYER_STATUS_PLAYING:
-					gst_element_set_state(player_pipeline, GST_STATE_PLAYING);
-					break;
-				case PLAYER_STATUS_PAUSED:
-					gst_element_set_state(player_pipeline, GST_STATE_PAUSED);
-					break;
-				case PLAYER_STATUS_STOPPED:
-					gst_element_set_state(player_pipeline, GST_STATE_READY);
-					break;
-				}
+				logger_debug(player_log, "standby: seek failed");
+				player_standby_drop(FALSE);
 			}
+		}
+		else if (player_standby_state != PLAYER_STANDBY_NONE)
+		{
+			logger_debug(player_log, "standby: %s is ready", 
+					player_standby_song->m_fullname);
+			player_standby_state = PLAYER_STANDBY_READY;
+		}
+		break;
 
-			if (player_context->m_status == PLAYER_STATUS_PLAYING)
-			{
-				gint64 tm;
+	case GST_MESSAGE_ERROR:
+		logger_debug(player_log, "standby: pre-roll failed");
+		player_standby_drop(FALSE);
+		break;
 
-				/* Update time */
-				if (gst_element_query_position(player_pipeline, GST_FORMAT_TIME, &tm))
-				{
-					tm = player_translate_time(song_played, tm, FALSE);
-					if (tm != player_context->m_cur_time)
-					{
-						int was_seconds = TIME_TO_SECONDS(player_context->m_cur_time);
-						int new_seconds = TIME_TO_SECONDS(tm);
-						player_context->m_cur_time = tm;
+	default:
+		break;
+	}
+} /* End of 'player_standby_bus_call' function */
 
-						if (was_seconds != new_seconds)
-						{
-							pmng_hook(player_pmng, "player-time");
-							wnd_invalidate(player_wnd);
-						}
-					}
-				}
+/* Make the standby pipeline current if it has pre-rolled the song */
+static bool_t player_standby_take( song_t *s )
+{
+	GstElement *was_pipeline;
+	GSource *was_watch;
 
-				/* Check for end of projected song */
-				if (song_played->m_end_time > -1 && 
-						player_translate_time(song_played, player_context->m_cur_time, TRUE) >= 
-						song_played->m_end_time)
-				{
-					logger_debug(player_log, _("stopping at time %lld(%lld) with end_time=%lld."), 
-							player_context->m_cur_time,
-							player_translate_time(song_played, player_context->m_cur_time, TRUE),
-							song_played->m_end_time);
-					song_finished = TRUE;
-					break;
-				}
-			}
+	if (player_standby_state == PLAYER_STANDBY_NONE)
+		return FALSE;
+	if (s != player_standby_song || player_context->m_cur_time != 0 ||
+			player_standby_state != PLAYER_STANDBY_READY)
+	{
+		logger_debug(player_log, "standby: miss for %s", s->m_fullname);
+		return FALSE;
+	}
+	logger_debug(player_log, "standby: hit for %s", s->m_fullname);
+
+	/* Swap pipelines; the old one will be used for the next pre-roll */
+	was_pipeline = player_pipeline;
+	was_watch = player_bus_watch;
+	player_pipeline = player_standby;
+	player_bus_watch = player_standby_bus_watch;
+	player_standby = was_pipeline;
+	player_standby_bus_watch = was_watch;
+	song_free(player_standby_song);
+	player_standby_song = NULL;
+	player_standby_state = PLAYER_STANDBY_NONE;
+	if (player_standby)
+		gst_element_set_state(player_standby, GST_STATE_READY);
+
+	/* Caps of the new pipeline are known already */
+	player_on_audio_changed(player_pipeline, NULL);
+	return TRUE;
+} /* End of 'player_standby_take' function */
 
-			if (player_end_of_stream)
-			{
-				player_end_of_stream = FALSE;
-				song_finished = TRUE;
-				break;
-			}
+/* Attach a timer to the player thread context */
+static GSource *player_add_timer( guint interval, GSourceFunc func )
+{
+	GSource *src = g_timeout_source_new(interval);
+	g_source_set_callback(src, func, NULL, NULL);
+	g_source_attach(src, player_main_ctx);
+	return src;
+} /* End of 'player_add_timer' function */
+
+/* Remove a timer */
+static void player_remove_timer( GSource **src )
+{
+	if (*src == NULL)
+		return;
+	g_source_destroy(*src);
+	g_source_unref(*src);
+	*src = NULL;
+} /* End of 'player_remove_timer' function */
 
-			was_status = player_context->m_status;
-			util_wait();
-		}
-		logger_debug(player_log, "End playing track");
+/* Set pipeline state */
+static void player_pipeline_set_state( GstState state )
+{
+	if (player_xfade != NULL)
+		xfade_set_state(player_xfade, state);
+	else
+		gst_element_set_state(player_pipeline, state);
+} /* End of 'player_pipeline_set_state' function */
+
+/* Get crossfade duration in milliseconds (0 means no crossfade) */
+static int player_xfade_duration( void )
+{
+	int dur = cfg_get_var_int(cfg_list, "crossfade-duration");
+	return (dur > 0) ? dur : 0;
+} /* End of 'player_xfade_duration' function */
+
+/* Complete the transition to the song being faded in */
+static gboolean player_on_xfade_timer( gpointer data );
+
+/* Stop crossfade timer (also a suspended one) */
+static void player_stop_xfade_timer( void )
+{
+	player_remove_timer(&player_xfade_timer);
+	player_xfade_left = -1;
+} /* End of 'player_stop_xfade_timer' function */
+
+/* Start crossfade timer firing in 'left' microseconds */
+static void player_start_xfade_timer( gint64 left )
+{
+	player_stop_xfade_timer();
+	player_xfade_deadline = g_get_monotonic_time() + left;
+	player_xfade_timer = player_add_timer(left / 1000, player_on_xfade_timer);
+} /* End of 'player_start_xfade_timer' function */
+
+/* Suspend crossfade timer while play is paused, as the fade doesn't
+ * go on then */
+static void player_suspend_xfade_timer( void )
+{
+	if (player_xfade_timer == NULL)
+		return;
+	player_remove_timer(&player_xfade_timer);
+	player_xfade_left = MAX(player_xfade_deadline - g_get_monotonic_time(), 0);
+} /* End of 'player_suspend_xfade_timer' function */
+
+/* Re-arm suspended crossfade timer with the time it had left */
+static void player_resume_xfade_timer( void )
+{
+	if (player_xfade_left >= 0)
+		player_start_xfade_timer(player_xfade_left);
+} /* End of 'player_resume_xfade_timer' function */
+
+/* Complete the transition to the song being faded in */
+static gboolean player_on_xfade_timer( gpointer data )
+{
+	int index;
+
+	player_stop_xfade_timer();
+	index = player_gapless_take();
+	xfade_switch(player_xfade);
+	lat_track_end();
+
+	/* Song has been removed from the list */
+	if (index < 0)
+	{
+		player_end_play(TRUE);
+		pmng_hook(player_pmng, "player-status");
+		return G_SOURCE_REMOVE;
+	}
+
+	logger_debug(player_log, "Crossfade transition to track %s", 
+			player_plist->m_list[index]->m_fullname);
+	player_continue_with(index);
+	return G_SOURCE_REMOVE;
+} /* End of 'player_on_xfade_timer' function */
+
+/* Prepare the next song if the current one is close to its end.
+ * The next slice of the same file is joined without fading */
+static void player_xfade_check( void )
+{
+	song_t *cur = player_song_played, *next;
+	song_time_t end, pos, fade, left;
+	int index;
+
+	if (player_xfade == NULL || player_gapless_decided || player_end_track ||
+			cur == NULL || player_applied_status != PLAYER_STATUS_PLAYING)
+		return;
+
+	/* Song end in the file time */
+	end = (cur->m_end_time > -1) ? cur->m_end_time : cur->m_len;
+	if (end <= 0)
+		return;
+	pos = player_translate_time(cur, player_context->m_cur_time, TRUE);
+	fade = (song_time_t)player_xfade_duration() * GST_MSECOND;
+	if (end - pos > fade + PLAYER_XFADE_LEAD)
+		return;
+
+	/* Queue is taken only when the transition completes, since the
+	 * choice may be dropped before */
+	pthread_mutex_lock(&player_gapless_mutex);
+	plist_lock(player_plist);
+	index = player_predict_next();
+	player_gapless_decided = TRUE;
+	player_gapless_index = index;
+	next = NULL;
+	if (index >= 0)
+		next = player_gapless_song = song_add_ref(player_plist->m_list[index]);
+	plist_unlock(player_plist);
+	pthread_mutex_unlock(&player_gapless_mutex);
+
+	/* Nothing to play further, pipeline will just finish */
+	if (next == NULL)
+		return;
+
+	/* Fade must fit into both songs */
+	if (player_is_next_slice(cur, next))
+		fade = 0;
+	if (fade > end - pos)
+		fade = end - pos;
+	if (next->m_len > 0 && fade > next->m_len / 2)
+		fade = next->m_len / 2;
+
+	left = xfade_queue_next(player_xfade, next->m_fullname, 
+			(next->m_start_time > 0) ? next->m_start_time : 0, next->m_end_time,
+			end - fade, fade, 
+			xfade_curve_by_name(cfg_get_var(cfg_list, "crossfade-curve")));
+
+	/* Next song will be started the usual way at the end of stream */
+	if (left < 0)
+	{
+		logger_debug(player_log, "crossfade: unable to queue %s", next->m_fullname);
+		return;
+	}
+	player_start_xfade_timer(left / GST_USECOND);
+} /* End of 'player_xfade_check' function */
+
+/* Handle error in the crossfade pipeline */
+static void player_xfade_on_error( GstObject *src )
+{
+	if (xfade_on_error(player_xfade, src))
+	{
+		player_track_finished();
+		return;
+	}
+
+	/* Next song failed to start, so it will be tried again the usual way */
+	if (player_xfade->m_next == NULL && player_xfade_timer != NULL)
+		player_stop_xfade_timer();
+} /* End of 'player_xfade_on_error' function */
+
+/* Get seek flags for the 'seek-mode' setting */
+static GstSeekFlags player_seek_flags( void )
+{
+	char *mode = cfg_get_var(cfg_list, "seek-mode");
+
+	if (mode != NULL && !strcasecmp(mode, "fast"))
+		return GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_NEAREST;
+	return GST_SEEK_FLAG_ACCURATE;
+} /* End of 'player_seek_flags' function */
+
+/* Drop pending seek request and forget the seek in flight */
+static void player_seek_reset( void )
+{
+	player_seek_to = -1;
+	player_seek_in_flight = FALSE;
+	player_remove_timer(&player_seek_timer);
+	g_atomic_int_set(&player_seek_probe_state, 0);
+} /* End of 'player_seek_reset' function */
+
+/* Watch audio reaching the sink after a seek (called from a streaming thread) */
+static GstPadProbeReturn player_on_seek_probe( GstPad *pad, 
+		GstPadProbeInfo *info, gpointer data )
+{
+	gint64 now;
+
+	if (!g_atomic_int_get(&player_seek_probe_state))
+		return GST_PAD_PROBE_OK;
+
+	/* Buffers still flowing before the flush are not the seek result */
+	if (info->type & GST_PAD_PROBE_TYPE_EVENT_FLUSH)
+	{
+		if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_FLUSH_STOP)
+			g_atomic_int_compare_and_exchange(&player_seek_probe_state, 1, 2);
+		return GST_PAD_PROBE_OK;
+	}
+	if (!(info->type & GST_PAD_PROBE_TYPE_BUFFER) ||
+			!g_atomic_int_compare_and_exchange(&player_seek_probe_state, 2, 0))
+		return GST_PAD_PROBE_OK;
+
+	now = g_get_monotonic_time();
+	pthread_mutex_lock(&player_seek_probe_mutex);
+	logger_debug(player_log, "seek: audio is %.1f ms after the request, "
+			"%.1f ms after the seek (%d requests coalesced)",
+			(now - player_seek_probe_request) / 1000.,
+			(now - player_seek_probe_issue) / 1000.,
+			player_seek_probe_num);
+	pthread_mutex_unlock(&player_seek_probe_mutex);
+	return GST_PAD_PROBE_OK;
+} /* End of 'player_on_seek_probe' function */
+
+/* Watch the sink pad for the seek latency samples */
+static void player_attach_seek_probe( GstPad *pad )
+{
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | 
+			GST_PAD_PROBE_TYPE_EVENT_FLUSH, player_on_seek_probe, NULL, NULL);
+} /* End of 'player_attach_seek_probe' function */
+
+/* Start the latency sample of the seek just issued */
+static void player_arm_seek_probe( void )
+{
+	pthread_mutex_lock(&player_seek_probe_mutex);
+	player_seek_probe_issue = player_seek_issue_time;
+	player_seek_probe_request = player_seek_issued_request;
+	player_seek_probe_num = player_seek_issued_num;
+	g_atomic_int_set(&player_seek_probe_state, 1);
+	pthread_mutex_unlock(&player_seek_probe_mutex);
+} /* End of 'player_arm_seek_probe' function */
+
+/* Handle seek delay timer */
+static gboolean player_on_seek_timer( gpointer data )
+{
+	player_remove_timer(&player_seek_timer);
+	player_apply_seek();
+	return G_SOURCE_REMOVE;
+} /* End of 'player_on_seek_timer' function */
+
+/* Pipeline has completed the seek in flight, so the next one may be 
+ * issued. Latency is sampled by the sink probe, as audio reaches the
+ * sink later than that */
+static void player_seek_done( void )
+{
+	if (!player_seek_in_flight)
+		return;
+	player_seek_in_flight = FALSE;
+	player_apply_seek();
+} /* End of 'player_seek_done' function */
+
+/* Apply the pending seek request. While the pipeline is busy with
+ * a previous seek or if it was issued too recently, the request waits */
+static void player_apply_seek( void )
+{
+	gint64 now = g_get_monotonic_time();
+	gint64 min_interval = 
+		(gint64)cfg_get_var_int(cfg_list, "seek-min-interval") * 1000;
+	song_time_t t;
+	GstSeekFlags flags;
+	bool_t ok;
+
+	if (player_seek_to < 0 || !player_track_active || player_start_pending ||
+			player_seek_timer != NULL)
+		return;
+	if (player_seek_in_flight && now - player_seek_issue_time < PLAYER_SEEK_TIMEOUT)
+		return;
+	if (now - player_seek_issue_time < min_interval)
+	{
+		player_seek_timer = player_add_timer(
+				(min_interval - (now - player_seek_issue_time)) / 1000 + 1,
+				player_on_seek_timer);
+		return;
+	}
+
+	/* Take request */
+	t = player_seek_to;
+	player_seek_to = -1;
+	player_seek_issued_request = player_seek_request_time;
+	player_seek_issued_num = player_seek_num_requests;
+
+	flags = player_seek_flags();
+	if (player_xfade != NULL)
+	{
+		/* Transition being prepared is cancelled */
+		player_stop_xfade_timer();
+		player_gapless_reset();
+		ok = xfade_seek(player_xfade, 
+				player_translate_time(player_song_played, t, TRUE), flags);
+	}
+	else
+		ok = player_seek_pipeline(player_pipeline, player_song_played, t,
+				GST_SEEK_FLAG_FLUSH | flags);
+	if (!ok)
+	{
+		logger_error(player_log, 1, _("gstreamer: gst_element_seek returned FALSE"));
+		player_seek_in_flight = FALSE;
+		return;
+	}
+	player_seek_in_flight = TRUE;
+	player_seek_issue_time = now;
+	player_arm_seek_probe();
+} /* End of 'player_apply_seek' function */
+
+/* Get pipeline position in the file time */
+static bool_t player_query_position( gint64 *tm )
+{
+	if (player_xfade != NULL)
+	{
+		*tm = xfade_get_position(player_xfade);
+		return TRUE;
+	}
+	return gst_element_query_position(player_pipeline, GST_FORMAT_TIME, tm);
+} /* End of 'player_query_position' function */
+
+/* Update the current time */
+static void player_update_time( void )
+{
+	gint64 now = g_get_monotonic_time(), tm, step;
+	song_t *s = player_song_played;
+
+	/* Sample pipeline or interpolate */
+	if (!player_pos_valid || now - player_pos_sample_time >= player_pos_sample_interval)
+	{
+		if (!player_query_position(&tm))
+			return;
+		player_pos_sample = tm;
+		player_pos_sample_time = now;
+		player_pos_valid = TRUE;
+	}
+	else
+		tm = player_pos_sample + (now - player_pos_sample_time) * 1000;
+
+	tm = player_translate_time(s, tm, FALSE);
+	if (tm < 0)
+		tm = 0;
+	else if (s->m_len > 0 && tm > s->m_len)
+		tm = s->m_len;
+	player_context->m_cur_time = tm;
+
+	/* Publish */
+	step = tm / player_pos_granularity;
+	if (step != player_pos_step)
+	{
+		if (player_pos_step < 0)
+			lat_mark(LAT_FIRST_POSITION);
+		player_pos_step = step;
+		pmng_hook(player_pmng, "player-time");
+		wnd_invalidate(player_wnd);
+	}
+	player_xfade_check();
+} /* End of 'player_update_time' function */
+
+/* Time update timer handler */
+static gboolean player_on_time_timer( gpointer data )
+{
+	player_update_time();
+	return G_SOURCE_CONTINUE;
+} /* End of 'player_on_time_timer' function */
+
+/* Get time update interval in milliseconds */
+static int player_time_update_interval( void )
+{
+	int interval = cfg_get_var_int(cfg_list, "time-update-interval");
+	return (interval > 0) ? interval : 100;
+} /* End of 'player_time_update_interval' function */
+
+/* (Re)start position tracking. Pipeline will be sampled on the next tick */
+static void player_start_time_timer( void )
+{
+	int gran = cfg_get_var_int(cfg_list, "position-granularity");
+	int sample = cfg_get_var_int(cfg_list, "position-sample-interval");
+	int interval = player_time_update_interval();
+
+	if (gran <= 0)
+		gran = 1000;
+	if (sample <= 0)
+		sample = 1000;
+	player_pos_granularity = gran * GST_MSECOND;
+	player_pos_sample_interval = sample * 1000LL;
+	player_pos_valid = FALSE;
+	player_pos_step = -1;
+
+	/* Position does not move while paused or stopped */
+	player_remove_timer(&player_time_timer);
+	if (player_context->m_status != PLAYER_STATUS_PLAYING)
+		return;
+
+	/* Tick at least once per granularity step */
+	player_time_timer = player_add_timer(MIN(interval, gran), player_on_time_timer);
+} /* End of 'player_start_time_timer' function */
+
+/* Start track playing in the pipeline */
+static void player_track_start( void )
+{
+	song_t *s = player_plist->m_list[player_plist->m_cur_song];
+
+	player_active_gen = player_track_gen;
+	player_end_track = FALSE;
+	player_gapless_reset();
+	player_seek_reset();
 
-		gst_element_set_state(player_pipeline, GST_STATE_NULL);
+	logger_debug(player_log, "Playing track %s", s->m_fullname);
 
-		/* Send message about track end */
-		if (!player_end_track)
+	/* Get song length and information */
+	logger_debug(player_log, "Updating song info");
+	song_update_info(s);
+
+	/* Create gstreamer stuff if not yet */
+	if (player_pipeline_invalid || (player_pipeline != NULL && 
+				(player_xfade != NULL) != (player_xfade_duration() > 0)))
+		player_pipeline_free();
+
+	/* Song is pre-rolled already, so just start it */
+	if (player_standby_take(s))
+	{
+		lat_mark(LAT_PIPELINE_CREATED);
+		player_song_played = s;
+		player_track_active = TRUE;
+		player_update_rgain(s);
+		prefetch_note_play(s);
+		player_prefetch_next();
+		gst_element_set_state(player_pipeline, GST_STATE_PLAYING);
+		player_applied_status = PLAYER_STATUS_PLAYING;
+		player_start_time_timer();
+		player_standby_prepare();
+		return;
+	}
+
+	if (!player_pipeline && !player_pipeline_new())
+	{
+		player_context->m_status = PLAYER_STATUS_STOPPED;
+		return;
+	}
+	lat_mark(LAT_PIPELINE_CREATED);
+	player_song_played = s;
+	player_track_active = TRUE;
+
+	/* Set volume */
+	player_update_rgain(s);
+	prefetch_note_play(s);
+	player_prefetch_next();
+
+	/* Crossfade engine seeks its decks on its own */
+	if (player_xfade != NULL)
+	{
+		if (!xfade_play(player_xfade, s->m_fullname, 
+					player_translate_time(s, player_context->m_cur_time, TRUE),
+					s->m_end_time))
 		{
-			logger_debug(player_log, "Going to the next track");
-			player_next_track();
+			player_track_stop();
+			player_context->m_status = PLAYER_STATUS_STOPPED;
+			return;
 		}
+		player_pipeline_set_state(GST_STATE_PLAYING);
+		player_applied_status = PLAYER_STATUS_PLAYING;
+		player_start_time_timer();
+		return;
+	}
 
-		/* End playing */
-		player_context->m_bitrate = player_context->m_freq = player_context->m_channels = player_context->m_depth = 0;
+	g_object_set(G_OBJECT(player_pipeline), "uri", s->m_fullname, NULL);
 
-		/* Update screen */
-		wnd_invalidate(player_wnd);
+	/* Song has to be sought to its start time first. Pipeline is not
+	 * waited for here, since a slow source would block the thread;
+	 * the seek is done and play started when it has pre-rolled */
+	logger_debug(player_log, "start time is %lld", s->m_start_time);
+	logger_debug(player_log, "cur_time is %lld", player_context->m_cur_time);
+	if (player_context->m_cur_time > 0 || s->m_start_time > -1 || s->m_end_time > -1)
+	{
+		gst_element_set_state(player_pipeline, GST_STATE_PAUSED);
+		player_applied_status = PLAYER_STATUS_PAUSED;
+		player_start_pending = TRUE;
+	}
+	/* Start playing */
+	else
+	{
+		gst_element_set_state(player_pipeline, GST_STATE_PLAYING);
+		player_applied_status = PLAYER_STATUS_PLAYING;
+		player_start_time_timer();
+	}
+	player_standby_prepare();
+} /* End of 'player_track_start' function */
 
-	cleanup:
-		if (player_pipeline)
+/* Seek the pre-rolled pipeline to the track start time and bring it
+ * to the wanted status */
+static void player_start_done( void )
+{
+	player_start_pending = FALSE;
+	if (!player_track_active || player_song_played == NULL)
+		return;
+
+	/* Current time already holds the target of the seeks requested
+	 * in the meantime */
+	player_seek_to = -1;
+	if (!player_seek_pipeline(player_pipeline, player_song_played, 
+				player_context->m_cur_time, GST_SEEK_FLAG_FLUSH))
+	{
+		logger_error(player_log, 1, _("gstreamer: gst_element_seek returned FALSE"));
+	}
+	player_sync();
+} /* End of 'player_start_done' function */
+
+/* Stop track playing in the pipeline */
+static void player_track_stop( void )
+{
+	if (!player_track_active)
+		return;
+
+	logger_debug(player_log, "End playing track");
+	player_remove_timer(&player_time_timer);
+	player_stop_xfade_timer();
+	player_seek_reset();
+	player_start_pending = FALSE;
+	player_track_active = FALSE;
+	player_song_played = NULL;
+
+	/* Keep the output open if we are going to play further */
+	player_pipeline_set_state(
+			(player_context->m_status == PLAYER_STATUS_STOPPED) ?
+			GST_STATE_NULL : GST_STATE_READY);
+	if (player_context->m_status == PLAYER_STATUS_STOPPED && player_standby)
+	{
+		player_standby_drop(FALSE);
+		gst_element_set_state(player_standby, GST_STATE_NULL);
+	}
+
+	/* End playing */
+	player_context->m_bitrate = player_context->m_freq = player_context->m_channels = player_context->m_depth = 0;
+
+	/* Update screen */
+	wnd_invalidate(player_wnd);
+} /* End of 'player_track_stop' function */
+
+/* Handle the end of track and go to the next one */
+static void player_track_finished( void )
+{
+	if (!player_track_active)
+		return;
+
+	player_track_stop();
+	lat_start(g_get_monotonic_time(), LAT_REQ_AUTO);
+	lat_track_end();
+	logger_debug(player_log, "Going to the next track");
+	if (player_gapless_decided)
+		player_set_track(player_gapless_take());
+	else
+		player_next_track();
+	player_gapless_reset();
+} /* End of 'player_track_finished' function */
+
+/* Bring pipeline in accordance with the player state */
+static void player_sync( void )
+{
+	bool_t want_play = (player_plist->m_cur_song >= 0 && 
+			player_context->m_status != PLAYER_STATUS_STOPPED);
+
+	/* (Re)start or stop the track */
+	if (player_track_active && (!want_play || player_end_track ||
+				player_active_gen != player_track_gen))
+		player_track_stop();
+	if (!player_track_active && want_play)
+		player_track_start();
+	player_apply_seek();
+	if (!player_track_active || player_start_pending ||
+			player_context->m_status == player_applied_status)
+		return;
+
+	/* Apply status change */
+	switch (player_context->m_status)
+	{
+	case PLAYER_STATUS_PLAYING:
+		player_pipeline_set_state(GST_STATE_PLAYING);
+		player_start_time_timer();
+		player_resume_xfade_timer();
+		break;
+	case PLAYER_STATUS_PAUSED:
+		player_pipeline_set_state(GST_STATE_PAUSED);
+		player_remove_timer(&player_time_timer);
+		player_suspend_xfade_timer();
+		break;
+	}
+	player_applied_status = player_context->m_status;
+} /* End of 'player_sync' function */
+
+/* Check if we are in the player thread */
+static bool_t player_in_thread( void )
+{
+	return player_thread_running && pthread_equal(pthread_self(), player_thread_self);
+} /* End of 'player_in_thread' function */
+
+/* Put a command to the ring. Slot sequence number tells its state: 
+ * equal to the position it is free for a producer; position + 1 means
+ * filled for the player thread. Returns FALSE if the ring is full */
+static bool_t player_cmd_push( player_cmd_t *cmd )
+{
+	player_cmd_t *slot;
+	guint pos;
+
+	for ( ;; )
+	{
+		gint diff;
+
+		pos = (guint)g_atomic_int_get(&player_cmd_tail);
+		slot = &player_cmd_ring[pos % PLAYER_CMD_RING_SIZE];
+		diff = (gint)((guint)g_atomic_int_get(&slot->m_seq) - pos);
+		if (diff == 0)
 		{
-			gst_object_unref(GST_OBJECT(player_pipeline));
-			player_pipeline = NULL;
+			if (g_atomic_int_compare_and_exchange(&player_cmd_tail, 
+						(gint)pos, (gint)(pos + 1)))
+				break;
 		}
-		if (loop)
+		else if (diff < 0)
+			return FALSE;
+	}
+
+	/* Fill slot and publish it */
+	slot->m_type = cmd->m_type;
+	slot->m_int = cmd->m_int;
+	slot->m_time = cmd->m_time;
+	slot->m_val = cmd->m_val;
+	slot->m_flag = cmd->m_flag;
+	slot->m_stamp = cmd->m_stamp;
+	slot->m_done = cmd->m_done;
+	g_atomic_int_set(&slot->m_seq, (gint)(pos + 1));
+
+	/* Wake the thread up unless it is already going to look at the ring */
+	if (g_atomic_int_compare_and_exchange(&player_cmd_wakeup, 0, 1) &&
+			player_cmd_pipe[1] >= 0)
+	{
+		char c = 0;
+		if (write(player_cmd_pipe[1], &c, 1) < 0)
+			logger_debug(player_log, "player wakeup failed");
+	}
+	return TRUE;
+} /* End of 'player_cmd_push' function */
+
+/* Put a command to the ring waiting for space if needed */
+static void player_cmd_send( player_cmd_t *cmd )
+{
+	cmd->m_stamp = g_get_monotonic_time();
+	while (!player_cmd_push(cmd))
+	{
+		/* Player thread syncs after applying the commands anyway */
+		if (player_in_thread() || !player_thread_running)
 		{
-			g_main_loop_unref(loop);
-			loop = NULL;
+			logger_debug(player_log, "player command %d dropped", cmd->m_type);
+			return;
 		}
+		g_usleep(1000);
+	}
+} /* End of 'player_cmd_send' function */
+
+/* Pass a control request to the player thread. Returns FALSE if we are
+ * in the player thread (or it is not running) and the request is to be 
+ * done by the caller. A synchronous command is waited to be applied */
+static bool_t player_cmd_forward( int type, int ival, song_time_t time,
+		double val, bool_t flag, bool_t wait )
+{
+	player_cmd_t cmd;
+	volatile bool_t done = FALSE;
+
+	if (!player_thread_running || player_in_thread())
+		return FALSE;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.m_type = type;
+	cmd.m_int = ival;
+	cmd.m_time = time;
+	cmd.m_val = val;
+	cmd.m_flag = flag;
+	cmd.m_done = (wait ? &done : NULL);
+	player_cmd_send(&cmd);
+
+	if (wait)
+	{
+		pthread_mutex_lock(&player_cmd_done_mutex);
+		while (!done && player_thread_running)
+			pthread_cond_wait(&player_cmd_done_cond, &player_cmd_done_mutex);
+		pthread_mutex_unlock(&player_cmd_done_mutex);
 	}
+	return TRUE;
+} /* End of 'player_cmd_forward' function */
+
+/* Apply a command in the player thread */
+static void player_cmd_apply( player_cmd_t *cmd )
+{
+	player_cmd_stamp = cmd->m_stamp;
+
+	/* Requests starting a track are timed from the moment they were sent */
+	if (cmd->m_type == PLAYER_CMD_PLAY || cmd->m_type == PLAYER_CMD_START_PLAY ||
+			cmd->m_type == PLAYER_CMD_RESUME || cmd->m_type == PLAYER_CMD_SKIP)
+	{
+		lat_start(cmd->m_stamp, LAT_REQ_USER);
+		lat_mark(LAT_CMD_APPLIED);
+	}
+
+	switch (cmd->m_type)
+	{
+	case PLAYER_CMD_PLAY:
+		player_play(cmd->m_int, cmd->m_time);
+		break;
+	case PLAYER_CMD_START_PLAY:
+		player_start_play(cmd->m_int, cmd->m_time);
+		break;
+	case PLAYER_CMD_RESUME:
+		player_resume();
+		break;
+	case PLAYER_CMD_PAUSE_RESUME:
+		player_pause_resume();
+		break;
+	case PLAYER_CMD_STOP:
+		player_stop();
+		break;
+	case PLAYER_CMD_END_PLAY:
+		player_end_play(cmd->m_flag);
+		break;
+	case PLAYER_CMD_SKIP:
+		player_skip_songs(cmd->m_int, TRUE);
+		break;
+	case PLAYER_CMD_SEEK:
+		player_seek(cmd->m_time, cmd->m_flag);
+		break;
+	case PLAYER_CMD_VOLUME:
+		player_set_vol(cmd->m_val, cmd->m_flag);
+		break;
+	case PLAYER_CMD_STATUS:
+		player_set_status(cmd->m_int);
+		break;
+	case PLAYER_CMD_TIME_BACK:
+		player_time_back();
+		break;
+	}
+	player_cmd_stamp = 0;
+
+	if (cmd->m_done != NULL)
+	{
+		pthread_mutex_lock(&player_cmd_done_mutex);
+		*cmd->m_done = TRUE;
+		pthread_cond_broadcast(&player_cmd_done_cond);
+		pthread_mutex_unlock(&player_cmd_done_mutex);
+	}
+} /* End of 'player_cmd_apply' function */
+
+/* Apply all the commands in the ring. Returns FALSE if thread has to quit */
+static bool_t player_cmd_drain( void )
+{
+	bool_t quit = FALSE;
+
+	for ( ;; )
+	{
+		player_cmd_t *slot = &player_cmd_ring[player_cmd_head % PLAYER_CMD_RING_SIZE];
+		player_cmd_t cmd;
+
+		if ((gint)((guint)g_atomic_int_get(&slot->m_seq) - (player_cmd_head + 1)) < 0)
+			break;
+		cmd = *slot;
+		g_atomic_int_set(&slot->m_seq, (gint)(player_cmd_head + PLAYER_CMD_RING_SIZE));
+		player_cmd_head ++;
+
+		if (cmd.m_type == PLAYER_CMD_QUIT)
+			quit = TRUE;
+		else
+			player_cmd_apply(&cmd);
+	}
+	return !quit;
+} /* End of 'player_cmd_drain' function */
+
+/* Handle commands arriving to the player thread */
+static gboolean player_on_cmd( gint fd, GIOCondition cond, gpointer data )
+{
+	char buf[64];
+
+	while (read(fd, buf, sizeof(buf)) == sizeof(buf))
+		;
+
+	/* Producers coming after this point wake us up again */
+	g_atomic_int_set(&player_cmd_wakeup, 0);
+	if (!player_cmd_drain() || player_end_thread)
+	{
+		g_main_loop_quit(player_main_loop);
+		return G_SOURCE_CONTINUE;
+	}
+	player_sync();
+	return G_SOURCE_CONTINUE;
+} /* End of 'player_on_cmd' function */
+
+/* Send a parameterless command to the player thread */
+static void player_send_cmd( int type )
+{
+	player_cmd_t cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.m_type = type;
+	player_cmd_send(&cmd);
+} /* End of 'player_send_cmd' function */
+
+/* Set player status */
+void player_set_status( int status )
+{
+	if (player_cmd_forward(PLAYER_CMD_STATUS, status, 0, 0, FALSE, FALSE))
+		return;
+	player_context->m_status = status;
+	player_send_cmd(PLAYER_CMD_SYNC);
+} /* End of 'player_set_status' function */
+
+/* Player thread function */
+void *player_thread( void *arg )
+{
+	GSource *cmd_src;
+
+	logger_debug(player_log, "In player_thread");
+
+	/* All the player sources live in the thread's own context */
+	player_main_ctx = g_main_context_new();
+	g_main_context_push_thread_default(player_main_ctx);
+	player_main_loop = g_main_loop_new(player_main_ctx, FALSE);
+	if (!player_main_loop)
+	{
+		logger_error(player_log, 1, _("g_main_loop_new failed"));
+		g_main_context_pop_thread_default(player_main_ctx);
+		g_main_context_unref(player_main_ctx);
+		player_main_ctx = NULL;
+		return NULL;
+	}
+	cmd_src = g_unix_fd_source_new(player_cmd_pipe[0], G_IO_IN);
+	g_source_set_callback(cmd_src, (GSourceFunc)player_on_cmd, NULL, NULL);
+	g_source_attach(cmd_src, player_main_ctx);
+	player_thread_self = pthread_self();
+	player_thread_running = TRUE;
+
+	/* Main loop */
+	player_sync();
+	if (!player_end_thread)
+		g_main_loop_run(player_main_loop);
+
+	player_track_stop();
+	player_pipeline_free();
+	g_source_destroy(cmd_src);
+	g_source_unref(cmd_src);
+	g_main_loop_unref(player_main_loop);
+	player_main_loop = NULL;
+	g_main_context_pop_thread_default(player_main_ctx);
+	g_main_context_unref(player_main_ctx);
+	player_main_ctx = NULL;
+
+	/* Release those waiting for commands that will never be applied */
+	pthread_mutex_lock(&player_cmd_done_mutex);
+	player_thread_running = FALSE;
+	pthread_cond_broadcast(&player_cmd_done_cond);
+	pthread_mutex_unlock(&player_cmd_done_mutex);
 	logger_debug(player_log, "Player thread finished");
 	return NULL;
 } /* End of 'player_thread' function */
@@ -2307,6 +4173,23 @@ void player_search_dialog( void )
 	dialog_arrange_children(dlg);
 } /* End of 'player_search_dialog' function */
 
+/* Display play list filter dialog box. Play list is filtered while
+ * the string is typed */
+void player_filter_dialog( void )
+{
+	dialog_t *dlg;
+	editbox_t *eb;
+	plist_view_t *v = PLIST_VIEW(player_plist);
+
+	dlg = dialog_new(wnd_root, _("Filter"));
+	eb = editbox_new_with_label(WND_OBJ(dlg->m_vbox), _("S&tring: "), 
+			"string", (v == NULL) ? "" : v->m_filter, 't', PLAYER_EB_WIDTH);
+	wnd_msg_add_handler(WND_OBJ(eb), "changed", player_on_filter_changed);
+	wnd_msg_add_handler(WND_OBJ(dlg), "cancel_clicked", 
+			player_on_filter_cancel);
+	dialog_arrange_children(dlg);
+} /* End of 'player_filter_dialog' function */
+
 /* Display variables manager */
 void player_var_manager( void )
 {
@@ -2356,8 +4239,12 @@ static void player_on_audio_setup( wnd_t *wnd )
 			!EDITBOX_EMPTY(sink_eb) ? EDITBOX_TEXT(sink_eb) : "");
 	cfg_set_var(cfg_list, "gstreamer.audio-sink-params.device", 
 			!EDITBOX_EMPTY(dev_eb) ? EDITBOX_TEXT(dev_eb) : "");
+	cfg_set_var(cfg_list, "output-profile", 
+			CHECKBOX_OBJ(dialog_find_item(DIALOG_OBJ(wnd), "low_latency"))->m_checked ?
+			"low-latency" : "default");
 
-	/* Restart playback */
+	/* Restart playback with the new output */
+	player_pipeline_invalid = TRUE;
 	if (player_plist->m_cur_song >= 0)
 		player_play(player_plist->m_cur_song, player_context->m_cur_time);
 }
@@ -2365,6 +4252,7 @@ static void player_on_audio_setup( wnd_t *wnd )
 /* Display audio output setup dialog */
 static void player_audio_setup_dlg( void )
 {
+	char latency[128];
 	dialog_t *dlg = dialog_new(wnd_root, _("Audio output setup"));
 	editbox_t *sink_eb = editbox_new_with_label(WND_OBJ(dlg->m_vbox), _("&Sink name: "),
 			"sink", "", 's', PLAYER_EB_WIDTH);
@@ -2373,6 +4261,15 @@ static void player_audio_setup_dlg( void )
 			"device", "", 'd', PLAYER_EB_WIDTH);
 	editbox_set_text(dev_eb, cfg_get_var(cfg_list, "gstreamer.audio-sink-params.device"));
 	player_audio_setup_sync_device_box(WND_OBJ(sink_eb));
+	checkbox_new(WND_OBJ(dlg->m_vbox), _("&Low latency output"), "low_latency", 
+			'l', player_low_latency());
+	if (player_out_buffer_time > 0)
+		snprintf(latency, sizeof(latency), _("%.1f ms buffer, %.1f ms period"),
+				player_out_buffer_time / 1000., player_out_latency_time / 1000.);
+	else
+		snprintf(latency, sizeof(latency), _("not measured yet"));
+	label_new_with_label(WND_OBJ(dlg->m_vbox), _("Output latency: "), latency,
+			"latency", LABEL_NOBOLD);
 	label_new(WND_OBJ(dlg->m_vbox),
 			_("\nYou can specify GStreamer sink (e.g. alsasink) and \n"
 			  "device here. Device can only be set if sink is specified.\n"
@@ -2482,6 +4379,10 @@ void player_test_dialog( void )
 	vbox = vbox_new(WND_OBJ(dlg->m_vbox), _("Tests"), 0);
 	radio_new(WND_OBJ(vbox), _("Test &1. Window library perfomance"), "1", '1', 
 			TRUE);
+	radio_new(WND_OBJ(vbox), _("Test &2. Effects perfomance"), "2", '2', 
+			FALSE);
+	radio_new(WND_OBJ(vbox), _("Test &3. Play list sort perfomance"), "3", '3', 
+			FALSE);
 	btn = button_new(WND_OBJ(dlg->m_hbox), _("&Stop job"), "stop", 's');
 	wnd_msg_add_handler(WND_OBJ(btn), "clicked", player_on_test_stop);
 	wnd_msg_add_handler(WND_OBJ(dlg), "ok_clicked", player_on_test);
@@ -2791,6 +4692,8 @@ void player_save_info_dialog( dialog_t *dlg )
 		if (genre->m_modified)
 			si_set_genre(info, EDITBOX_TEXT(genre));
 		song_update_title(songs_list[i]);
+		sidx_touch(songs_list[i]);
+		plist_song_title_changed(songs_list[i]);
 		wnd_invalidate(player_wnd);
 
 		/* Save info */
@@ -2907,6 +4810,22 @@ wnd_msg_retcode_t player_on_search( wnd_t *wnd )
 	return WND_MSG_RETCODE_OK;
 } /* End of 'player_on_search' function */
 
+/* Handle 'changed' for filter dialog edit box */
+wnd_msg_retcode_t player_on_filter_changed( wnd_t *wnd )
+{
+	plist_set_filter(player_plist, EDITBOX_TEXT(EDITBOX_OBJ(wnd)));
+	wnd_invalidate(player_wnd);
+	return WND_MSG_RETCODE_OK;
+} /* End of 'player_on_filter_changed' function */
+
+/* Handle 'cancel_clicked' for filter dialog */
+wnd_msg_retcode_t player_on_filter_cancel( wnd_t *wnd )
+{
+	plist_set_filter(player_plist, NULL);
+	wnd_invalidate(player_wnd);
+	return WND_MSG_RETCODE_OK;
+} /* End of 'player_on_filter_cancel' function */
+
 /* Handle 'ok_clicked' for advanced search dialog */
 wnd_msg_retcode_t player_on_adv_search( wnd_t *wnd )
 {
@@ -3025,6 +4944,14 @@ wnd_msg_retcode_t player_on_test( wnd_t *wnd )
 	assert(r);
 	if (r->m_checked)
 		sel = TEST_WNDLIB_PERFOMANCE;
+	r = RADIO_OBJ(dialog_find_item(DIALOG_OBJ(wnd), "2"));
+	assert(r);
+	if (r->m_checked)
+		sel = TEST_DSP_PERFOMANCE;
+	r = RADIO_OBJ(dialog_find_item(DIALOG_OBJ(wnd), "3"));
+	assert(r);
+	if (r->m_checked)
+		sel = TEST_SORT_PERFOMANCE;
 	if (sel < 0)
 		return WND_MSG_RETCODE_OK;
 
@@ -3145,7 +5072,11 @@ static bool_t player_handle_var_title_format( cfg_node_t *var, char *value,
 		return TRUE;
 
 	for ( i = 0; i < player_plist->m_len; i ++ )
+	{
 		song_update_title(player_plist->m_list[i]);
+		sidx_touch(player_plist->m_list[i]);
+		plist_song_title_changed(player_plist->m_list[i]);
+	}
 	wnd_invalidate(wnd_root);
 	return TRUE;
 } /* End of 'player_handle_var_title_format' function */
@@ -3177,6 +5108,14 @@ static bool_t player_handle_kbind_scheme( cfg_node_t *node, char *value,
 	return TRUE;
 } /* End of 'player_handle_kbind_scheme' function */
 
+/* Handle effects settings change */
+static bool_t player_handle_dsp( cfg_node_t *node, char *value, void *data )
+{
+	if (player_dsp != NULL)
+		dsp_configure(player_dsp);
+	return TRUE;
+} /* End of 'player_handle_dsp' function */
+
 /*****
  *
  * Player window class functions
@@ -3264,6 +5203,7 @@ void player_class_set_default_styles( cfg_node_t *list )
 	cfg_set_var(list, "kbind.centrize", "C");
 	cfg_set_var(list, "kbind.search", "/");
 	cfg_set_var(list, "kbind.advanced_search", "\\\\");
+	cfg_set_var(list, "kbind.filter", "F");
 	cfg_set_var(list, "kbind.next_match", "n");
 	cfg_set_var(list, "kbind.prev_match", "N");
 	cfg_set_var(list, "kbind.help", "?");
@@ -3276,6 +5216,7 @@ void player_class_set_default_styles( cfg_node_t *list )
 	cfg_set_var(list, "kbind.undo", "U");
 	cfg_set_var(list, "kbind.redo", "D");
 	cfg_set_var(list, "kbind.reload_info", "I");
+	cfg_set_var(list, "kbind.rgain_analyze", "gr");
 	cfg_set_var(list, "kbind.set_play_bounds", "ps");
 	cfg_set_var(list, "kbind.clear_play_bounds", "pc");
 	cfg_set_var(list, "kbind.play_bounds", "p<Return>");
@@ -3352,6 +5293,8 @@ void player_go_back( void )
 /* Return to the last time */
 void player_time_back( void )
 {
+	if (player_cmd_forward(PLAYER_CMD_TIME_BACK, 0, 0, 0, FALSE, FALSE))
+		return;
 	if (player_last_song == player_plist->m_cur_song)
 		player_seek(player_last_song_time, FALSE);
 	else
@@ -3369,21 +5312,36 @@ void player_save_time( void )
 /* High-level start play */
 void player_start_play( int song, song_time_t start_time )
 {
-	player_context->m_status = PLAYER_STATUS_PLAYING;
+	if (player_cmd_forward(PLAYER_CMD_START_PLAY, song, start_time, 0, FALSE, FALSE))
+		return;
+	player_set_status(PLAYER_STATUS_PLAYING);
 	player_play(song, start_time);
 	pmng_hook(player_pmng, "player-status");
 } /* End of 'player_start_play' function */
 
+/* High-level resume play: start current song unless it is paused */
+void player_resume( void )
+{
+	if (player_cmd_forward(PLAYER_CMD_RESUME, 0, 0, 0, FALSE, FALSE))
+		return;
+	if (player_context->m_status != PLAYER_STATUS_PAUSED)
+		player_play(player_plist->m_cur_song, 0);
+	player_set_status(PLAYER_STATUS_PLAYING);
+	pmng_hook(player_pmng, "player-status");
+} /* End of 'player_resume' function */
+
 /* High-level pause/resume */
 void player_pause_resume( void )
 {
+	if (player_cmd_forward(PLAYER_CMD_PAUSE_RESUME, 0, 0, 0, FALSE, FALSE))
+		return;
 	if (player_context->m_status == PLAYER_STATUS_PLAYING)
 	{
-		player_context->m_status = PLAYER_STATUS_PAUSED;
+		player_set_status(PLAYER_STATUS_PAUSED);
 	}
 	else if (player_context->m_status == PLAYER_STATUS_PAUSED)
 	{
-		player_context->m_status = PLAYER_STATUS_PLAYING;
+		player_set_status(PLAYER_STATUS_PLAYING);
 	}
 
 	pmng_hook(player_pmng, "player-status");
@@ -3392,9 +5350,12 @@ void player_pause_resume( void )
 /* High-level stop play */
 void player_stop( void )
 {
-	int was_song = player_plist->m_cur_song;
+	int was_song;
 
-	player_context->m_status = PLAYER_STATUS_STOPPED;
+	if (player_cmd_forward(PLAYER_CMD_STOP, 0, 0, 0, FALSE, FALSE))
+		return;
+	was_song = player_plist->m_cur_song;
+	player_set_status(PLAYER_STATUS_STOPPED);
 	player_end_play(FALSE);
 	player_plist->m_cur_song = was_song;
 	pmng_hook(player_pmng, "player-status");
@@ -3403,8 +5364,10 @@ void player_stop( void )
 /* Queue the selected song */
 void player_queue_song( void )
 {
-	if(num_queued_songs < PLAYER_MAX_ENQUEUED)
-		queued_songs[num_queued_songs++] = player_plist->m_sel_end;
+	int pos = player_plist->m_sel_end;
+
+	if (player_queue != NULL && pos >= 0 && pos < player_plist->m_len)
+		pq_push(player_queue, player_plist->m_list[pos]->m_id);
 } /* End of 'player_queue_song' function */
 
 /* End of 'player.c' file */
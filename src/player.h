@@ -23,12 +23,14 @@
 #ifndef __SG_MPFC_PLAYER_H__
 #define __SG_MPFC_PLAYER_H__
 
+#include <gst/gst.h>
 #include "types.h"
 #include "cfg.h"
 #include "command.h"
 #include "logger.h"
 #include "logger_view.h"
 #include "main_types.h"
+#include "play_queue.h"
 #include "plist.h"
 #include "pmng.h"
 #include "undo.h"
@@ -60,9 +62,6 @@
 #define PLAYER_MSG_INFO			0
 #define PLAYER_MSG_NEXT_FOCUS	1
 
-/* Max number of enqueued songs */
-#define PLAYER_MAX_ENQUEUED 	20
-
 /* Player window type */
 typedef struct
 {
@@ -115,9 +114,8 @@ extern cfg_node_t *cfg_list;
 extern logger_t *player_log;
 extern logger_view_t *player_logview;
 
-/* enqueued songs - max of PLAYER_MAX_ENQUEUED */
-extern int queued_songs[PLAYER_MAX_ENQUEUED];
-extern int num_queued_songs;
+/* Queue of songs to be played next */
+extern pq_t *player_queue;
 
 /***
  * Initialization/deinitialization functions
@@ -226,6 +224,9 @@ song_time_t player_translate_time( song_t *s, song_time_t t, bool_t virtual2real
 /* Player thread function */
 void *player_thread( void *arg );
 
+/* Create a playbin with the configured output and buffering */
+GstElement *player_playbin_new( GstElement *audio_sink );
+
 /***
  * Dialogs launching functions
  ***/
@@ -263,6 +264,9 @@ void player_search_dialog( void );
 /* Launch advanced search dialog */
 void player_advanced_search_dialog( void );
 
+/* Launch play list filter dialog */
+void player_filter_dialog( void );
+
 /* Launch variables manager */
 void player_var_manager( void );
 
@@ -312,6 +316,12 @@ wnd_msg_retcode_t player_on_search( wnd_t *wnd );
 /* Handle 'ok_clicked' for advanced search dialog */
 wnd_msg_retcode_t player_on_adv_search( wnd_t *wnd );
 
+/* Handle 'changed' for filter dialog edit box */
+wnd_msg_retcode_t player_on_filter_changed( wnd_t *wnd );
+
+/* Handle 'cancel_clicked' for filter dialog */
+wnd_msg_retcode_t player_on_filter_cancel( wnd_t *wnd );
+
 /* Handle 'ok_clicked' for info reload dialog */
 wnd_msg_retcode_t player_on_info_reload( wnd_t *wnd );
 
@@ -391,6 +401,12 @@ void player_save_time( void );
 /* High-level start play */
 void player_start_play( int song, song_time_t start_time );
 
+/* Set player status and let player thread apply it */
+void player_set_status( int status );
+
+/* High-level resume play */
+void player_resume( void );
+
 /* High-level pause/resume */
 void player_pause_resume( void );
 
@@ -25,6 +25,7 @@
 #include <glib.h>
 #include <glob.h>
 #include <pthread.h>
+#include <regex.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -41,8 +42,35 @@
 #include "song.h"
 #include "util.h"
 #include "undo.h"
+#include "dirwalk.h"
+#include "search_index.h"
 #include "wnd.h"
 #include "info_rw_thread.h"
+#include "len_tree.h"
+
+static void plist_views_free( plist_t *pl );
+
+/* All the play lists (for passing song length changes to them) */
+static GSList *plist_all = NULL;
+static pthread_mutex_t plist_all_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Create a set of song ids. Ids are never reused, so a song which has
+ * gone is simply not found by its id later */
+static GHashTable *plist_id_set_new( void )
+{
+	return g_hash_table_new_full(g_int64_hash, g_int64_equal, free, NULL);
+} /* End of 'plist_id_set_new' function */
+
+/* Add song id to a set */
+static void plist_id_set_add( GHashTable *set, song_id_t id )
+{
+	song_id_t *key = (song_id_t *)malloc(sizeof(*key));
+
+	if (key == NULL)
+		return;
+	*key = id;
+	g_hash_table_add(set, key);
+} /* End of 'plist_id_set_add' function */
 
 /* Create a new play list */
 plist_t *plist_new( int start_pos )
@@ -62,7 +90,23 @@ plist_t *plist_new( int start_pos )
 	pl->m_visual = FALSE;
 	pl->m_len = 0;
 	pl->m_list = NULL;
+	pl->m_capacity = 0;
+	pl->m_sidx = sidx_new();
+	pl->m_gen = 0;
+	pl->m_views = NULL;
+	pl->m_num_views = pl->m_views_capacity = 0;
+	pl->m_view_scrolled = 0;
+	pl->m_view_gen = 0;
+	pl->m_view_pending = plist_id_set_new();
+	pl->m_lens = ltree_new();
+	pl->m_lens_gen = pl->m_gen;
+	pl->m_len_pending = plist_id_set_new();
+	pl->m_id_index = g_hash_table_new(g_int64_hash, g_int64_equal);
 	pthread_mutex_init(&pl->m_mutex, NULL);
+
+	pthread_mutex_lock(&plist_all_mutex);
+	plist_all = g_slist_prepend(plist_all, pl);
+	pthread_mutex_unlock(&plist_all_mutex);
 	return pl;
 } /* End of 'plist_new' function */
 
@@ -82,6 +126,19 @@ void plist_free( plist_t *pl )
 			plist_unlock(pl);
 		}
 		
+		pthread_mutex_lock(&plist_all_mutex);
+		plist_all = g_slist_remove(plist_all, pl);
+		pthread_mutex_unlock(&plist_all_mutex);
+
+		plist_views_free(pl);
+		sidx_free(pl->m_sidx);
+		ltree_free(pl->m_lens);
+		if (pl->m_len_pending != NULL)
+			g_hash_table_destroy(pl->m_len_pending);
+		if (pl->m_view_pending != NULL)
+			g_hash_table_destroy(pl->m_view_pending);
+		if (pl->m_id_index != NULL)
+			g_hash_table_destroy(pl->m_id_index);
 		pthread_mutex_destroy(&pl->m_mutex);
 		free(pl);
 	}
@@ -109,8 +166,13 @@ bool_t plist_save( plist_t *pl, char *filename )
 	char *ext = util_extension(filename);
 	assert(pl);
 
+	/* M3U saves titles and lengths which come from info, PLS needs
+	 * only file names */
 	if (!strcasecmp(ext, "m3u"))
+	{
+		plist_require_info(pl, 0, pl->m_len - 1);
 		return plist_save_m3u(pl, filename);
+	}
 	else if (!strcasecmp(ext, "pls"))
 		return plist_save_pls(pl, filename);
 	return FALSE;
@@ -177,17 +239,17 @@ int plist_song_cmp( song_t *s1, song_t *s2, int criteria )
 	switch (criteria)
 	{
 	case PLIST_SORT_BY_TITLE:
-		return strcmp(STR_TO_CPTR(s1->m_title), STR_TO_CPTR(s2->m_title));
+		return strcoll(STR_TO_CPTR(s1->m_title), STR_TO_CPTR(s2->m_title));
 	case PLIST_SORT_BY_NAME:
-		return strcmp(util_short_name(song_get_name(s1)),
+		return strcoll(util_short_name(song_get_name(s1)),
 				util_short_name(song_get_name(s2)));
 	case PLIST_SORT_BY_PATH:
-		return strcmp(song_get_name(s1), song_get_name(s2));
+		return strcoll(song_get_name(s1), song_get_name(s2));
 	case PLIST_SORT_BY_TRACK:
 		/* Compare directories first */
 		util_get_dir_name(dir1, song_get_name(s1));
 		util_get_dir_name(dir2, song_get_name(s2));
-		res = strcmp(dir1, dir2);
+		res = strcoll(dir1, dir2);
 		if (res != 0)
 			return res;
 
@@ -200,19 +262,257 @@ int plist_song_cmp( song_t *s1, song_t *s2, int criteria )
 		}
 
 		/* Now compare file names */
-		return strcmp(util_short_name(song_get_name(s1)),
+		return strcoll(util_short_name(song_get_name(s1)),
 				util_short_name(song_get_name(s2)));
 	}
 	return 0;
 } /* End of 'plist_song_cmp' function */
 
+/* Make a collation key for the first 'len' bytes of a string. Keys
+ * compared with strcmp give the same order as strcoll on the strings */
+static char *plist_collate_key( const char *str, size_t len )
+{
+	char *copy = NULL, *key;
+	size_t n;
+
+	if (str[len] != 0)
+	{
+		copy = strndup(str, len);
+		if (copy == NULL)
+			return NULL;
+		str = copy;
+	}
+	n = strxfrm(NULL, str, 0);
+	key = (char *)malloc(n + 1);
+	if (key != NULL)
+		strxfrm(key, str, n + 1);
+	free(copy);
+	return key;
+} /* End of 'plist_collate_key' function */
+
+/* Get directory collation key. Songs of a directory share it, so
+ * the keys are kept in the 'dirs' table */
+static char *plist_dir_key( GHashTable *dirs, const char *name, size_t len )
+{
+	char *dir = strndup(name, len), *key;
+
+	if (dir == NULL)
+		return NULL;
+	key = (char *)g_hash_table_lookup(dirs, dir);
+	if (key != NULL)
+	{
+		free(dir);
+		return key;
+	}
+	key = plist_collate_key(dir, len);
+	if (key == NULL)
+	{
+		free(dir);
+		return NULL;
+	}
+	g_hash_table_insert(dirs, dir, key);
+	return key;
+} /* End of 'plist_dir_key' function */
+
+/* Fill song sort key. Returns FALSE if out of memory */
+static bool_t plist_sort_key_init( plist_sort_key_t *k, song_t *s, int index, 
+		int criteria, GHashTable *dirs )
+{
+	const char *name = song_get_name(s), *short_name = util_short_name(name);
+
+	k->m_song = s;
+	k->m_index = index;
+	k->m_key = k->m_name_key = NULL;
+	k->m_has_track = FALSE;
+	k->m_track = 0;
+
+	switch (criteria)
+	{
+	case PLIST_SORT_BY_TITLE:
+		k->m_key = plist_collate_key(STR_TO_CPTR(s->m_title), 
+				strlen(STR_TO_CPTR(s->m_title)));
+		break;
+	case PLIST_SORT_BY_NAME:
+		k->m_key = plist_collate_key(short_name, strlen(short_name));
+		break;
+	case PLIST_SORT_BY_PATH:
+		k->m_key = plist_collate_key(name, strlen(name));
+		break;
+	case PLIST_SORT_BY_TRACK:
+		/* Directory is the name part before the last slash */
+		k->m_key = plist_dir_key(dirs, name, 
+				(short_name == name) ? 0 : (size_t)(short_name - name - 1));
+		k->m_name_key = plist_collate_key(short_name, strlen(short_name));
+		if (k->m_name_key == NULL)
+			return FALSE;
+		if (s->m_info != NULL)
+		{
+			k->m_has_track = TRUE;
+			k->m_track = atoi(s->m_info->m_track);
+		}
+		break;
+	default:
+		k->m_key = strdup("");
+		break;
+	}
+	return (k->m_key != NULL);
+} /* End of 'plist_sort_key_init' function */
+
+/* Compare songs sort keys (the same order as 'plist_song_cmp' gives) */
+static int plist_sort_key_cmp( const plist_sort_key_t *k1, 
+		const plist_sort_key_t *k2 )
+{
+	int res = strcmp(k1->m_key, k2->m_key);
+	if (res != 0 || k1->m_name_key == NULL)
+		return res;
+	if (k1->m_has_track && k2->m_has_track && k1->m_track != k2->m_track)
+		return (k1->m_track < k2->m_track) ? -1 : 1;
+	return strcmp(k1->m_name_key, k2->m_name_key);
+} /* End of 'plist_sort_key_cmp' function */
+
+/* Stable merge sort of keys array. 'tmp' must have the same size */
+static void plist_merge_sort( plist_sort_key_t **keys, plist_sort_key_t **tmp,
+		int num )
+{
+	int half = num / 2, i, j, k;
+
+	/* Short runs are sorted by insertion */
+	if (num <= PLIST_SORT_RUN)
+	{
+		for ( i = 1; i < num; i ++ )
+		{
+			plist_sort_key_t *key = keys[i];
+			for ( j = i; j > 0 && plist_sort_key_cmp(key, keys[j - 1]) < 0; j -- )
+				keys[j] = keys[j - 1];
+			keys[j] = key;
+		}
+		return;
+	}
+
+	plist_merge_sort(keys, tmp, half);
+	plist_merge_sort(keys + half, tmp, num - half);
+
+	/* Halves are already in order */
+	if (plist_sort_key_cmp(keys[half], keys[half - 1]) >= 0)
+		return;
+
+	/* Merge taking equal items from the left half first */
+	memcpy(tmp, keys, half * sizeof(*keys));
+	for ( i = 0, j = half, k = 0; i < half; k ++ )
+	{
+		if (j < num && plist_sort_key_cmp(keys[j], tmp[i]) < 0)
+			keys[k] = keys[j ++];
+		else
+			keys[k] = tmp[i ++];
+	}
+} /* End of 'plist_merge_sort' function */
+
+/* Sort songs array (stable). If 'order' is not NULL, it receives
+ * the original index of every song of the sorted array */
+bool_t plist_sort_songs( song_t **songs, int num, int criteria, int *order )
+{
+	plist_sort_key_t *keys, **ptrs, **tmp;
+	GHashTable *dirs = NULL;
+	bool_t ok = FALSE;
+	int i, num_keys = 0;
+
+	if (num <= 0)
+		return TRUE;
+	if (criteria == PLIST_SORT_BY_TRACK)
+		dirs = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+	keys = (plist_sort_key_t *)malloc(sizeof(*keys) * num);
+	ptrs = (plist_sort_key_t **)malloc(sizeof(*ptrs) * num);
+	tmp = (plist_sort_key_t **)malloc(sizeof(*tmp) * num);
+	if (keys == NULL || ptrs == NULL || tmp == NULL)
+		goto finally;
+
+	/* Compute keys once instead of on every comparison */
+	for ( ; num_keys < num; num_keys ++ )
+	{
+		if (!plist_sort_key_init(&keys[num_keys], songs[num_keys], num_keys, 
+					criteria, dirs))
+		{
+			if (dirs == NULL)
+				free(keys[num_keys].m_key);
+			free(keys[num_keys].m_name_key);
+			goto finally;
+		}
+		ptrs[num_keys] = &keys[num_keys];
+	}
+
+	plist_merge_sort(ptrs, tmp, num);
+	for ( i = 0; i < num; i ++ )
+	{
+		songs[i] = ptrs[i]->m_song;
+		if (order != NULL)
+			order[i] = ptrs[i]->m_index;
+	}
+	ok = TRUE;
+
+finally:
+	for ( i = 0; i < num_keys; i ++ )
+	{
+		if (dirs == NULL)
+			free(keys[i].m_key);
+		free(keys[i].m_name_key);
+	}
+	if (dirs != NULL)
+		g_hash_table_destroy(dirs);
+	free(keys);
+	free(ptrs);
+	free(tmp);
+	return ok;
+} /* End of 'plist_sort_songs' function */
+
+/* Store positions of songs within the bounds in the id index (play
+ * list must be locked). Called for the songs that have moved */
+void plist_update_ids( plist_t *pl, int start, int end )
+{
+	int i;
+
+	if (pl->m_id_index == NULL)
+		return;
+	for ( i = start; i <= end && i < pl->m_len; i ++ )
+		g_hash_table_insert(pl->m_id_index, &pl->m_list[i]->m_id,
+				GINT_TO_POINTER(i + 1));
+} /* End of 'plist_update_ids' function */
+
+/* Find position of song with given id (play list must be locked).
+ * Returns -1 if there is no such song */
+int plist_id_pos( plist_t *pl, song_id_t id )
+{
+	int i;
+
+	/* Scan the list if there is no index */
+	if (pl->m_id_index == NULL)
+	{
+		for ( i = 0; i < pl->m_len; i ++ )
+			if (pl->m_list[i]->m_id == id)
+				return i;
+		return -1;
+	}
+	return GPOINTER_TO_INT(g_hash_table_lookup(pl->m_id_index, &id)) - 1;
+} /* End of 'plist_id_pos' function */
+
+/* Find position of song with given id. Returns -1 if there is no
+ * such song */
+int plist_find_id( plist_t *pl, song_id_t id )
+{
+	int pos;
+
+	assert(pl);
+
+	plist_lock(pl);
+	pos = plist_id_pos(pl, id);
+	plist_unlock(pl);
+	return pos;
+} /* End of 'plist_find_id' function */
+
 /* Sort play list with specified bounds */
 void plist_sort_bounds( plist_t *pl, int start, int end, int criteria )
 {
-	int i, j, was_song;
-	song_t *cur_song;
-	song_t **was_list = NULL;
-	bool_t finished = FALSE;
+	int i, was_song, *order;
+	song_id_t cur_id;
 
 	assert(pl);
 	if (start > end)
@@ -223,91 +523,63 @@ void plist_sort_bounds( plist_t *pl, int start, int end, int criteria )
 		end = pl->m_len - 1;
 
 	/* Wait until info isn't got */
-	while ((criteria == PLIST_SORT_BY_TITLE || 
-				criteria == PLIST_SORT_BY_TRACK) && !finished)
-	{
-		finished = TRUE;
-		for ( i = 0; i < pl->m_len; i ++ )
-		{
-			if (pl->m_list[i]->m_flags & SONG_INFO_READ)
-			{
-				finished = FALSE;
-				break;
-			}
-		}
-		util_wait();
-	}
+	if (criteria == PLIST_SORT_BY_TITLE || criteria == PLIST_SORT_BY_TRACK)
+		plist_require_info(pl, start, end);
 
 	/* Lock play list */
 	plist_lock(pl);
-
-	/* Save play list */
-	was_list = (song_t **)malloc(sizeof(song_t *) * pl->m_len);
-	memcpy(was_list, pl->m_list, sizeof(song_t *) * pl->m_len);
-	
-	/* Save current song */
-	was_song = pl->m_cur_song;
-	cur_song = (pl->m_cur_song < 0) ? NULL : pl->m_list[was_song];
+	if (end >= pl->m_len)
+		end = pl->m_len - 1;
+	if (start > end)
+	{
+		plist_unlock(pl);
+		return;
+	}
 
 	/* Sort */
-	for ( i = start; i < end; i ++ )
+	was_song = pl->m_cur_song;
+	cur_id = (was_song >= 0) ? pl->m_list[was_song]->m_id : 0;
+	order = (int *)malloc(sizeof(int) * (end - start + 1));
+	if (order == NULL || 
+			!plist_sort_songs(&pl->m_list[start], end - start + 1, criteria, order))
 	{
-		int k = i + 1, j;
-		song_t *s = pl->m_list[k];
-
-		for ( j = i; j >= start; j -- )
-		{
-			/* Compare songs and save current preferred position */
-			if (plist_song_cmp(s, pl->m_list[j], criteria) < 0)
-				k = j;
-			else
-				break;
-		}
-
-		/* Paste string to its place */
-		if (k <= i)
-		{
-			memmove(&pl->m_list[k + 1], &pl->m_list[k],
-					(i - k + 1) * sizeof(*pl->m_list));
-			pl->m_list[k] = s;
-		}
+		free(order);
+		plist_unlock(pl);
+		return;
 	}
+	pl->m_gen ++;
+	plist_update_ids(pl, start, end);
 
 	/* Find current song */
-	if (cur_song != NULL)
-	{
-		int i;
+	if (was_song >= start && was_song <= end)
+		pl->m_cur_song = plist_id_pos(pl, cur_id);
 
-		for ( i = start; i <= end; i ++ )
-			if (pl->m_list[i] == cur_song)
-			{
-				pl->m_cur_song = i;
-				break;
-			}
-	}
-
-	/* Store undo information */
+	/* Store undo information: transform maps old positions to new ones */
 	if (player_store_undo)
 	{
 		struct tag_undo_list_item_t *undo;
+		int *transform = (int *)malloc(sizeof(int) * pl->m_len);
 		undo = (struct tag_undo_list_item_t *)malloc(sizeof(*undo));
-		undo->m_type = UNDO_SORT;
-		undo->m_next = undo->m_prev = NULL;
-		undo->m_data.m_sort.m_was_song = was_song;
-		undo->m_data.m_sort.m_transform = (int *)malloc(
-				sizeof(int) * pl->m_len);
-		for ( i = 0; i < pl->m_len; i ++ )
+		if (undo != NULL && transform != NULL)
 		{
-			for ( j = 0; j < pl->m_len; j ++ )
-				if (was_list[i] == pl->m_list[j])
-				{
-					undo->m_data.m_sort.m_transform[i] = j;
-					break;
-				}
+			undo->m_type = UNDO_SORT;
+			undo->m_next = undo->m_prev = NULL;
+			undo->m_data.m_sort.m_was_song = was_song;
+			undo->m_data.m_sort.m_transform = transform;
+			undo->m_data.m_sort.m_len = pl->m_len;
+			for ( i = 0; i < pl->m_len; i ++ )
+				transform[i] = i;
+			for ( i = 0; i <= end - start; i ++ )
+				transform[start + order[i]] = start + i;
+			undo_add(player_ul, undo);
+		}
+		else
+		{
+			free(undo);
+			free(transform);
 		}
-		undo_add(player_ul, undo);
 	}
-	free(was_list);
+	free(order);
 
 	/* Unlock play list */
 	plist_unlock(pl);
@@ -356,40 +628,27 @@ void plist_rem( plist_t *pl )
 	{
 		struct tag_undo_list_item_t *undo;
 		struct tag_undo_list_rem_t *data;
-		int j;
-		song_metadata_t metadata_empty = SONG_METADATA_EMPTY;
 		
+		/* Songs are kept alive by references, so restoring them needs
+		 * neither a format check nor reading info again */
 		undo = (struct tag_undo_list_item_t *)malloc(sizeof(*undo));
-		undo->m_type = UNDO_REM;
-		undo->m_next = undo->m_prev = NULL;
-		data = &undo->m_data.m_rem;
-		data->m_num_files = end - start + 1;
-		data->m_start_pos = start;
-		data->m_files = (struct song_name *)malloc(sizeof(struct song_name) * data->m_num_files);
-		for ( i = start, j = 0; i <= end; i ++, j ++ )
+		if (undo != NULL)
 		{
-			song_t *s = pl->m_list[i];
-			struct song_name *sn = &data->m_files[j];
-			if (s->m_filename)
+			undo->m_type = UNDO_REM;
+			undo->m_next = undo->m_prev = NULL;
+			data = &undo->m_data.m_rem;
+			data->m_num_songs = end - start + 1;
+			data->m_start_pos = start;
+			data->m_songs = (song_t **)malloc(sizeof(song_t *) * data->m_num_songs);
+			if (data->m_songs != NULL)
 			{
-				sn->m_filename = strdup(s->m_filename);
-				sn->m_fullname = NULL;
+				for ( i = start; i <= end; i ++ )
+					data->m_songs[i - start] = song_add_ref(pl->m_list[i]);
+				undo_add(player_ul, undo);
 			}
 			else
-			{
-				sn->m_fullname = strdup(s->m_fullname);
-				sn->m_filename = NULL;
-			}
-
-			song_metadata_t *metadata = &sn->m_metadata;
-			(*metadata) = metadata_empty;
-			metadata->m_start_time = s->m_start_time;
-			metadata->m_end_time = s->m_end_time;
-			metadata->m_len = s->m_len;
-			if (s->m_default_title)
-				metadata->m_title = strdup(s->m_default_title);
+				free(undo);
 		}
-		undo_add(player_ul, undo);
 	}
 
 	/* Stop currently playing song if it is inside area being removed */
@@ -402,20 +661,40 @@ void plist_rem( plist_t *pl )
 	plist_lock(pl);
 
 	/* Free memory */
+	if (pl->m_sidx != NULL)
+		sidx_remove(pl->m_sidx, &pl->m_list[start], end - start + 1);
+	if (pl == player_plist && player_queue != NULL)
+		pq_remove(player_queue, &pl->m_list[start], end - start + 1);
 	for ( i = start; i <= end; i ++ )
+	{
+		/* Index keys point into the songs */
+		if (pl->m_id_index != NULL)
+			g_hash_table_remove(pl->m_id_index, &pl->m_list[i]->m_id);
 		song_free(pl->m_list[i]);
+	}
 
-	/* Shift songs list and reallocate memory */
+	/* Shift songs list and release memory if much of it is unused */
 	memmove(&pl->m_list[start], &pl->m_list[end + 1],
 			(pl->m_len - end - 1) * sizeof(*pl->m_list));
 	pl->m_len -= (end - start + 1);
-	if (pl->m_len)
-		pl->m_list = (song_t **)realloc(pl->m_list, 
-				pl->m_len * sizeof(*pl->m_list));
-	else
+	pl->m_gen ++;
+	plist_update_ids(pl, start, pl->m_len - 1);
+	if (!pl->m_len)
 	{
 		free(pl->m_list);
 		pl->m_list = NULL;
+		pl->m_capacity = 0;
+	}
+	else if (pl->m_len < pl->m_capacity / 4 && pl->m_capacity > PLIST_MIN_CAPACITY)
+	{
+		int capacity = MAX(pl->m_capacity / 2, PLIST_MIN_CAPACITY);
+		song_t **list = (song_t **)realloc(pl->m_list, 
+				capacity * sizeof(*pl->m_list));
+		if (list != NULL)
+		{
+			pl->m_list = list;
+			pl->m_capacity = capacity;
+		}
 	}
 
 	/* Fix cursor */
@@ -430,22 +709,121 @@ void plist_rem( plist_t *pl )
 	pmng_hook(player_pmng, "playlist");
 } /* End of 'plist_rem' function */
 
+/* Get song text searched with given criteria */
+static char *plist_search_text( song_t *s, int criteria )
+{
+	if (criteria == PLIST_SEARCH_TITLE)
+		return STR_TO_CPTR(s->m_title);
+	if (s->m_info == NULL)
+		return NULL;
+
+	switch (criteria)
+	{
+	case PLIST_SEARCH_NAME:
+		return s->m_info->m_name;
+	case PLIST_SEARCH_ARTIST:
+		return s->m_info->m_artist;
+	case PLIST_SEARCH_ALBUM:
+		return s->m_info->m_album;
+	case PLIST_SEARCH_YEAR:
+		return s->m_info->m_year;
+	case PLIST_SEARCH_GENRE:
+		return s->m_info->m_genre;
+	case PLIST_SEARCH_COMMENT:
+		return s->m_info->m_comments;
+	case PLIST_SEARCH_OWN:
+		return s->m_info->m_own_data;
+	case PLIST_SEARCH_TRACK:
+		return s->m_info->m_track;
+	}
+	return NULL;
+} /* End of 'plist_search_text' function */
+
+/* Check if song matches compiled pattern. Songs whose info is not
+ * read yet are matched only by title */
+static bool_t plist_search_match( song_t *s, int criteria, regex_t *preg )
+{
+	char *str;
+
+	if (criteria != PLIST_SEARCH_TITLE &&
+			(s->m_flags & (SONG_SCHEDULE | SONG_INFO_READ)))
+		return FALSE;
+	str = plist_search_text(s, criteria);
+	return (str != NULL && !regexec(preg, str, 0, NULL, 0));
+} /* End of 'plist_search_match' function */
+
 /* Search for string */
 bool_t plist_search( plist_t *pl, char *pstr, int dir, int criteria )
 {
 	int i, count = 0;
-	bool_t found = FALSE;
+	bool_t found = FALSE, nocase;
+	song_t **cands = NULL;
+	int num_cands = 0;
+	regex_t preg;
 
 	assert(pl);
-	if (!pl->m_len)
+	if (!pl->m_len || pstr == NULL)
+		return FALSE;
+
+	/* Search what is loaded, but have the rest read for the next time */
+	if (criteria != PLIST_SEARCH_TITLE)
+		plist_start_info(pl, 0, pl->m_len - 1);
+
+	/* Compile pattern once for all the songs */
+	nocase = cfg_get_var_bool(cfg_list, "search-nocase");
+	if (regcomp(&preg, pstr, REG_NOSUB | (nocase ? REG_ICASE : 0)))
 		return FALSE;
 
+	/* Index covers titles, names, artists and albums */
+	if (pl->m_sidx != NULL && (criteria == PLIST_SEARCH_TITLE ||
+				criteria == PLIST_SEARCH_NAME || criteria == PLIST_SEARCH_ARTIST ||
+				criteria == PLIST_SEARCH_ALBUM))
+		cands = sidx_query(pl->m_sidx, pstr, nocase, &num_cands);
+
+	/* Check the candidates in the search order */
+	if (cands != NULL)
+	{
+		int *pos = (int *)malloc(sizeof(int) * (num_cands + 1));
+		int best = -1, best_dist = 0;
+
+		if (pos != NULL)
+		{
+			plist_lock(pl);
+			for ( i = 0; i < num_cands; i ++ )
+				pos[i] = plist_id_pos(pl, cands[i]->m_id);
+			plist_unlock(pl);
+			for ( i = 0; i < num_cands; i ++ )
+			{
+				int dist;
+
+				if (pos[i] < 0)
+					continue;
+				dist = ((pos[i] - pl->m_sel_end) * dir + pl->m_len) % pl->m_len;
+				if (dist == 0)
+					dist = pl->m_len;
+				if ((best < 0 || dist < best_dist) &&
+						plist_search_match(cands[i], criteria, &preg))
+				{
+					best = pos[i];
+					best_dist = dist;
+				}
+			}
+			if (best >= 0)
+			{
+				found = TRUE;
+				plist_move(pl, best, FALSE);
+			}
+			free(pos);
+			free(cands);
+			regfree(&preg);
+			return found;
+		}
+		free(cands);
+	}
+
 	/* Search */
 	for ( i = pl->m_sel_end, count = 0; count < pl->m_len && !found; count ++ )
 	{
-		char *str;
-		song_t *s;
-		
 		/* Go to next song */
 		i += dir;
 		if (i < 0 && dir < 0)
@@ -454,54 +832,441 @@ bool_t plist_search( plist_t *pl, char *pstr, int dir, int criteria )
 			i = 0;
 
 		/* Search for specified string */
-		s = pl->m_list[i];
-		if (criteria != PLIST_SEARCH_TITLE && s->m_info == NULL)
-			continue;
-		switch (criteria)
-		{
-		case PLIST_SEARCH_TITLE:
-			str = STR_TO_CPTR(s->m_title);
-			break;
-		case PLIST_SEARCH_NAME:
-			str = s->m_info->m_name;
-			break;
-		case PLIST_SEARCH_ARTIST:
-			str = s->m_info->m_artist;
-			break;
-		case PLIST_SEARCH_ALBUM:
-			str = s->m_info->m_album;
-			break;
-		case PLIST_SEARCH_YEAR:
-			str = s->m_info->m_year;
-			break;
-		case PLIST_SEARCH_GENRE:
-			str = s->m_info->m_genre;
-			break;
-		case PLIST_SEARCH_COMMENT:
-			str = s->m_info->m_comments;
-			break;
-		case PLIST_SEARCH_OWN:
-			str = s->m_info->m_own_data;
-			break;
-		case PLIST_SEARCH_TRACK:
-			str = s->m_info->m_track;
-			break;
-		}
-		found = util_search_regexp(pstr, str, 
-				cfg_get_var_int(cfg_list, "search-nocase"));
+		found = plist_search_match(pl->m_list[i], criteria, &preg);
 		if (found)
 			plist_move(pl, i, FALSE);
 	} 
 
+	regfree(&preg);
 	return found;
 } /* End of 'plist_search' function */
 
+/* Check that song title contains filter string (ignoring case) */
+static bool_t plist_filter_match( song_t *s, const char *filter )
+{
+	const char *title = STR_TO_CPTR(s->m_title);
+	return (title != NULL && strcasestr(title, filter) != NULL);
+} /* End of 'plist_filter_match' function */
+
+/* Compare list positions */
+static int plist_pos_cmp( const void *p1, const void *p2 )
+{
+	int a = *(const int *)p1, b = *(const int *)p2;
+	return (a > b) - (a < b);
+} /* End of 'plist_pos_cmp' function */
+
+/* Get positions of songs matching filter from the search index.
+ * Returns FALSE if index can't narrow the search */
+static bool_t plist_view_from_index( plist_t *pl, const char *filter,
+		int *pos, int *num )
+{
+	char *pattern, *p;
+	song_t **cands;
+	int num_cands, i;
+
+	if (pl->m_sidx == NULL || strlen(filter) < 3)
+		return FALSE;
+
+	/* Filter is a plain string, so escape it for the index */
+	pattern = (char *)malloc(2 * strlen(filter) + 1);
+	if (pattern == NULL)
+		return FALSE;
+	for ( p = pattern; *filter; filter ++ )
+	{
+		if (strchr(".[]*^$\\", *filter) != NULL)
+			*(p ++) = '\\';
+		*(p ++) = *filter;
+	}
+	*p = 0;
+	cands = sidx_query(pl->m_sidx, pattern, TRUE, &num_cands);
+	free(pattern);
+	if (cands == NULL)
+		return FALSE;
+
+	/* There are no more candidates than songs, so 'pos' is large enough */
+	(*num) = 0;
+	for ( i = 0; i < num_cands; i ++ )
+	{
+		int p = plist_id_pos(pl, cands[i]->m_id);
+		if (p >= 0)
+			pos[(*num) ++] = p;
+	}
+	qsort(pos, *num, sizeof(int), plist_pos_cmp);
+	free(cands);
+	return TRUE;
+} /* End of 'plist_view_from_index' function */
+
+/* Fill view with positions of songs matching its filter. If base view
+ * is given, only its songs are checked (play list must be locked) */
+static bool_t plist_view_compute( plist_t *pl, plist_view_t *v,
+		plist_view_t *base )
+{
+	int *pos, num = 0, i;
+	song_id_t *ids;
+
+	pos = (int *)malloc(sizeof(int) *
+			((base == NULL ? pl->m_len : base->m_len) + 1));
+	if (pos == NULL)
+		return FALSE;
+
+	/* Narrow the previous view */
+	if (base != NULL)
+	{
+		for ( i = 0; i < base->m_len; i ++ )
+			if (plist_filter_match(pl->m_list[base->m_pos[i]], v->m_filter))
+				pos[num ++] = base->m_pos[i];
+	}
+	/* Check index candidates only */
+	else if (plist_view_from_index(pl, v->m_filter, pos, &num))
+	{
+		int j;
+		for ( i = j = 0; i < num; i ++ )
+			if (plist_filter_match(pl->m_list[pos[i]], v->m_filter))
+				pos[j ++] = pos[i];
+		num = j;
+	}
+	/* Check all the songs */
+	else
+	{
+		for ( i = 0; i < pl->m_len; i ++ )
+			if (plist_filter_match(pl->m_list[i], v->m_filter))
+				pos[num ++] = i;
+	}
+
+	ids = (song_id_t *)malloc(sizeof(song_id_t) * (num + 1));
+	if (ids == NULL)
+	{
+		free(pos);
+		return FALSE;
+	}
+	for ( i = 0; i < num; i ++ )
+		ids[i] = pl->m_list[pos[i]]->m_id;
+
+	free(v->m_pos);
+	free(v->m_ids);
+	v->m_pos = pos;
+	v->m_ids = ids;
+	v->m_len = num;
+	return TRUE;
+} /* End of 'plist_view_compute' function */
+
+/* Free views stack */
+static void plist_views_free( plist_t *pl )
+{
+	int i;
+
+	for ( i = 0; i < pl->m_num_views; i ++ )
+	{
+		free(pl->m_views[i].m_filter);
+		free(pl->m_views[i].m_pos);
+		free(pl->m_views[i].m_ids);
+	}
+	free(pl->m_views);
+	pl->m_views = NULL;
+	pl->m_num_views = pl->m_views_capacity = 0;
+	pl->m_view_scrolled = 0;
+} /* End of 'plist_views_free' function */
+
+/* Find the view songs after the list has changed (play list must be 
+ * locked). Removed songs are dropped, and the order is restored if 
+ * songs have been moved */
+static void plist_view_remap( plist_t *pl, plist_view_t *v )
+{
+	bool_t sorted = TRUE;
+	int i, num = 0;
+
+	for ( i = 0; i < v->m_len; i ++ )
+	{
+		int pos = plist_id_pos(pl, v->m_ids[i]);
+		if (pos < 0)
+			continue;
+		if (num > 0 && pos < v->m_pos[num - 1])
+			sorted = FALSE;
+		v->m_pos[num] = pos;
+		v->m_ids[num ++] = v->m_ids[i];
+	}
+	v->m_len = num;
+	if (!sorted)
+	{
+		qsort(v->m_pos, num, sizeof(int), plist_pos_cmp);
+		for ( i = 0; i < num; i ++ )
+			v->m_ids[i] = pl->m_list[v->m_pos[i]]->m_id;
+	}
+} /* End of 'plist_view_remap' function */
+
+/* Test changed songs against the view filter and put them to their 
+ * places or take them off the view (play list must be locked). Filter
+ * of a narrower view contains the wider one's, so a song matching it
+ * is in the wider view too */
+static bool_t plist_view_update( plist_t *pl, plist_view_t *v,
+		GHashTable *changed )
+{
+	GHashTableIter iter;
+	gpointer id;
+	int *add, *pos, num_add = 0, num = 0, i, j;
+	song_id_t *ids;
+
+	/* Changed songs which match now */
+	add = (int *)malloc(sizeof(int) * (g_hash_table_size(changed) + 1));
+	if (add == NULL)
+		return FALSE;
+	g_hash_table_iter_init(&iter, changed);
+	while (g_hash_table_iter_next(&iter, &id, NULL))
+	{
+		int p = plist_id_pos(pl, *(song_id_t *)id);
+		if (p >= 0 && plist_filter_match(pl->m_list[p], v->m_filter))
+			add[num_add ++] = p;
+	}
+	qsort(add, num_add, sizeof(int), plist_pos_cmp);
+
+	/* Merge them with the songs that have not changed */
+	pos = (int *)malloc(sizeof(int) * (v->m_len + num_add + 1));
+	ids = (song_id_t *)malloc(sizeof(song_id_t) * (v->m_len + num_add + 1));
+	if (pos == NULL || ids == NULL)
+	{
+		free(add);
+		free(pos);
+		free(ids);
+		return FALSE;
+	}
+	for ( i = j = 0; i < v->m_len || j < num_add; )
+	{
+		if (j >= num_add || (i < v->m_len && v->m_pos[i] < add[j]))
+		{
+			if (!g_hash_table_contains(changed, &v->m_ids[i]))
+				pos[num ++] = v->m_pos[i];
+			i ++;
+		}
+		else
+		{
+			if (i < v->m_len && v->m_pos[i] == add[j])
+				i ++;
+			pos[num ++] = add[j ++];
+		}
+	}
+	for ( i = 0; i < num; i ++ )
+		ids[i] = pl->m_list[pos[i]]->m_id;
+	free(add);
+
+	free(v->m_pos);
+	free(v->m_ids);
+	v->m_pos = pos;
+	v->m_ids = ids;
+	v->m_len = num;
+	return TRUE;
+} /* End of 'plist_view_update' function */
+
+/* Make the views up to date if songs have been added, removed, moved 
+ * or retitled since they were built (play list must be locked). Only
+ * the changed songs are tested, and the whole stack is kept */
+static void plist_view_sync( plist_t *pl )
+{
+	GHashTable *changed = NULL;
+	int i;
+
+	if (pl->m_view_pending == NULL)
+		return;
+
+	/* Take the changed songs. Titles are read after that, so a change
+	 * made meanwhile is at worst applied twice */
+	pthread_mutex_lock(&plist_all_mutex);
+	if (g_hash_table_size(pl->m_view_pending) > 0)
+	{
+		changed = pl->m_view_pending;
+		pl->m_view_pending = plist_id_set_new();
+	}
+	pthread_mutex_unlock(&plist_all_mutex);
+
+	if (PLIST_FILTERED(pl) && (changed != NULL || pl->m_view_gen != pl->m_gen))
+	{
+		for ( i = 0; i < pl->m_num_views; i ++ )
+		{
+			plist_view_t *v = &pl->m_views[i];
+
+			if (pl->m_view_gen != pl->m_gen)
+				plist_view_remap(pl, v);
+			if (changed != NULL && !plist_view_update(pl, v, changed))
+			{
+				plist_views_free(pl);
+				break;
+			}
+		}
+	}
+	pl->m_view_gen = pl->m_gen;
+	if (changed != NULL)
+		g_hash_table_destroy(changed);
+} /* End of 'plist_view_sync' function */
+
+/* Find view index of the first song at or after a list position */
+static int plist_view_lower_bound( plist_view_t *v, int pos )
+{
+	int lo = 0, hi = v->m_len;
+
+	while (lo < hi)
+	{
+		int mid = lo + (hi - lo) / 2;
+		if (v->m_pos[mid] < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+} /* End of 'plist_view_lower_bound' function */
+
+/* Put cursor to a view index (play list must be locked) */
+static void plist_view_move_to( plist_t *pl, int index, bool_t center )
+{
+	plist_view_t *v = PLIST_VIEW(pl);
+	int height = PLIST_HEIGHT;
+
+	if (index >= v->m_len)
+		index = v->m_len - 1;
+	if (index < 0)
+		index = 0;
+	if (v->m_len > 0)
+		pl->m_sel_start = pl->m_sel_end = v->m_pos[index];
+
+	/* Scroll if need */
+	if (center)
+		pl->m_view_scrolled = index - (height + 1) / 2;
+	else if (index < pl->m_view_scrolled)
+		pl->m_view_scrolled = index;
+	else if (index >= pl->m_view_scrolled + height)
+		pl->m_view_scrolled = index - height + 1;
+	if (pl->m_view_scrolled > v->m_len - height)
+		pl->m_view_scrolled = v->m_len - height;
+	if (pl->m_view_scrolled < 0)
+		pl->m_view_scrolled = 0;
+} /* End of 'plist_view_move_to' function */
+
+/* Set filter for the displayed songs. Empty filter shows all of them */
+void plist_set_filter( plist_t *pl, const char *filter )
+{
+	plist_view_t *v;
+
+	assert(pl);
+
+	plist_lock(pl);
+	if (filter == NULL || !(*filter))
+	{
+		plist_views_free(pl);
+		plist_unlock(pl);
+		return;
+	}
+	plist_view_sync(pl);
+
+	/* Return to the view which filter is a part of the new one; its
+	 * songs are the only ones which may match */
+	while (PLIST_FILTERED(pl) && 
+			strcasestr(filter, PLIST_VIEW(pl)->m_filter) == NULL)
+	{
+		pl->m_num_views --;
+		free(pl->m_views[pl->m_num_views].m_filter);
+		free(pl->m_views[pl->m_num_views].m_pos);
+		free(pl->m_views[pl->m_num_views].m_ids);
+	}
+
+	/* Narrow it */
+	if (!PLIST_FILTERED(pl) || strcasecmp(filter, PLIST_VIEW(pl)->m_filter))
+	{
+		if (pl->m_num_views >= pl->m_views_capacity)
+		{
+			int capacity = (pl->m_views_capacity == 0) ? 4 : 
+				2 * pl->m_views_capacity;
+			plist_view_t *views = (plist_view_t *)realloc(pl->m_views,
+					sizeof(*views) * capacity);
+			if (views == NULL)
+			{
+				plist_unlock(pl);
+				return;
+			}
+			pl->m_views = views;
+			pl->m_views_capacity = capacity;
+		}
+		v = &pl->m_views[pl->m_num_views];
+		v->m_filter = strdup(filter);
+		v->m_pos = NULL;
+		v->m_ids = NULL;
+		v->m_len = 0;
+		if (v->m_filter == NULL || !plist_view_compute(pl, v, 
+					PLIST_FILTERED(pl) ? PLIST_VIEW(pl) : NULL))
+		{
+			free(v->m_filter);
+			plist_unlock(pl);
+			return;
+		}
+		pl->m_num_views ++;
+	}
+
+	/* Move cursor to a matching song */
+	pl->m_visual = FALSE;
+	plist_view_move_to(pl, plist_view_lower_bound(PLIST_VIEW(pl), 
+				pl->m_sel_end), FALSE);
+	plist_unlock(pl);
+} /* End of 'plist_set_filter' function */
+
+/* Get list position of song displayed in a play list row */
+int plist_row_pos( plist_t *pl, int row )
+{
+	int pos;
+
+	assert(pl);
+
+	if (!PLIST_FILTERED(pl))
+		return pl->m_scrolled + row;
+
+	plist_lock(pl);
+	plist_view_sync(pl);
+	if (!PLIST_FILTERED(pl))
+		pos = pl->m_scrolled + row;
+	else if (PLIST_VIEW(pl)->m_len == 0)
+		pos = pl->m_sel_end;
+	else
+	{
+		plist_view_t *v = PLIST_VIEW(pl);
+		row += pl->m_view_scrolled;
+		pos = v->m_pos[(row < v->m_len) ? row : v->m_len - 1];
+	}
+	plist_unlock(pl);
+	return pos;
+} /* End of 'plist_row_pos' function */
+
 /* Move cursor in play list */
 void plist_move( plist_t *pl, int y, bool_t relative )
 {
 	int old_end;
 	assert(pl);
 
+	/* Move through the filtered songs */
+	if (PLIST_FILTERED(pl))
+	{
+		plist_view_t *v;
+		int index;
+
+		plist_lock(pl);
+		plist_view_sync(pl);
+		v = PLIST_VIEW(pl);
+		if (v == NULL)
+		{
+			plist_unlock(pl);
+			plist_move(pl, y, relative);
+			return;
+		}
+		if (!relative)
+			index = plist_view_lower_bound(v, y);
+		else
+		{
+			/* Cursor may be at a song that no more matches */
+			index = plist_view_lower_bound(v, pl->m_sel_end);
+			if (y > 0 && (index >= v->m_len || v->m_pos[index] != pl->m_sel_end))
+				index --;
+			index += y;
+		}
+		plist_view_move_to(pl, index, FALSE);
+		plist_unlock(pl);
+		return;
+	}
+
 	/* If we have empty list - set position to 0 */
 	if (!pl->m_len)
 	{
@@ -544,7 +1309,16 @@ void plist_centrize( plist_t *pl, int index )
 
 	if (index < 0)
 		index = pl->m_cur_song;
-	if (index >= 0)
+	if (index >= 0 && PLIST_FILTERED(pl))
+	{
+		plist_lock(pl);
+		plist_view_sync(pl);
+		if (PLIST_FILTERED(pl))
+			plist_view_move_to(pl, 
+					plist_view_lower_bound(PLIST_VIEW(pl), index), TRUE);
+		plist_unlock(pl);
+	}
+	else if (index >= 0)
 	{
 		pl->m_sel_end = index;
 		if (!pl->m_visual)
@@ -558,21 +1332,149 @@ void plist_centrize( plist_t *pl, int index )
 	}
 } /* End of 'plist_centrize' function */
 
+/* Read info for the current song and the songs on the screen before
+ * the other ones (play list must be locked) */
+static void plist_prioritize_visible( plist_t *pl )
+{
+	int height = PLIST_HEIGHT, num = 0;
+	song_t *songs[height > 0 ? height + 1 : 1];
+
+	if (pl->m_cur_song >= 0 && pl->m_cur_song < pl->m_len)
+		songs[num ++] = pl->m_list[pl->m_cur_song];
+	if (PLIST_FILTERED(pl))
+	{
+		plist_view_t *v = PLIST_VIEW(pl);
+		for ( int i = pl->m_view_scrolled; 
+				i < pl->m_view_scrolled + height && i < v->m_len; i ++ )
+		{
+			if (v->m_pos[i] != pl->m_cur_song)
+				songs[num ++] = pl->m_list[v->m_pos[i]];
+		}
+	}
+	else
+	{
+		for ( int i = pl->m_scrolled; i < pl->m_scrolled + height && i < pl->m_len; i ++ )
+		{
+			if (i >= 0 && i != pl->m_cur_song)
+				songs[num ++] = pl->m_list[i];
+		}
+	}
+
+	for ( int i = 0; i < num; i ++ )
+		irw_push_scheduled(songs[i]);
+	irw_prioritize(songs, num);
+} /* End of 'plist_prioritize_visible' function */
+
+/* Note that song length has changed */
+void plist_song_len_changed( song_t *song )
+{
+	GSList *l;
+
+	pthread_mutex_lock(&plist_all_mutex);
+	for ( l = plist_all; l != NULL; l = l->next )
+	{
+		plist_t *pl = (plist_t *)l->data;
+		if (pl->m_len_pending != NULL)
+			plist_id_set_add(pl->m_len_pending, song->m_id);
+	}
+	pthread_mutex_unlock(&plist_all_mutex);
+} /* End of 'plist_song_len_changed' function */
+
+/* Note that song title has changed, so filter views test it again */
+void plist_song_title_changed( song_t *song )
+{
+	GSList *l;
+
+	pthread_mutex_lock(&plist_all_mutex);
+	for ( l = plist_all; l != NULL; l = l->next )
+	{
+		plist_t *pl = (plist_t *)l->data;
+		if (pl->m_view_pending != NULL)
+			plist_id_set_add(pl->m_view_pending, song->m_id);
+	}
+	pthread_mutex_unlock(&plist_all_mutex);
+} /* End of 'plist_song_title_changed' function */
+
+/* Bring lengths tree up to date: rebuild it after the list has changed
+ * and apply pending length changes (play list must be locked).
+ * Returns FALSE if there is no tree */
+static bool_t plist_sync_lens( plist_t *pl )
+{
+	GHashTable *pending;
+	GHashTableIter iter;
+	gpointer id;
+	int num;
+
+	if (pl->m_lens == NULL || pl->m_len_pending == NULL)
+		return FALSE;
+
+	/* Take the changed songs. Lengths are read after that, so a change
+	 * made meanwhile is at worst applied twice */
+	pthread_mutex_lock(&plist_all_mutex);
+	pending = pl->m_len_pending;
+	num = g_hash_table_size(pending);
+	if (num > 0)
+		pl->m_len_pending = plist_id_set_new();
+	pthread_mutex_unlock(&plist_all_mutex);
+
+	/* Rebuilt tree has all the current lengths */
+	if (pl->m_lens_gen != pl->m_gen)
+	{
+		if (num > 0)
+			g_hash_table_destroy(pending);
+		if (!ltree_build(pl->m_lens, pl->m_list, pl->m_len))
+			return FALSE;
+		pl->m_lens_gen = pl->m_gen;
+		return TRUE;
+	}
+	if (num == 0)
+		return TRUE;
+
+	/* Songs removed meanwhile are not found */
+	g_hash_table_iter_init(&iter, pending);
+	while (g_hash_table_iter_next(&iter, &id, NULL))
+	{
+		int pos = plist_id_pos(pl, *(song_id_t *)id);
+		if (pos >= 0)
+			ltree_set(pl->m_lens, pos, pl->m_list[pos]->m_len);
+	}
+	g_hash_table_destroy(pending);
+	return TRUE;
+} /* End of 'plist_sync_lens' function */
+
 /* Display play list */
 void plist_display( plist_t *pl, wnd_t *wnd )
 {
-	int i, j, start, end;
+	int i, j, start, end, row;
 	char time_text[80];
+	plist_view_t *v = NULL;
 
 	assert(pl);
-	PLIST_GET_SEL(pl, start, end);
 
 	plist_lock(pl);
+	plist_view_sync(pl);
+	if (PLIST_FILTERED(pl))
+	{
+		v = PLIST_VIEW(pl);
+		if (pl->m_view_scrolled > v->m_len - PLIST_HEIGHT)
+			pl->m_view_scrolled = v->m_len - PLIST_HEIGHT;
+		if (pl->m_view_scrolled < 0)
+			pl->m_view_scrolled = 0;
+	}
+	PLIST_GET_SEL(pl, start, end);
+	plist_prioritize_visible(pl);
 
 	/* Display each song */
-	for ( i = 0, j = pl->m_scrolled; i < PLIST_HEIGHT; i ++, j ++ )
+	for ( i = 0, row = (v == NULL) ? pl->m_scrolled : pl->m_view_scrolled; 
+			i < PLIST_HEIGHT; i ++, row ++ )
 	{
 		int attrib;
+
+		/* Get song list position */
+		if (v == NULL)
+			j = row;
+		else
+			j = (row < v->m_len) ? v->m_pos[row] : pl->m_len;
 		
 		/* Set respective print attributes */
 		if (j >= start && j <= end)
@@ -596,16 +1498,15 @@ void plist_display( plist_t *pl, wnd_t *wnd )
 			song_t *s = pl->m_list[j];
 			char len[10];
 			int x;
-			int queueList;
+			int queue_place;
 			
 			wnd_move(wnd, 0, 0, pl->m_start_pos + i);
 			wnd_printf(wnd, WND_PRINT_ELLIPSES, WND_WIDTH(wnd) - 8, 
 					"%i. %s", j + 1, STR_TO_CPTR(s->m_title));
-			for(queueList=0;queueList<num_queued_songs;queueList++)
-			{
-				if(queued_songs[queueList] == j)
-					wnd_printf(wnd, 0, 0, "    #%i in queue...", queueList+1);
-			}
+			queue_place = (player_queue == NULL) ? 0 : 
+				pq_find(player_queue, s->m_id);
+			if (queue_place > 0)
+				wnd_printf(wnd, 0, 0, "    #%i in queue...", queue_place);
 			int l = TIME_TO_SECONDS(s->m_len);
 			sprintf(len, "%i:%02i", l / 60, l % 60);
 			wnd_move(wnd, WND_MOVE_ADVANCE, WND_WIDTH(wnd) - strlen(len) - 1, 
@@ -618,14 +1519,29 @@ void plist_display( plist_t *pl, wnd_t *wnd )
 	song_time_t l_time = 0, s_time = 0;
 	if (pl->m_len)
 	{
-		for ( i = 0; i < pl->m_len; i ++ )
-			l_time += pl->m_list[i]->m_len;
-		for ( i = start; i <= end; i ++ )
-			s_time += pl->m_list[i]->m_len;
+		if (plist_sync_lens(pl))
+		{
+			l_time = ltree_sum(pl->m_lens, 0, pl->m_len - 1);
+			s_time = ltree_sum(pl->m_lens, start, end);
+		}
+		else
+		{
+			for ( i = 0; i < pl->m_len; i ++ )
+				l_time += pl->m_list[i]->m_len;
+			for ( i = start; i <= end; i ++ )
+				s_time += pl->m_list[i]->m_len;
+		}
 	}
 	int l_seconds = TIME_TO_SECONDS(l_time);
 	int s_seconds = TIME_TO_SECONDS(s_time);
 	wnd_apply_style(wnd, "plist-time-style");
+	if (v != NULL)
+	{
+		wnd_move(wnd, 0, 0, pl->m_start_pos + PLIST_HEIGHT);
+		wnd_printf(wnd, WND_PRINT_ELLIPSES, WND_WIDTH(wnd) / 2,
+				ngettext("Filter: %s (%i song)", "Filter: %s (%i songs)",
+					v->m_len), v->m_filter, v->m_len);
+	}
 	sprintf(time_text, ngettext("%i/%i song; %i:%02i:%02i/%i:%02i:%02i",
 				"%i/%i songs; %i:%02i:%02i/%i:%02i:%02i", pl->m_len),
 			(end >= 0 && pl->m_len > 0) ? end - start + 1 : 0, pl->m_len,
@@ -653,8 +1569,7 @@ void plist_unlock( plist_t *pl )
 /* Move selection in play list */
 void plist_move_sel( plist_t *pl, int y, bool_t relative )
 {
-	int start, end, i, j, num_songs;
-	song_t *cur_song;
+	int start, end, i, j, num_songs, cur;
 	
 	if (pl == NULL)
 		return;
@@ -673,10 +1588,6 @@ void plist_move_sel( plist_t *pl, int y, bool_t relative )
 		y = 0;
 	else if (y >= pl->m_len - (end - start))
 		y = pl->m_len - (end - start) - 1;
-	if (pl->m_cur_song >= 0)
-		cur_song = pl->m_list[pl->m_cur_song];
-	else
-		cur_song = NULL;
 	num_songs = end - start + 1;
 
 	/* Store undo information */
@@ -714,15 +1625,19 @@ void plist_move_sel( plist_t *pl, int y, bool_t relative )
 		}
 	}
 
+	pl->m_gen ++;
+	plist_update_ids(pl, MIN(start, y), MAX(end, y + num_songs - 1));
+
 	/* Update selection indecies and current song */
 	pl->m_sel_start += (y - start);
 	pl->m_sel_end += (y - start);
-	for ( i = 0; i < pl->m_len; i ++ )
-		if (pl->m_list[i] == cur_song)
-		{
-			pl->m_cur_song = i;
-			break;
-		}
+	cur = pl->m_cur_song;
+	if (cur >= start && cur <= end)
+		pl->m_cur_song += (y - start);
+	else if (y < start && cur >= y && cur < start)
+		pl->m_cur_song += num_songs;
+	else if (y > start && cur > end && cur <= end + (y - start))
+		pl->m_cur_song -= num_songs;
 
 	/* Scroll if need */
 	if (pl->m_sel_end < pl->m_scrolled || 
@@ -776,22 +1691,39 @@ bool_t plist_is_obj( char *filename )
 		return FALSE;
 } /* End of 'plist_is_obj' function */
 
-/* Set info for all scheduled songs */
+/* Set info for all scheduled songs. In the lazy mode songs are left
+ * scheduled until they are displayed or their info is required */
 void plist_flush_scheduled( plist_t *pl )
 {
 	int i;
 
+	if (cfg_get_var_bool(cfg_list, "lazy-info"))
+		return;
+
 	for ( i = 0; i < pl->m_len; i ++ )
-	{
-		song_t *s = pl->m_list[i];
-		if (s->m_flags & SONG_SCHEDULE)
-		{
-			irw_push(s, SONG_INFO_READ);
-			s->m_flags &= (~SONG_SCHEDULE);
-		}
-	}
+		irw_push_scheduled(pl->m_list[i]);
 } /* End of 'plist_flush_scheduled' function */
 
+/* Start reading info for scheduled songs within the bounds */
+void plist_start_info( plist_t *pl, int start, int end )
+{
+	int i;
+
+	for ( i = start; i <= end && i < pl->m_len; i ++ )
+		irw_push_scheduled(pl->m_list[i]);
+} /* End of 'plist_start_info' function */
+
+/* Read info for scheduled songs within the bounds and wait until it
+ * is read */
+void plist_require_info( plist_t *pl, int start, int end )
+{
+	int i;
+
+	plist_start_info(pl, start, end);
+	for ( i = start; i <= end && i < pl->m_len; i ++ )
+		irw_wait_read(pl->m_list[i]);
+} /* End of 'plist_require_info' function */
+
 #define PLIST_TOO_NESTED -1
 #define PLP_STATUS_TOO_NESTED -1
 
@@ -922,32 +1854,77 @@ finish:
 	return ret;
 } /* End of 'plist_add_playlist_item' function */
 
-void plist_add_song( plist_t *pl, song_t *song, int where )
+/* Make room for at least 'len' songs (play list must be locked) */
+static bool_t plist_reserve( plist_t *pl, int len )
+{
+	song_t **list;
+	int capacity;
+
+	if (len <= pl->m_capacity)
+		return TRUE;
+	capacity = MAX(pl->m_capacity * 2, PLIST_MIN_CAPACITY);
+	if (capacity < len)
+		capacity = len;
+	list = (song_t **)realloc(pl->m_list, sizeof(song_t *) * capacity);
+	if (list == NULL)
+		return FALSE;
+	pl->m_list = list;
+	pl->m_capacity = capacity;
+	return TRUE;
+} /* End of 'plist_reserve' function */
+
+/* Add songs at once. Play list takes over the songs references
+ * (they are freed if there is no memory) */
+bool_t plist_add_songs( plist_t *pl, song_t **songs, int num, int where )
 {
+	int i, was_len;
+
+	if (num <= 0)
+		return TRUE;
+
 	/* Lock play list */
 	plist_lock(pl);
 
-	/* Try to reallocate memory for play list */
-	int was_len = pl->m_len;
-	pl->m_list = (song_t **)realloc(pl->m_list,
-			sizeof(song_t *) * (pl->m_len + 1));
-	if (pl->m_list == NULL)
+	was_len = pl->m_len;
+	if (!plist_reserve(pl, pl->m_len + num))
 	{
-		pl->m_len = 0;
 		plist_unlock(pl);
-		return;
+		for ( i = 0; i < num; i ++ )
+			song_free(songs[i]);
+		return FALSE;
 	}
 
 	if (where < 0 || where >= pl->m_len)  
 		where = pl->m_len;
-	memmove(&pl->m_list[where + 1], &pl->m_list[where], 
+	memmove(&pl->m_list[where + num], &pl->m_list[where], 
 			sizeof(song_t *) * (pl->m_len - where));
-	pl->m_list[where] = song;
-	pl->m_len ++;
+	memcpy(&pl->m_list[where], songs, sizeof(song_t *) * num);
+	pl->m_len += num;
+
+	/* Lengths tree is extended if songs go to the end; otherwise it is
+	 * rebuilt when needed */
+	if (where == was_len && pl->m_lens != NULL && pl->m_lens_gen == pl->m_gen && 
+			ltree_append(pl->m_lens, songs, num))
+		pl->m_lens_gen ++;
+	pl->m_gen ++;
+
+	/* New songs and the ones after them have new positions */
+	plist_update_ids(pl, where, pl->m_len - 1);
+	if (pl->m_sidx != NULL)
+		sidx_add(pl->m_sidx, songs, num);
+
+	/* Views test the new songs when they are synced */
+	if (PLIST_FILTERED(pl) && pl->m_view_pending != NULL)
+	{
+		pthread_mutex_lock(&plist_all_mutex);
+		for ( i = 0; i < num; i ++ )
+			plist_id_set_add(pl->m_view_pending, songs[i]->m_id);
+		pthread_mutex_unlock(&plist_all_mutex);
+	}
 
 	/* Update current song index */
 	if (pl->m_cur_song >= where)
-		pl->m_cur_song ++;
+		pl->m_cur_song += num;
 
 	/* If list was empty - put cursor to the first song */
 	if (!was_len)
@@ -958,6 +1935,12 @@ void plist_add_song( plist_t *pl, song_t *song, int where )
 
 	/* Unlock play list */
 	plist_unlock(pl);
+	return TRUE;
+} /* End of 'plist_add_songs' function */
+
+void plist_add_song( plist_t *pl, song_t *song, int where )
+{
+	plist_add_songs(pl, &song, 1, where);
 }
 
 static plist_plugin_t *is_playlist(char *file)
@@ -987,6 +1970,19 @@ int plist_add_plist( plist_t *pl, plist_plugin_t *plp, char *file, int recc_leve
 	return ctx.num_added;
 }
 
+/* Create a song for a file being added */
+static song_t *plist_file_song_new( char *file, song_metadata_t *metadata )
+{
+	song_t *song = song_new_from_file(file, metadata);
+	if (song == NULL)
+		return NULL;
+
+	/* Schedule song for setting its info and length */
+	if (!metadata->m_title)
+		song->m_flags |= SONG_SCHEDULE;
+	return song;
+} /* End of 'plist_file_song_new' function */
+
 /* Add single file to play list */
 int plist_add_one_file( plist_t *pl, char *file, song_metadata_t *metadata,
 		int where, int recc_level, bool_t dry_run )
@@ -1005,17 +2001,9 @@ int plist_add_one_file( plist_t *pl, char *file, song_metadata_t *metadata,
 		return 1;
 
 	/* Initialize new song and add it to list */
-	song = song_new_from_file(file, metadata);
+	song = plist_file_song_new(file, metadata);
 	if (song == NULL)
-	{
-		plist_unlock(pl);
 		return 0;
-	}
-
-	/* Schedule song for setting its info and length */
-	if (!metadata->m_title)
-		song->m_flags |= SONG_SCHEDULE;
-
 	plist_add_song(pl, song, where);
 
 	return 1;
@@ -1058,6 +2046,31 @@ static int plist_add_real_path( plist_t *pl, char *full_path, bool_t dry_run )
 		return plist_add_file(pl, full_path, dry_run);
 }
 
+/* Append a song to the batch. Song is freed if there is no memory */
+static void plist_batch_push( plist_batch_t *b, song_t *song )
+{
+	if (b->m_num == b->m_capacity)
+	{
+		int capacity = MAX(b->m_capacity * 2, PLIST_MIN_CAPACITY);
+		song_t **songs = (song_t **)realloc(b->m_songs, sizeof(song_t *) * capacity);
+		if (songs == NULL)
+		{
+			song_free(song);
+			return;
+		}
+		b->m_songs = songs;
+		b->m_capacity = capacity;
+	}
+	b->m_songs[b->m_num ++] = song;
+} /* End of 'plist_batch_push' function */
+
+/* Add batch songs to the end of play list */
+static void plist_batch_flush( plist_t *pl, plist_batch_t *b )
+{
+	plist_add_songs(pl, b->m_songs, b->m_num, -1);
+	b->m_num = 0;
+} /* End of 'plist_batch_flush' function */
+
 static int plist_add_dir( plist_t *pl, char *dir_path, bool_t dry_run )
 {
 	/* Get sorted directory contents */
@@ -1071,6 +2084,7 @@ static int plist_add_dir( plist_t *pl, char *dir_path, bool_t dry_run )
 
 	int num_added = 0;
 	int only_idx = -1;
+	plist_batch_t batch = { NULL, 0, 0 };
 
 	/* Smart directory adding: scan directory for playlist and 
 	 * only one playlist if there is any */
@@ -1119,18 +2133,120 @@ static int plist_add_dir( plist_t *pl, char *dir_path, bool_t dry_run )
 			goto finally;
 
 		char *full_path = util_strcat(dir_path, "/", name, NULL);
-		num_added += plist_add_real_path(pl, full_path, dry_run);
+		bool_t is_dir;
+
+		/* Plain files are collected and added at once, everything else
+		 * goes after them to keep the order */
+		if (!dry_run && fu_file_type(full_path, &is_dir) && !is_dir && 
+				is_playlist(full_path) == NULL)
+		{
+			song_metadata_t metadata = SONG_METADATA_EMPTY;
+			song_t *song = plist_file_song_new(full_path, &metadata);
+			if (song != NULL)
+			{
+				plist_batch_push(&batch, song);
+				num_added ++;
+			}
+		}
+		else
+		{
+			plist_batch_flush(pl, &batch);
+			num_added += plist_add_real_path(pl, full_path, dry_run);
+		}
 		free(full_path);
 
 	finally:
 		free(namelist[i]);
 	}
 
+	plist_batch_flush(pl, &batch);
+	free(batch.m_songs);
 	free(namelist);
 
 	return num_added;
 }
 
+/* Add songs of a directory read by the walker. Directories are added
+ * depth-first in the same order 'plist_add_dir' uses */
+static int plist_add_dw_node( plist_t *pl, dw_t *dw, dw_node_t *node,
+		plist_batch_t *batch, gint64 *wait_time )
+{
+	int num_added = 0;
+
+	/* Wait for the walker. This blocks the calling (interface) thread,
+	 * so nothing is redrawn until the whole tree is added */
+	if (!node->m_done)
+	{
+		gint64 start;
+
+		plist_batch_flush(pl, batch);
+		start = g_get_monotonic_time();
+		dw_wait(dw, node);
+		(*wait_time) += g_get_monotonic_time() - start;
+	}
+
+	/* Smart adding has to choose a play list here */
+	if (node->m_serial)
+	{
+		plist_batch_flush(pl, batch);
+		return plist_add_dir(pl, node->m_path, FALSE);
+	}
+
+	for ( int i = 0; i < node->m_num_entries; i++ )
+	{
+		dw_entry_t *e = &node->m_entries[i];
+
+		if (e->m_type == DW_ENTRY_SONG)
+		{
+			plist_batch_push(batch, e->m_song);
+			e->m_song = NULL;
+			num_added ++;
+			if (batch->m_num >= PLIST_DIR_BATCH)
+				plist_batch_flush(pl, batch);
+		}
+		else if (e->m_type == DW_ENTRY_DIR)
+			num_added += plist_add_dw_node(pl, dw, e->m_dir, batch, wait_time);
+		else
+		{
+			plist_batch_flush(pl, batch);
+			num_added += plist_add_real_path(pl, e->m_path, FALSE);
+		}
+	}
+	return num_added;
+} /* End of 'plist_add_dw_node' function */
+
+/* Add a directory reading it with several threads */
+static int plist_add_dir_parallel( plist_t *pl, char *dir_path, int num_threads )
+{
+	gint64 start = g_get_monotonic_time(), wait_time = 0, elapsed;
+	int flags = 0;
+
+	if (cfg_get_var_bool(cfg_list, "skip-hidden-files"))
+		flags |= DW_SKIP_HIDDEN;
+	if (cfg_get_var_bool(cfg_list, "smart-dir-add"))
+		flags |= DW_SMART_ADD;
+	dw_t *dw = dw_new(dir_path, num_threads, flags);
+	if (dw == NULL)
+		return plist_add_dir(pl, dir_path, FALSE);
+
+	plist_batch_t batch = { NULL, 0, 0 };
+	int num_added = plist_add_dw_node(pl, dw, dw->m_root, &batch, &wait_time);
+	plist_batch_flush(pl, &batch);
+	free(batch.m_songs);
+
+	elapsed = g_get_monotonic_time() - start;
+	logger_message(player_log, 1,
+			_("Added %d files from %d directories in %.2f s (%.0f files/s) "
+			  "with %d threads: reading %.2f s, creating songs %.2f s, "
+			  "waiting %.2f s, inserting %.2f s"),
+			num_added, dw->m_num_dirs, elapsed / 1e6,
+			elapsed > 0 ? num_added * 1e6 / elapsed : 0.,
+			dw->m_num_threads, dw->m_scan_time / 1e6, dw->m_song_time / 1e6,
+			wait_time / 1e6, (elapsed - wait_time) / 1e6);
+	dw_free(dw);
+	return num_added;
+} /* End of 'plist_add_dir_parallel' function */
+
 int plist_add_uri( plist_t *pl, char *uri, song_metadata_t *metadata, bool_t dry_run )
 {
 	/* Dry run: pretend to add this song */
@@ -1178,7 +2294,14 @@ static int plist_add_path( plist_t *pl, char *path )
 		free(dirname);
 	}
 
-	int res = plist_add_real_path(pl, full_path, FALSE);
+	/* Directories are read in parallel */
+	int res;
+	bool_t is_dir;
+	int num_threads = cfg_get_var_int(cfg_list, "scan-threads");
+	if (num_threads > 1 && fu_file_type(full_path, &is_dir) && is_dir)
+		res = plist_add_dir_parallel(pl, full_path, num_threads);
+	else
+		res = plist_add_real_path(pl, full_path, FALSE);
 	if (full_path != path)
 		free(full_path);
 
@@ -1383,6 +2506,7 @@ JsonArray *plist_export_to_json( plist_t *pl )
 void plist_import_from_json( plist_t *pl, JsonArray *js_plist )
 {
 	int num_songs = json_array_get_length(js_plist);
+	plist_batch_t batch = { NULL, 0, 0 };
 	for ( int i = 0; i < num_songs; ++i )
 	{
 		JsonNode *js_song_node = json_array_get_element(js_plist, i);
@@ -1430,9 +2554,11 @@ void plist_import_from_json( plist_t *pl, JsonArray *js_plist )
 		{
 			if (!is_static_info && si)
 				song_set_info(s, si);
-			plist_add_song(pl, s, -1);
+			plist_batch_push(&batch, s);
 		}
 	}
+	plist_batch_flush(pl, &batch);
+	free(batch.m_songs);
 }
 
 /* End of 'plist.c' file */
@@ -53,6 +53,40 @@ typedef struct
 #define PLIST_SORT_BY_PATH  2
 #define PLIST_SORT_BY_TRACK 3
 
+/* Initial play list capacity */
+#define PLIST_MIN_CAPACITY 16
+
+/* Songs collected to be added at once */
+typedef struct
+{
+	song_t **m_songs;
+	int m_num, m_capacity;
+} plist_batch_t;
+
+/* Maximal number of songs added at once while reading directories */
+#define PLIST_DIR_BATCH 4096
+
+/* Runs of this length are sorted by insertion */
+#define PLIST_SORT_RUN 16
+
+/* Precomputed sort key of a song */
+typedef struct
+{
+	song_t *m_song;
+
+	/* Position in the unsorted list */
+	int m_index;
+
+	/* Collation keys of the main sort string and of the file name
+	 * (the latter is used when sorting by track only; directory key
+	 * is shared by the songs of a directory then) */
+	char *m_key, *m_name_key;
+
+	/* Track number (if known) */
+	bool_t m_has_track;
+	int m_track;
+} plist_sort_key_t;
+
 /* Search criterias */
 #define PLIST_SEARCH_TITLE		0
 #define PLIST_SEARCH_NAME		1
@@ -70,6 +104,13 @@ typedef struct
 	 	(end) = (pl)->m_sel_end) : ((end) = (pl)->m_sel_start, \
 	 	(start) = (pl)->m_sel_end))
 
+/* Check if play list is displayed through a filter */
+#define PLIST_FILTERED(pl) ((pl)->m_num_views > 0)
+
+/* Get the current filter view */
+#define PLIST_VIEW(pl) (PLIST_FILTERED(pl) ? \
+		&(pl)->m_views[(pl)->m_num_views - 1] : NULL)
+
 /* Check if there exists song information */
 #define PLIST_HAS_INFO(s) (!((s)->m_info == NULL || \
 			(!(s)->m_info->m_not_own_present && \
@@ -96,6 +137,10 @@ int plist_add_plist( plist_t *pl, plist_plugin_t *plp, char *file, int recc_leve
 
 void plist_add_song( plist_t *pl, song_t *song, int where );
 
+/* Add songs at once. Play list takes over the songs references
+ * (they are freed if there is no memory) */
+bool_t plist_add_songs( plist_t *pl, song_t **songs, int num, int where );
+
 /* Add M3U play list */
 int plist_add_m3u( plist_t *pl, char *filename );
 
@@ -114,6 +159,21 @@ bool_t plist_save_pls( plist_t *pl, char *filename );
 /* Compare two songs for sorting */
 int plist_song_cmp( song_t *s1, song_t *s2, int criteria );
 
+/* Sort songs array (stable). If 'order' is not NULL, it receives
+ * the original index of every song of the sorted array */
+bool_t plist_sort_songs( song_t **songs, int num, int criteria, int *order );
+
+/* Find position of song with given id. Returns -1 if there is no
+ * such song */
+int plist_find_id( plist_t *pl, song_id_t id );
+
+/* The same for a locked play list */
+int plist_id_pos( plist_t *pl, song_id_t id );
+
+/* Store positions of songs within the bounds in the id index (play
+ * list must be locked) */
+void plist_update_ids( plist_t *pl, int start, int end );
+
 /* Sort play list with specified bounds */
 void plist_sort_bounds( plist_t *pl, int start, int end, int criteria );
 
@@ -138,9 +198,21 @@ void plist_move_sel( plist_t *pl, int y, bool_t relative );
 /* Centrize view */
 void plist_centrize( plist_t *pl, int index );
 
+/* Set filter for the displayed songs. Empty filter shows all of them */
+void plist_set_filter( plist_t *pl, const char *filter );
+
+/* Get list position of song displayed in a play list row */
+int plist_row_pos( plist_t *pl, int row );
+
 /* Display play list */
 void plist_display( plist_t *pl, wnd_t *wnd );
 
+/* Note that song length has changed */
+void plist_song_len_changed( song_t *song );
+
+/* Note that song title has changed */
+void plist_song_title_changed( song_t *song );
+
 /* Lock play list */
 void plist_lock( plist_t *pl );
 
@@ -159,6 +231,13 @@ void plist_reload_info( plist_t *pl, bool_t global );
 /* Set info for all scheduled songs */
 void plist_flush_scheduled( plist_t *pl );
 
+/* Start reading info for scheduled songs within the bounds */
+void plist_start_info( plist_t *pl, int start, int end );
+
+/* Read info for scheduled songs within the bounds and wait until it
+ * is read */
+void plist_require_info( plist_t *pl, int start, int end );
+
 /* Initialize a set of files for adding */
 plist_set_t *plist_set_new( bool_t patterns );
 
@@ -0,0 +1,355 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Upcoming files read-ahead implementation.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "types.h"
+#include "cfg.h"
+#include "player.h"
+#include "prefetch.h"
+
+/* Size of a single read */
+#define PREFETCH_CHUNK (256 * 1024)
+
+/* Extra space warmed around a slice (its offset is only estimated) */
+#define PREFETCH_SLICE_MARGIN (512 * 1024)
+
+/* Amount of a region checked for residency when the song starts */
+#define PREFETCH_CHECK_SIZE (4 * 1024 * 1024)
+
+/* Linux idle I/O scheduling class */
+#define PREFETCH_IOPRIO_WHO_PROCESS 1
+#define PREFETCH_IOPRIO_CLASS_IDLE 3
+#define PREFETCH_IOPRIO_CLASS_SHIFT 13
+
+/* Files to warm. Protected by the mutex; the generation changes every
+ * time the set is replaced so that the thread drops outdated work */
+static prefetch_item_t prefetch_items[PREFETCH_MAX_FILES];
+static int prefetch_num_items = 0;
+static volatile unsigned prefetch_gen = 0;
+static unsigned prefetch_done_gen = 0;
+static pthread_mutex_t prefetch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prefetch_cond = PTHREAD_COND_INITIALIZER;
+
+/* Thread */
+static pthread_t prefetch_tid;
+static bool_t prefetch_running = FALSE;
+static volatile bool_t prefetch_stop = FALSE;
+
+/* Statistics */
+static int prefetch_hits = 0, prefetch_misses = 0;
+
+static void *prefetch_thread( void *arg );
+
+/* Initialize read-ahead thread */
+bool_t prefetch_init( void )
+{
+	prefetch_stop = FALSE;
+	if (pthread_create(&prefetch_tid, NULL, prefetch_thread, NULL))
+		return FALSE;
+	prefetch_running = TRUE;
+	return TRUE;
+} /* End of 'prefetch_init' function */
+
+/* Free items (mutex must be locked) */
+static void prefetch_clear( void )
+{
+	int i;
+
+	for ( i = 0; i < prefetch_num_items; i ++ )
+		free(prefetch_items[i].m_filename);
+	prefetch_num_items = 0;
+} /* End of 'prefetch_clear' function */
+
+/* Stop read-ahead thread */
+void prefetch_free( void )
+{
+	pthread_mutex_lock(&prefetch_mutex);
+	prefetch_stop = TRUE;
+	pthread_cond_signal(&prefetch_cond);
+	pthread_mutex_unlock(&prefetch_mutex);
+	if (prefetch_running)
+		pthread_join(prefetch_tid, NULL);
+	prefetch_running = FALSE;
+
+	pthread_mutex_lock(&prefetch_mutex);
+	prefetch_clear();
+	pthread_mutex_unlock(&prefetch_mutex);
+
+	if (prefetch_hits + prefetch_misses > 0)
+		logger_debug(player_log, "read-ahead: %d hits, %d misses total",
+				prefetch_hits, prefetch_misses);
+} /* End of 'prefetch_free' function */
+
+/* Replace the set of files to warm with the given songs (in play order) */
+void prefetch_schedule( song_t **songs, int num )
+{
+	int i;
+
+	pthread_mutex_lock(&prefetch_mutex);
+	prefetch_clear();
+	for ( i = 0; i < num && prefetch_num_items < PREFETCH_MAX_FILES; i ++ )
+	{
+		prefetch_item_t *item = &prefetch_items[prefetch_num_items];
+		song_t *s = songs[i];
+
+		/* Only local files are read ahead */
+		if (s->m_filename == NULL)
+			continue;
+		memset(item, 0, sizeof(*item));
+		item->m_filename = strdup(s->m_filename);
+		if (item->m_filename == NULL)
+			break;
+		item->m_start_time = s->m_start_time;
+		item->m_len = s->m_len;
+		item->m_full_len = s->m_full_len;
+		prefetch_num_items ++;
+	}
+	prefetch_gen ++;
+	pthread_cond_signal(&prefetch_cond);
+	pthread_mutex_unlock(&prefetch_mutex);
+} /* End of 'prefetch_schedule' function */
+
+/* Choose the region of a file to warm */
+static void prefetch_get_region( prefetch_item_t *item, off_t file_size,
+		off_t *offset, off_t *size )
+{
+	double ratio;
+
+	*offset = 0;
+	*size = file_size;
+
+	/* Slice offset is estimated assuming a constant bit rate */
+	if (item->m_full_len <= 0 ||
+			(item->m_start_time <= 0 && item->m_len >= item->m_full_len))
+		return;
+	ratio = (double)file_size / item->m_full_len;
+	*offset = (off_t)(item->m_start_time * ratio) - PREFETCH_SLICE_MARGIN;
+	*size = (off_t)(item->m_len * ratio) + 2 * PREFETCH_SLICE_MARGIN;
+	if (*offset < 0)
+	{
+		*size += *offset;
+		*offset = 0;
+	}
+	if (*offset > file_size)
+		*offset = file_size;
+	if (*offset + *size > file_size)
+		*size = file_size - *offset;
+} /* End of 'prefetch_get_region' function */
+
+/* Read a file region into the page cache. Stops early if the set of
+ * files to warm changes. Returns amount of data read */
+static off_t prefetch_read( int fd, off_t offset, off_t size, unsigned gen )
+{
+	static char buf[PREFETCH_CHUNK];
+	off_t done = 0;
+
+	while (done < size && gen == prefetch_gen && !prefetch_stop)
+	{
+		size_t len = (size - done < PREFETCH_CHUNK) ?
+			(size_t)(size - done) : PREFETCH_CHUNK;
+		ssize_t n = pread(fd, buf, len, offset + done);
+		if (n <= 0)
+			break;
+		done += n;
+	}
+	return done;
+} /* End of 'prefetch_read' function */
+
+/* Warm files of the current set while the budget allows */
+static void prefetch_run( unsigned gen )
+{
+	off_t budget = (off_t)cfg_get_var_int(cfg_list, "prefetch-budget") << 20;
+	int i;
+
+	for ( i = 0; budget > 0 && gen == prefetch_gen && !prefetch_stop; i ++ )
+	{
+		prefetch_item_t item;
+		struct stat st;
+		off_t offset, size, done;
+		int fd;
+
+		/* Take item copy */
+		pthread_mutex_lock(&prefetch_mutex);
+		if (gen != prefetch_gen || i >= prefetch_num_items)
+		{
+			pthread_mutex_unlock(&prefetch_mutex);
+			break;
+		}
+		item = prefetch_items[i];
+		item.m_filename = strdup(item.m_filename);
+		pthread_mutex_unlock(&prefetch_mutex);
+		if (item.m_filename == NULL)
+			break;
+
+		fd = open(item.m_filename, O_RDONLY);
+		if (fd < 0)
+		{
+			free(item.m_filename);
+			continue;
+		}
+		if (fstat(fd, &st) || !S_ISREG(st.st_mode))
+		{
+			close(fd);
+			free(item.m_filename);
+			continue;
+		}
+		prefetch_get_region(&item, st.st_size, &offset, &size);
+		if (size > budget)
+			size = budget;
+		done = prefetch_read(fd, offset, size, gen);
+		close(fd);
+		budget -= done;
+		logger_debug(player_log, "read-ahead: warmed %ld of %ld KB at %ld "
+				"of %s", (long)(done >> 10), (long)(size >> 10),
+				(long)(offset >> 10), item.m_filename);
+		free(item.m_filename);
+
+		/* Store result */
+		pthread_mutex_lock(&prefetch_mutex);
+		if (gen == prefetch_gen)
+		{
+			prefetch_items[i].m_offset = offset;
+			prefetch_items[i].m_size = size;
+			prefetch_items[i].m_done = done;
+			prefetch_items[i].m_complete = TRUE;
+		}
+		pthread_mutex_unlock(&prefetch_mutex);
+	}
+} /* End of 'prefetch_run' function */
+
+/* Thread function */
+static void *prefetch_thread( void *arg )
+{
+	/* Don't compete with the decoder and the rest of the system */
+#ifdef SYS_ioprio_set
+	syscall(SYS_ioprio_set, PREFETCH_IOPRIO_WHO_PROCESS, 0,
+			PREFETCH_IOPRIO_CLASS_IDLE << PREFETCH_IOPRIO_CLASS_SHIFT);
+#endif
+
+	for ( ;; )
+	{
+		unsigned gen;
+
+		pthread_mutex_lock(&prefetch_mutex);
+		while (!prefetch_stop && prefetch_done_gen == prefetch_gen)
+			pthread_cond_wait(&prefetch_cond, &prefetch_mutex);
+		if (prefetch_stop)
+		{
+			pthread_mutex_unlock(&prefetch_mutex);
+			break;
+		}
+		gen = prefetch_done_gen = prefetch_gen;
+		pthread_mutex_unlock(&prefetch_mutex);
+
+		prefetch_run(gen);
+	}
+	return NULL;
+} /* End of 'prefetch_thread' function */
+
+/* Get percentage of a file region present in the page cache
+ * (-1 if unknown) */
+static int prefetch_residency( const char *filename, off_t offset, off_t size )
+{
+	long page = sysconf(_SC_PAGESIZE);
+	off_t start = offset - offset % page;
+	size_t len = size + (offset - start), pages, i, resident = 0;
+	unsigned char *vec;
+	void *map;
+	int fd;
+
+	if (size <= 0 || page <= 0)
+		return -1;
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, start);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	pages = (len + page - 1) / page;
+	vec = (unsigned char *)malloc(pages);
+	if (vec != NULL && !mincore(map, len, vec))
+	{
+		for ( i = 0; i < pages; i ++ )
+			if (vec[i] & 1)
+				resident ++;
+	}
+	else
+		pages = 0;
+	free(vec);
+	munmap(map, len);
+	return pages ? (int)(resident * 100 / pages) : -1;
+} /* End of 'prefetch_residency' function */
+
+/* Report whether the song that starts playing has been warmed */
+void prefetch_note_play( song_t *s )
+{
+	prefetch_item_t item;
+	bool_t found = FALSE;
+	int i, resident;
+
+	if (s->m_filename == NULL || !prefetch_running)
+		return;
+
+	pthread_mutex_lock(&prefetch_mutex);
+	for ( i = 0; i < prefetch_num_items; i ++ )
+	{
+		prefetch_item_t *it = &prefetch_items[i];
+		if (it->m_start_time == s->m_start_time &&
+				!strcmp(it->m_filename, s->m_filename))
+		{
+			item = *it;
+			found = TRUE;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&prefetch_mutex);
+
+	if (!found || !item.m_complete || item.m_done <= 0)
+	{
+		prefetch_misses ++;
+		logger_debug(player_log, "read-ahead: miss for %s (%s); "
+				"%d hits, %d misses", s->m_filename,
+				found ? "not read yet" : "not scheduled",
+				prefetch_hits, prefetch_misses);
+		return;
+	}
+
+	/* Check the head of the region is still cached */
+	resident = prefetch_residency(s->m_filename, item.m_offset,
+			MIN(item.m_done, PREFETCH_CHECK_SIZE));
+	prefetch_hits ++;
+	logger_debug(player_log, "read-ahead: hit for %s (%ld of %ld KB warmed, "
+			"%d%% of head resident); %d hits, %d misses", s->m_filename,
+			(long)(item.m_done >> 10), (long)(item.m_size >> 10), resident,
+			prefetch_hits, prefetch_misses);
+} /* End of 'prefetch_note_play' function */
+
+/* End of 'prefetch.c' file */
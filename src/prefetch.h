@@ -0,0 +1,62 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Interface for upcoming files read-ahead.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#ifndef __SG_MPFC_PREFETCH_H__
+#define __SG_MPFC_PREFETCH_H__
+
+#include <sys/types.h>
+#include "types.h"
+#include "main_types.h"
+
+/* Maximal number of files warmed at once */
+#define PREFETCH_MAX_FILES 16
+
+/* A file region to warm */
+typedef struct
+{
+	char *m_filename;
+
+	/* Song start and length within the file (used for slices) */
+	song_time_t m_start_time, m_len, m_full_len;
+
+	/* Region chosen and the amount of it actually read */
+	off_t m_offset, m_size, m_done;
+
+	/* Whether reading has completed */
+	bool_t m_complete;
+} prefetch_item_t;
+
+/* Initialize read-ahead thread */
+bool_t prefetch_init( void );
+
+/* Stop read-ahead thread */
+void prefetch_free( void );
+
+/* Replace the set of files to warm with the given songs (in play order) */
+void prefetch_schedule( song_t **songs, int num );
+
+/* Report whether the song that starts playing has been warmed */
+void prefetch_note_play( song_t *s );
+
+#endif
+
+/* End of 'prefetch.h' file */
@@ -0,0 +1,757 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. ReplayGain analyzer implementation.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <gst/gst.h>
+#include "types.h"
+#include "cfg.h"
+#include "player.h"
+#include "plist.h"
+#include "rg_analyzer.h"
+#include "song.h"
+
+/* Analysis pipeline of a worker thread:
+ * uridecodebin ! audioconvert ! audioresample ! rganalysis ! fakesink */
+typedef struct
+{
+	GstElement *m_pipeline, *m_dec, *m_convert, *m_rg;
+} rga_worker_t;
+
+/* Jobs queue */
+static rga_job_t *rga_head = NULL, *rga_tail = NULL;
+static pthread_mutex_t rga_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rga_cond = PTHREAD_COND_INITIALIZER;
+
+/* Worker threads */
+static pthread_t rga_tids[RGA_MAX_WORKERS];
+static int rga_num_workers = 0;
+static volatile bool_t rga_stop = FALSE;
+
+/* Progress of the current batch */
+static unsigned rga_batch = 0;
+static int rga_total = 0, rga_done = 0, rga_failed = 0;
+static gint64 rga_start_time = 0, rga_report_time = 0;
+
+/* Results cache (file name -> rga_entry_t) and the file it is kept in.
+ * Cache is read by a thread of its own, so that nobody playing a song
+ * has to wait for the file */
+static GHashTable *rga_cache = NULL;
+static FILE *rga_cache_fd = NULL;
+static char rga_cache_file[MAX_FILE_NAME] = "";
+static pthread_mutex_t rga_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rga_cache_cond = PTHREAD_COND_INITIALIZER;
+static bool_t rga_cache_loaded = FALSE;
+static pthread_t rga_loader_tid;
+static bool_t rga_loader_started = FALSE;
+
+/* Interval between progress reports (in us) */
+#define RGA_REPORT_INTERVAL (5 * G_USEC_PER_SEC)
+
+static void *rga_thread( void *arg );
+static void *rga_cache_loader( void *arg );
+
+/* Initialize analyzer */
+bool_t rga_init( void )
+{
+	char *home = getenv("HOME");
+
+	snprintf(rga_cache_file, sizeof(rga_cache_file), "%s/.mpfc/rgain",
+			(home == NULL) ? "." : home);
+	rga_stop = FALSE;
+
+	/* Start reading the cache */
+	rga_loader_started = !pthread_create(&rga_loader_tid, NULL, 
+			rga_cache_loader, NULL);
+	if (!rga_loader_started)
+		rga_cache_loader(NULL);
+	return TRUE;
+} /* End of 'rga_init' function */
+
+/* Free a job */
+static void rga_job_free( rga_job_t *job )
+{
+	int i;
+
+	for ( i = 0; i < job->m_num_files; i ++ )
+		free(job->m_files[i]);
+	free(job->m_files);
+	free(job);
+} /* End of 'rga_job_free' function */
+
+/* Free all queued jobs (queue must be locked) */
+static void rga_clear_queue( void )
+{
+	while (rga_head != NULL)
+	{
+		rga_job_t *next = rga_head->m_next;
+		rga_job_free(rga_head);
+		rga_head = next;
+	}
+	rga_tail = NULL;
+} /* End of 'rga_clear_queue' function */
+
+/* Stop analysis and free analyzer */
+void rga_free( void )
+{
+	int i;
+
+	/* Stop threads */
+	pthread_mutex_lock(&rga_mutex);
+	rga_stop = TRUE;
+	rga_clear_queue();
+	pthread_cond_broadcast(&rga_cond);
+	pthread_mutex_unlock(&rga_mutex);
+	for ( i = 0; i < rga_num_workers; i ++ )
+		pthread_join(rga_tids[i], NULL);
+	rga_num_workers = 0;
+	if (rga_loader_started)
+	{
+		pthread_join(rga_loader_tid, NULL);
+		rga_loader_started = FALSE;
+	}
+
+	/* Free cache */
+	pthread_mutex_lock(&rga_cache_mutex);
+	if (rga_cache_fd != NULL)
+	{
+		fclose(rga_cache_fd);
+		rga_cache_fd = NULL;
+	}
+	if (rga_cache != NULL)
+	{
+		g_hash_table_destroy(rga_cache);
+		rga_cache = NULL;
+	}
+	rga_cache_loaded = FALSE;
+	pthread_mutex_unlock(&rga_cache_mutex);
+} /* End of 'rga_free' function */
+
+/* Write a cache file line */
+static void rga_cache_write( FILE *fd, const char *filename, rga_entry_t *e )
+{
+	char tg[G_ASCII_DTOSTR_BUF_SIZE], tp[G_ASCII_DTOSTR_BUF_SIZE];
+	char ag[G_ASCII_DTOSTR_BUF_SIZE], ap[G_ASCII_DTOSTR_BUF_SIZE];
+
+	/* Numbers are written locale-independently */
+	g_ascii_formatd(tg, sizeof(tg), "%.2f", e->m_track_gain);
+	g_ascii_formatd(tp, sizeof(tp), "%.6f", e->m_track_peak);
+	g_ascii_formatd(ag, sizeof(ag), "%.2f", e->m_album_gain);
+	g_ascii_formatd(ap, sizeof(ap), "%.6f", e->m_album_peak);
+	fprintf(fd, "%ld %s %s %s %s %d %s\n", (long)e->m_mtime, tg, tp, ag, ap,
+			e->m_has_album, filename);
+} /* End of 'rga_cache_write' function */
+
+/* Parse a cache file line */
+static bool_t rga_cache_parse( char *line, rga_entry_t *e, char **filename )
+{
+	char *p = line, *end;
+	size_t len = strlen(line);
+
+	if (len > 0 && line[len - 1] == '\n')
+		line[len - 1] = 0;
+
+	e->m_mtime = (time_t)strtol(p, &end, 10);
+	if (end == p)
+		return FALSE;
+	e->m_track_gain = g_ascii_strtod(p = end, &end);
+	e->m_track_peak = g_ascii_strtod(p = end, &end);
+	e->m_album_gain = g_ascii_strtod(p = end, &end);
+	e->m_album_peak = g_ascii_strtod(p = end, &end);
+	e->m_has_album = (bool_t)strtol(p = end, &end, 10);
+	if (end == p || *end != ' ' || end[1] == 0)
+		return FALSE;
+	*filename = end + 1;
+	return TRUE;
+} /* End of 'rga_cache_parse' function */
+
+/* Read cache file into a new table */
+static GHashTable *rga_cache_read( void )
+{
+	GHashTable *cache;
+	FILE *fd;
+	char line[4096];
+	int num_lines = 0;
+
+	cache = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+
+	/* Later lines override the earlier ones */
+	fd = fopen(rga_cache_file, "rt");
+	if (fd != NULL)
+	{
+		while (fgets(line, sizeof(line), fd) != NULL)
+		{
+			rga_entry_t e, *ne;
+			char *name;
+
+			if (!rga_cache_parse(line, &e, &name))
+				continue;
+			ne = (rga_entry_t *)malloc(sizeof(*ne));
+			if (ne == NULL)
+				break;
+			*ne = e;
+			g_hash_table_replace(cache, strdup(name), ne);
+			num_lines ++;
+		}
+		fclose(fd);
+	}
+
+	/* Compact the file if it has grown with outdated entries */
+	if (num_lines > 2 * g_hash_table_size(cache) + 100)
+	{
+		fd = fopen(rga_cache_file, "wt");
+		if (fd != NULL)
+		{
+			GHashTableIter iter;
+			gpointer key, val;
+
+			g_hash_table_iter_init(&iter, cache);
+			while (g_hash_table_iter_next(&iter, &key, &val))
+				rga_cache_write(fd, (char *)key, (rga_entry_t *)val);
+			fclose(fd);
+		}
+	}
+	return cache;
+} /* End of 'rga_cache_read' function */
+
+/* Cache loading thread function. Nothing is written to the file until
+ * it is over */
+static void *rga_cache_loader( void *arg )
+{
+	GHashTable *cache = rga_cache_read();
+
+	pthread_mutex_lock(&rga_cache_mutex);
+	rga_cache = cache;
+	rga_cache_loaded = TRUE;
+	pthread_cond_broadcast(&rga_cache_cond);
+	pthread_mutex_unlock(&rga_cache_mutex);
+	return NULL;
+} /* End of 'rga_cache_loader' function */
+
+/* Wait until cache is loaded (cache must be locked) */
+static void rga_cache_wait( void )
+{
+	while (!rga_cache_loaded)
+		pthread_cond_wait(&rga_cache_cond, &rga_cache_mutex);
+} /* End of 'rga_cache_wait' function */
+
+/* Store results to cache */
+static void rga_cache_put( const char *filename, rga_entry_t *e )
+{
+	rga_entry_t *ne = (rga_entry_t *)malloc(sizeof(*ne));
+	if (ne == NULL)
+		return;
+	*ne = *e;
+
+	pthread_mutex_lock(&rga_cache_mutex);
+	rga_cache_wait();
+	g_hash_table_replace(rga_cache, strdup(filename), ne);
+	if (rga_cache_fd == NULL)
+		rga_cache_fd = fopen(rga_cache_file, "at");
+	if (rga_cache_fd != NULL)
+	{
+		rga_cache_write(rga_cache_fd, filename, e);
+		fflush(rga_cache_fd);
+	}
+	pthread_mutex_unlock(&rga_cache_mutex);
+} /* End of 'rga_cache_put' function */
+
+/* Get cached results for a file. Fails if file has changed since */
+bool_t rga_lookup( const char *filename, rga_entry_t *entry )
+{
+	struct stat st;
+	rga_entry_t *e;
+	bool_t found = FALSE;
+
+	if (filename == NULL || stat(filename, &st))
+		return FALSE;
+
+	pthread_mutex_lock(&rga_cache_mutex);
+	rga_cache_wait();
+	e = (rga_entry_t *)g_hash_table_lookup(rga_cache, filename);
+	if (e != NULL && e->m_mtime == st.st_mtime)
+	{
+		*entry = *e;
+		found = TRUE;
+	}
+	pthread_mutex_unlock(&rga_cache_mutex);
+	return found;
+} /* End of 'rga_lookup' function */
+
+/* Get cached results for a file without touching the file and without
+ * waiting for the cache to be read. Results of a file changed since
+ * it was analysed are returned too */
+bool_t rga_lookup_cached( const char *filename, rga_entry_t *entry )
+{
+	rga_entry_t *e;
+	bool_t found = FALSE;
+
+	if (filename == NULL)
+		return FALSE;
+
+	pthread_mutex_lock(&rga_cache_mutex);
+	if (rga_cache_loaded)
+	{
+		e = (rga_entry_t *)g_hash_table_lookup(rga_cache, filename);
+		if (e != NULL)
+		{
+			*entry = *e;
+			found = TRUE;
+		}
+	}
+	pthread_mutex_unlock(&rga_cache_mutex);
+	return found;
+} /* End of 'rga_lookup_cached' function */
+
+/* Get volume scale for a file according to the 'rgain-mode' setting.
+ * Is called when a song starts, so only the cached results are used */
+double rga_volume_scale( const char *filename )
+{
+	char *mode = cfg_get_var(cfg_list, "rgain-mode");
+	rga_entry_t e;
+	bool_t album;
+	double gain, peak, scale;
+
+	if (mode == NULL || (strcasecmp(mode, "track") && strcasecmp(mode, "album")))
+		return 1.;
+	if (!rga_lookup_cached(filename, &e))
+		return 1.;
+
+	album = (!strcasecmp(mode, "album") && e.m_has_album);
+	gain = (album ? e.m_album_gain : e.m_track_gain) +
+		cfg_get_var_float(cfg_list, "rgain-preamp");
+	peak = (album ? e.m_album_peak : e.m_track_peak);
+	scale = pow(10., gain / 20.);
+
+	/* Prevent clipping */
+	if (peak > 0 && scale * peak > 1.)
+		scale = 1. / peak;
+	logger_debug(player_log, "rgain: %s gain is %.2f dB, scale %.3f",
+			album ? "album" : "track", gain, scale);
+	return scale;
+} /* End of 'rga_volume_scale' function */
+
+/* Report progress (queue must be locked) */
+static void rga_report( bool_t force )
+{
+	gint64 now = g_get_monotonic_time();
+	double secs = (now - rga_start_time) / (double)G_USEC_PER_SEC;
+
+	if (!force && now - rga_report_time < RGA_REPORT_INTERVAL)
+		return;
+	rga_report_time = now;
+	logger_message(player_log, 1,
+			_("ReplayGain: %d of %d tracks analysed (%d failed), %.1f tracks/s"),
+			rga_done, rga_total, rga_failed, (secs > 0) ? rga_done / secs : 0.);
+} /* End of 'rga_report' function */
+
+/* Account a processed track */
+static void rga_progress( rga_job_t *job, bool_t ok )
+{
+	pthread_mutex_lock(&rga_mutex);
+	if (job->m_batch != rga_batch)
+	{
+		pthread_mutex_unlock(&rga_mutex);
+		return;
+	}
+	rga_done ++;
+	if (!ok)
+		rga_failed ++;
+	rga_report(rga_done == rga_total);
+	pthread_mutex_unlock(&rga_mutex);
+} /* End of 'rga_progress' function */
+
+/* Link decoder output to the analysis chain */
+static void rga_on_pad_added( GstElement *dec, GstPad *pad, gpointer data )
+{
+	rga_worker_t *w = (rga_worker_t *)data;
+	GstPad *sink = gst_element_get_static_pad(w->m_convert, "sink");
+
+	if (!gst_pad_is_linked(sink))
+		gst_pad_link(pad, sink);
+	gst_object_unref(sink);
+} /* End of 'rga_on_pad_added' function */
+
+/* Create worker pipeline */
+static bool_t rga_worker_init( rga_worker_t *w )
+{
+	GstElement *resample, *sink;
+	GstCaps *caps;
+
+	w->m_pipeline = gst_pipeline_new(NULL);
+	w->m_dec = gst_element_factory_make("uridecodebin", NULL);
+	w->m_convert = gst_element_factory_make("audioconvert", NULL);
+	resample = gst_element_factory_make("audioresample", NULL);
+	w->m_rg = gst_element_factory_make("rganalysis", NULL);
+	sink = gst_element_factory_make("fakesink", NULL);
+	if (w->m_pipeline == NULL || w->m_dec == NULL || w->m_convert == NULL ||
+			resample == NULL || w->m_rg == NULL || sink == NULL)
+	{
+		logger_error(player_log, 1,
+				_("ReplayGain: unable to create analysis pipeline"));
+		if (w->m_dec)
+			gst_object_unref(w->m_dec);
+		if (w->m_convert)
+			gst_object_unref(w->m_convert);
+		if (resample)
+			gst_object_unref(resample);
+		if (w->m_rg)
+			gst_object_unref(w->m_rg);
+		if (sink)
+			gst_object_unref(sink);
+		if (w->m_pipeline)
+			gst_object_unref(w->m_pipeline);
+		return FALSE;
+	}
+
+	/* Decode as fast as possible */
+	g_object_set(G_OBJECT(sink), "sync", FALSE, NULL);
+	caps = gst_caps_from_string("audio/x-raw");
+	g_object_set(G_OBJECT(w->m_dec), "caps", caps, NULL);
+	gst_caps_unref(caps);
+
+	gst_bin_add_many(GST_BIN(w->m_pipeline), w->m_dec, w->m_convert, resample,
+			w->m_rg, sink, NULL);
+	gst_element_link_many(w->m_convert, resample, w->m_rg, sink, NULL);
+	g_signal_connect(w->m_dec, "pad-added", (GCallback)rga_on_pad_added, w);
+	return TRUE;
+} /* End of 'rga_worker_init' function */
+
+/* Analyze a file. Album results are obtained with the last album track */
+static bool_t rga_analyze_file( rga_worker_t *w, const char *filename,
+		rga_entry_t *e )
+{
+	GstBus *bus;
+	gchar *uri;
+	bool_t has_track = FALSE, finished = FALSE, ok = FALSE;
+
+	uri = gst_filename_to_uri(filename, NULL);
+	if (uri == NULL)
+		return FALSE;
+	g_object_set(G_OBJECT(w->m_dec), "uri", uri, NULL);
+	g_free(uri);
+	if (gst_element_set_state(w->m_pipeline, GST_STATE_PLAYING) ==
+			GST_STATE_CHANGE_FAILURE)
+	{
+		gst_element_set_state(w->m_pipeline, GST_STATE_READY);
+		return FALSE;
+	}
+
+	/* Wait for the end checking for stop request from time to time */
+	bus = gst_pipeline_get_bus(GST_PIPELINE(w->m_pipeline));
+	while (!finished && !rga_stop)
+	{
+		GstMessage *msg = gst_bus_timed_pop_filtered(bus, 200 * GST_MSECOND,
+				GST_MESSAGE_EOS | GST_MESSAGE_ERROR | GST_MESSAGE_TAG);
+		if (msg == NULL)
+			continue;
+
+		switch (GST_MESSAGE_TYPE(msg))
+		{
+		case GST_MESSAGE_TAG:
+			{
+				GstTagList *tags = NULL;
+				gdouble v;
+
+				/* Results come last so they override tags found in the file */
+				gst_message_parse_tag(msg, &tags);
+				if (gst_tag_list_get_double(tags, GST_TAG_TRACK_GAIN, &v))
+				{
+					e->m_track_gain = v;
+					has_track = TRUE;
+				}
+				if (gst_tag_list_get_double(tags, GST_TAG_TRACK_PEAK, &v))
+					e->m_track_peak = v;
+				if (gst_tag_list_get_double(tags, GST_TAG_ALBUM_GAIN, &v))
+				{
+					e->m_album_gain = v;
+					e->m_has_album = TRUE;
+				}
+				if (gst_tag_list_get_double(tags, GST_TAG_ALBUM_PEAK, &v))
+					e->m_album_peak = v;
+				gst_tag_list_unref(tags);
+			}
+			break;
+		case GST_MESSAGE_EOS:
+			ok = has_track;
+			finished = TRUE;
+			break;
+		case GST_MESSAGE_ERROR:
+			logger_debug(player_log, "ReplayGain: unable to decode %s", filename);
+			finished = TRUE;
+			break;
+		default:
+			break;
+		}
+		gst_message_unref(msg);
+	}
+	gst_object_unref(bus);
+
+	/* Album state of rganalysis is kept in READY */
+	gst_element_set_state(w->m_pipeline, GST_STATE_READY);
+	return ok;
+} /* End of 'rga_analyze_file' function */
+
+/* Process a job */
+static void rga_process_job( rga_worker_t *w, rga_job_t *job )
+{
+	rga_entry_t *res;
+	bool_t *ok;
+	int i, album = -1, num_cached = 0, num_tracks = 0;
+	bool_t album_failed = FALSE;
+
+	res = (rga_entry_t *)calloc(job->m_num_files, sizeof(*res));
+	ok = (bool_t *)calloc(job->m_num_files, sizeof(*ok));
+	if (res == NULL || ok == NULL)
+	{
+		free(res);
+		free(ok);
+		return;
+	}
+
+	/* Album is analysed only as a whole */
+	for ( i = 0; i < job->m_num_files; i ++ )
+	{
+		rga_entry_t e;
+		if (rga_lookup(job->m_files[i], &e) &&
+				(e.m_has_album || job->m_num_files == 1))
+			num_cached ++;
+	}
+	if (num_cached == job->m_num_files)
+	{
+		for ( i = 0; i < job->m_num_files; i ++ )
+			rga_progress(job, TRUE);
+		free(res);
+		free(ok);
+		return;
+	}
+
+	/* Files that are gone are left out of the album, so that the
+	 * analyzer gets all the tracks it is told about */
+	for ( i = 0; i < job->m_num_files; i ++ )
+	{
+		struct stat st;
+
+		if (stat(job->m_files[i], &st))
+		{
+			res[i].m_mtime = -1;
+			rga_progress(job, FALSE);
+			continue;
+		}
+		res[i].m_mtime = st.st_mtime;
+		num_tracks ++;
+	}
+
+	g_object_set(G_OBJECT(w->m_rg), "num-tracks", num_tracks, NULL);
+	for ( i = 0; i < job->m_num_files && !rga_stop; i ++ )
+	{
+		if (res[i].m_mtime == -1)
+			continue;
+		ok[i] = rga_analyze_file(w, job->m_files[i], &res[i]);
+		if (!ok[i] && !album_failed && num_tracks > 1)
+		{
+			logger_message(player_log, 1,
+					_("ReplayGain: %s failed, album gain is not computed"),
+					job->m_files[i]);
+			album_failed = TRUE;
+		}
+		if (ok[i] && res[i].m_has_album && !album_failed)
+			album = i;
+		rga_progress(job, ok[i]);
+	}
+	gst_element_set_state(w->m_pipeline, GST_STATE_NULL);
+
+	/* Album gain is only valid if the analyzer has seen all the tracks */
+	if (album_failed || rga_stop)
+		album = -1;
+
+	/* Store results */
+	for ( i = 0; i < job->m_num_files; i ++ )
+	{
+		if (!ok[i])
+			continue;
+		if (album >= 0)
+		{
+			res[i].m_album_gain = res[album].m_album_gain;
+			res[i].m_album_peak = res[album].m_album_peak;
+			res[i].m_has_album = TRUE;
+		}
+		else if (album_failed)
+			res[i].m_has_album = FALSE;
+		rga_cache_put(job->m_files[i], &res[i]);
+	}
+	free(res);
+	free(ok);
+} /* End of 'rga_process_job' function */
+
+/* Get a job from the queue waiting for it. Returns NULL on stop */
+static rga_job_t *rga_pop( void )
+{
+	rga_job_t *job;
+
+	pthread_mutex_lock(&rga_mutex);
+	while (rga_head == NULL && !rga_stop)
+		pthread_cond_wait(&rga_cond, &rga_mutex);
+	if (rga_stop)
+	{
+		pthread_mutex_unlock(&rga_mutex);
+		return NULL;
+	}
+	job = rga_head;
+	rga_head = job->m_next;
+	if (rga_head == NULL)
+		rga_tail = NULL;
+	pthread_mutex_unlock(&rga_mutex);
+	return job;
+} /* End of 'rga_pop' function */
+
+/* Worker thread function */
+static void *rga_thread( void *arg )
+{
+	rga_worker_t w;
+
+	if (!rga_worker_init(&w))
+		return NULL;
+	for ( ;; )
+	{
+		rga_job_t *job = rga_pop();
+		if (job == NULL)
+			break;
+		rga_process_job(&w, job);
+		rga_job_free(job);
+	}
+	gst_element_set_state(w.m_pipeline, GST_STATE_NULL);
+	gst_object_unref(w.m_pipeline);
+	return NULL;
+} /* End of 'rga_thread' function */
+
+/* Start worker threads if not yet (queue must be locked) */
+static void rga_start_workers( void )
+{
+	int num = cfg_get_var_int(cfg_list, "rgain-workers");
+
+	if (num < 1)
+		num = 1;
+	else if (num > RGA_MAX_WORKERS)
+		num = RGA_MAX_WORKERS;
+	for ( ; rga_num_workers < num; rga_num_workers ++ )
+	{
+		if (pthread_create(&rga_tids[rga_num_workers], NULL, rga_thread, NULL))
+		{
+			logger_error(player_log, 1,
+					_("ReplayGain: unable to create analyzer thread"));
+			break;
+		}
+	}
+} /* End of 'rga_start_workers' function */
+
+/* Is file in the same directory as the other one? */
+static bool_t rga_same_dir( const char *f1, const char *f2 )
+{
+	const char *s1 = strrchr(f1, '/'), *s2 = strrchr(f2, '/');
+	int len1 = (s1 == NULL) ? 0 : s1 - f1, len2 = (s2 == NULL) ? 0 : s2 - f2;
+
+	return (len1 == len2 && !strncmp(f1, f2, len1));
+} /* End of 'rga_same_dir' function */
+
+/* Append file to the job */
+static bool_t rga_job_add( rga_job_t *job, const char *filename )
+{
+	/* Grow files array by doubling */
+	if ((job->m_num_files & (job->m_num_files - 1)) == 0)
+	{
+		int size = (job->m_num_files == 0) ? 1 : 2 * job->m_num_files;
+		char **files = (char **)realloc(job->m_files, size * sizeof(char *));
+		if (files == NULL)
+			return FALSE;
+		job->m_files = files;
+	}
+	job->m_files[job->m_num_files] = strdup(filename);
+	if (job->m_files[job->m_num_files] == NULL)
+		return FALSE;
+	job->m_num_files ++;
+	return TRUE;
+} /* End of 'rga_job_add' function */
+
+/* Queue all play list files for analysis. Pending jobs of a previous
+ * request are replaced */
+void rga_push_plist( plist_t *pl )
+{
+	rga_job_t *head = NULL, *tail = NULL, *job = NULL;
+	const char *prev = NULL;
+	int i, total = 0;
+
+	/* Build jobs */
+	plist_lock(pl);
+	for ( i = 0; i < pl->m_len; i ++ )
+	{
+		const char *name = pl->m_list[i]->m_filename;
+
+		/* Only local files; slices of a file are analysed once */
+		if (name == NULL || (prev != NULL && !strcmp(prev, name)))
+			continue;
+		if (job == NULL || !rga_same_dir(job->m_files[0], name))
+		{
+			job = (rga_job_t *)calloc(1, sizeof(*job));
+			if (job == NULL)
+				break;
+			if (!rga_job_add(job, name))
+			{
+				rga_job_free(job);
+				break;
+			}
+			if (tail == NULL)
+				head = job;
+			else
+				tail->m_next = job;
+			tail = job;
+		}
+		else if (!rga_job_add(job, name))
+			break;
+		prev = job->m_files[job->m_num_files - 1];
+		total ++;
+	}
+	plist_unlock(pl);
+
+	/* Queue them */
+	pthread_mutex_lock(&rga_mutex);
+	rga_batch ++;
+	for ( job = head; job != NULL; job = job->m_next )
+		job->m_batch = rga_batch;
+	rga_clear_queue();
+	rga_head = head;
+	rga_tail = tail;
+	rga_total = total;
+	rga_done = rga_failed = 0;
+	rga_start_time = rga_report_time = g_get_monotonic_time();
+	logger_message(player_log, 1, _("ReplayGain: %d tracks queued for analysis"),
+			total);
+	rga_start_workers();
+	pthread_cond_broadcast(&rga_cond);
+	pthread_mutex_unlock(&rga_mutex);
+} /* End of 'rga_push_plist' function */
+
+/* End of 'rg_analyzer.c' file */
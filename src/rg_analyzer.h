@@ -0,0 +1,79 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Interface for ReplayGain analyzer.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#ifndef __SG_MPFC_RG_ANALYZER_H__
+#define __SG_MPFC_RG_ANALYZER_H__
+
+#include <time.h>
+#include "types.h"
+#include "plist.h"
+
+/* Maximal number of analyzer threads */
+#define RGA_MAX_WORKERS 16
+
+/* Analysis job: files of one album. Consecutive play list songs from
+ * the same directory are considered an album */
+typedef struct tag_rga_job_t
+{
+	char **m_files;
+	int m_num_files;
+
+	/* Request the job belongs to */
+	unsigned m_batch;
+
+	struct tag_rga_job_t *m_next;
+} rga_job_t;
+
+/* Analysis results of a file */
+typedef struct
+{
+	/* File modification time the results are valid for */
+	time_t m_mtime;
+
+	/* Gains (in dB) and peaks */
+	double m_track_gain, m_track_peak;
+	double m_album_gain, m_album_peak;
+	bool_t m_has_album;
+} rga_entry_t;
+
+/* Initialize analyzer */
+bool_t rga_init( void );
+
+/* Stop analysis and free analyzer */
+void rga_free( void );
+
+/* Queue all play list files for analysis */
+void rga_push_plist( plist_t *pl );
+
+/* Get cached results for a file. Fails if file has changed since */
+bool_t rga_lookup( const char *filename, rga_entry_t *entry );
+
+/* Get cached results for a file without touching the file and without
+ * waiting for the cache to be read */
+bool_t rga_lookup_cached( const char *filename, rga_entry_t *entry );
+
+/* Get volume scale for a file according to the 'rgain-mode' setting */
+double rga_volume_scale( const char *filename );
+
+#endif
+
+/* End of 'rg_analyzer.h' file */
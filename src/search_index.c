@@ -0,0 +1,531 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Play list search index implementation.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "types.h"
+#include "search_index.h"
+#include "song.h"
+
+/* Growing array of trigrams */
+typedef struct
+{
+	guint32 *m_tris;
+	int m_num, m_capacity;
+} sidx_tris_t;
+
+/* All the indices (for passing changed songs to them) */
+static GSList *sidx_all = NULL;
+static pthread_mutex_t sidx_all_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Free posting list */
+static void sidx_posting_free( gpointer data )
+{
+	sidx_posting_t *p = (sidx_posting_t *)data;
+	free(p->m_ids);
+	free(p);
+} /* End of 'sidx_posting_free' function */
+
+/* Create an index */
+sidx_t *sidx_new( void )
+{
+	sidx_t *idx = (sidx_t *)malloc(sizeof(*idx));
+	if (idx == NULL)
+		return NULL;
+	memset(idx, 0, sizeof(*idx));
+	idx->m_song_docs = g_hash_table_new(g_direct_hash, g_direct_equal);
+	idx->m_postings = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, sidx_posting_free);
+	idx->m_pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+	pthread_mutex_init(&idx->m_mutex, NULL);
+
+	pthread_mutex_lock(&sidx_all_mutex);
+	sidx_all = g_slist_prepend(sidx_all, idx);
+	pthread_mutex_unlock(&sidx_all_mutex);
+	return idx;
+} /* End of 'sidx_new' function */
+
+/* Free index */
+void sidx_free( sidx_t *idx )
+{
+	if (idx == NULL)
+		return;
+
+	pthread_mutex_lock(&sidx_all_mutex);
+	sidx_all = g_slist_remove(sidx_all, idx);
+	pthread_mutex_unlock(&sidx_all_mutex);
+
+	g_hash_table_destroy(idx->m_song_docs);
+	g_hash_table_destroy(idx->m_postings);
+	g_hash_table_destroy(idx->m_pending);
+	pthread_mutex_destroy(&idx->m_mutex);
+	free(idx->m_docs);
+	free(idx);
+} /* End of 'sidx_free' function */
+
+/* Pack three (case folded) bytes */
+static inline guint32 sidx_trigram( const char *s )
+{
+	return ((guint32)(guchar)g_ascii_tolower(s[0]) << 16) |
+		((guint32)(guchar)g_ascii_tolower(s[1]) << 8) |
+		(guint32)(guchar)g_ascii_tolower(s[2]);
+} /* End of 'sidx_trigram' function */
+
+/* Append a trigram */
+static void sidx_tris_add( sidx_tris_t *t, guint32 tri )
+{
+	if (t->m_num == t->m_capacity)
+	{
+		int capacity = t->m_capacity ? 2 * t->m_capacity : 64;
+		guint32 *tris = (guint32 *)realloc(t->m_tris, capacity * sizeof(guint32));
+		if (tris == NULL)
+			return;
+		t->m_tris = tris;
+		t->m_capacity = capacity;
+	}
+	t->m_tris[t->m_num ++] = tri;
+} /* End of 'sidx_tris_add' function */
+
+/* Append trigrams of a text */
+static void sidx_tris_add_text( sidx_tris_t *t, const char *text )
+{
+	if (text == NULL)
+		return;
+	for ( ; text[0] && text[1] && text[2]; text ++ )
+		sidx_tris_add(t, sidx_trigram(text));
+} /* End of 'sidx_tris_add_text' function */
+
+/* Compare trigrams */
+static int sidx_tri_cmp( const void *a, const void *b )
+{
+	guint32 x = *(const guint32 *)a, y = *(const guint32 *)b;
+	return (x > y) - (x < y);
+} /* End of 'sidx_tri_cmp' function */
+
+/* Sort trigrams and remove duplicates */
+static void sidx_tris_unique( sidx_tris_t *t )
+{
+	int i, n = 0;
+
+	if (t->m_num == 0)
+		return;
+	qsort(t->m_tris, t->m_num, sizeof(guint32), sidx_tri_cmp);
+	for ( i = 1; i < t->m_num; i ++ )
+	{
+		if (t->m_tris[i] != t->m_tris[n])
+			t->m_tris[++ n] = t->m_tris[i];
+	}
+	t->m_num = n + 1;
+} /* End of 'sidx_tris_unique' function */
+
+/* Index a song as a new document (index must be locked) */
+static void sidx_index_song( sidx_t *idx, song_t *song, int refs )
+{
+	sidx_tris_t t = { NULL, 0, 0 };
+	guint32 id;
+	int i;
+
+	if (idx->m_num_docs == idx->m_docs_capacity)
+	{
+		int capacity = idx->m_docs_capacity ? 2 * idx->m_docs_capacity : 256;
+		sidx_doc_t *docs = (sidx_doc_t *)realloc(idx->m_docs,
+				capacity * sizeof(sidx_doc_t));
+		if (docs == NULL)
+			return;
+		idx->m_docs = docs;
+		idx->m_docs_capacity = capacity;
+	}
+	id = idx->m_num_docs ++;
+	idx->m_docs[id].m_song = song;
+	idx->m_docs[id].m_refs = refs;
+	g_hash_table_insert(idx->m_song_docs, song, GUINT_TO_POINTER(id + 1));
+
+	/* Collect trigrams of the searched texts */
+	song_lock(song);
+	sidx_tris_add_text(&t, STR_TO_CPTR(song->m_title));
+	if (song->m_info != NULL)
+	{
+		sidx_tris_add_text(&t, song->m_info->m_name);
+		sidx_tris_add_text(&t, song->m_info->m_artist);
+		sidx_tris_add_text(&t, song->m_info->m_album);
+	}
+	song_unlock(song);
+	sidx_tris_unique(&t);
+
+	for ( i = 0; i < t.m_num; i ++ )
+	{
+		gpointer key = GUINT_TO_POINTER(t.m_tris[i]);
+		sidx_posting_t *p = (sidx_posting_t *)g_hash_table_lookup(
+				idx->m_postings, key);
+		if (p == NULL)
+		{
+			p = (sidx_posting_t *)calloc(1, sizeof(*p));
+			if (p == NULL)
+				continue;
+			g_hash_table_insert(idx->m_postings, key, p);
+		}
+		if (p->m_num == p->m_capacity)
+		{
+			int capacity = p->m_capacity ? 2 * p->m_capacity : 4;
+			guint32 *ids = (guint32 *)realloc(p->m_ids, capacity * sizeof(guint32));
+			if (ids == NULL)
+				continue;
+			p->m_ids = ids;
+			p->m_capacity = capacity;
+		}
+		p->m_ids[p->m_num ++] = id;
+	}
+	free(t.m_tris);
+} /* End of 'sidx_index_song' function */
+
+/* Mark song document dead and return its references count (index must
+ * be locked) */
+static int sidx_kill_doc( sidx_t *idx, song_t *song )
+{
+	guint32 id = GPOINTER_TO_UINT(g_hash_table_lookup(idx->m_song_docs, song));
+	int refs;
+
+	if (id == 0)
+		return 0;
+	g_hash_table_remove(idx->m_song_docs, song);
+	refs = idx->m_docs[id - 1].m_refs;
+	idx->m_docs[id - 1].m_refs = 0;
+	idx->m_num_dead ++;
+	return refs;
+} /* End of 'sidx_kill_doc' function */
+
+/* Rebuild index if it has too many dead documents (index must be
+ * locked) */
+static void sidx_compact( sidx_t *idx )
+{
+	sidx_doc_t *docs;
+	int i, num;
+
+	if (idx->m_num_dead < SIDX_MIN_DEAD ||
+			idx->m_num_dead < idx->m_num_docs - idx->m_num_dead)
+		return;
+
+	docs = idx->m_docs;
+	num = idx->m_num_docs;
+	idx->m_docs = NULL;
+	idx->m_num_docs = idx->m_docs_capacity = idx->m_num_dead = 0;
+	g_hash_table_remove_all(idx->m_song_docs);
+	g_hash_table_remove_all(idx->m_postings);
+	for ( i = 0; i < num; i ++ )
+	{
+		if (docs[i].m_refs > 0)
+			sidx_index_song(idx, docs[i].m_song, docs[i].m_refs);
+	}
+	free(docs);
+} /* End of 'sidx_compact' function */
+
+/* Index again songs which have changed (index must be locked) */
+static void sidx_apply_pending( sidx_t *idx )
+{
+	GHashTable *pending;
+	GHashTableIter iter;
+	gpointer song;
+
+	pthread_mutex_lock(&sidx_all_mutex);
+	if (g_hash_table_size(idx->m_pending) == 0)
+	{
+		pthread_mutex_unlock(&sidx_all_mutex);
+		return;
+	}
+	pending = idx->m_pending;
+	idx->m_pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+	pthread_mutex_unlock(&sidx_all_mutex);
+
+	g_hash_table_iter_init(&iter, pending);
+	while (g_hash_table_iter_next(&iter, &song, NULL))
+	{
+		int refs = sidx_kill_doc(idx, (song_t *)song);
+		if (refs > 0)
+			sidx_index_song(idx, (song_t *)song, refs);
+	}
+	g_hash_table_destroy(pending);
+	sidx_compact(idx);
+} /* End of 'sidx_apply_pending' function */
+
+/* Index songs added to the list */
+void sidx_add( sidx_t *idx, song_t **songs, int num )
+{
+	int i;
+
+	pthread_mutex_lock(&idx->m_mutex);
+	sidx_apply_pending(idx);
+	for ( i = 0; i < num; i ++ )
+	{
+		guint32 id = GPOINTER_TO_UINT(g_hash_table_lookup(idx->m_song_docs,
+					songs[i]));
+		if (id != 0)
+			idx->m_docs[id - 1].m_refs ++;
+		else
+			sidx_index_song(idx, songs[i], 1);
+	}
+	pthread_mutex_unlock(&idx->m_mutex);
+} /* End of 'sidx_add' function */
+
+/* Forget songs removed from the list */
+void sidx_remove( sidx_t *idx, song_t **songs, int num )
+{
+	int i;
+
+	pthread_mutex_lock(&idx->m_mutex);
+	for ( i = 0; i < num; i ++ )
+	{
+		guint32 id = GPOINTER_TO_UINT(g_hash_table_lookup(idx->m_song_docs,
+					songs[i]));
+		if (id == 0)
+			continue;
+		if (idx->m_docs[id - 1].m_refs > 1)
+			idx->m_docs[id - 1].m_refs --;
+		else
+			sidx_kill_doc(idx, songs[i]);
+	}
+	sidx_compact(idx);
+	pthread_mutex_unlock(&idx->m_mutex);
+
+	/* Song pointers may be reused by new songs */
+	pthread_mutex_lock(&sidx_all_mutex);
+	for ( i = 0; i < num; i ++ )
+		g_hash_table_remove(idx->m_pending, songs[i]);
+	pthread_mutex_unlock(&sidx_all_mutex);
+} /* End of 'sidx_remove' function */
+
+/* Note that song title or info has changed */
+void sidx_touch( song_t *song )
+{
+	GSList *l;
+
+	pthread_mutex_lock(&sidx_all_mutex);
+	for ( l = sidx_all; l != NULL; l = l->next )
+		g_hash_table_add(((sidx_t *)l->data)->m_pending, song);
+	pthread_mutex_unlock(&sidx_all_mutex);
+} /* End of 'sidx_touch' function */
+
+/* Get trigrams every match of a basic regular expression contains.
+ * Returns FALSE if pattern is too complex to tell */
+static bool_t sidx_pattern_trigrams( const char *pattern, bool_t nocase,
+		sidx_tris_t *t )
+{
+	char *run = (char *)malloc(strlen(pattern) + 1);
+	int run_len = 0;
+	const char *p = pattern;
+
+	if (run == NULL)
+		return FALSE;
+	if (*p == '^')
+		p ++;
+
+#define SIDX_END_RUN() \
+	do { \
+		int i; \
+		for ( i = 0; i + 2 < run_len; i ++ ) \
+		{ \
+			/* Case folding of other characters may change their bytes */ \
+			if (nocase && ((run[i] | run[i + 1] | run[i + 2]) & 0x80)) \
+				continue; \
+			sidx_tris_add(t, sidx_trigram(&run[i])); \
+		} \
+		run_len = 0; \
+	} while (0)
+
+	for ( ; *p; p ++ )
+	{
+		switch (*p)
+		{
+		/* Repeated atom may be absent */
+		case '*':
+			if (run_len > 0)
+				run_len --;
+			SIDX_END_RUN();
+			break;
+
+		/* Bracket expression */
+		case '[':
+			SIDX_END_RUN();
+			p ++;
+			if (*p == '^')
+				p ++;
+			if (*p == ']')
+				p ++;
+			for ( ; *p && *p != ']'; p ++ )
+			{
+				if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '='))
+				{
+					char term = p[1];
+					for ( p += 2; *p && !(*p == term && p[1] == ']'); p ++ );
+					if (*p)
+						p ++;
+				}
+			}
+			if (!*p)
+				p --;
+			break;
+
+		case '.':
+		case '^':
+		case '$':
+			SIDX_END_RUN();
+			break;
+
+		case '\\':
+			p ++;
+			if (*p == 0)
+			{
+				p --;
+				break;
+			}
+
+			/* Groups and alternatives are not analyzed */
+			if (*p == '(' || *p == ')' || *p == '|')
+			{
+				free(run);
+				return FALSE;
+			}
+			if (*p == '{' || *p == '?')
+			{
+				if (run_len > 0)
+					run_len --;
+				SIDX_END_RUN();
+
+				/* Skip interval bounds */
+				if (*p == '{')
+				{
+					for ( ; p[1] && !(p[0] == '\\' && p[1] == '}'); p ++ );
+					if (p[1])
+						p ++;
+				}
+			}
+			else if (strchr("}+<>bBwWsS`'123456789", *p) != NULL)
+				SIDX_END_RUN();
+			else
+				run[run_len ++] = *p;
+			break;
+
+		default:
+			/* Character followed by '*' is optional; that is handled
+			 * when the star is met */
+			run[run_len ++] = *p;
+			break;
+		}
+	}
+	SIDX_END_RUN();
+#undef SIDX_END_RUN
+
+	free(run);
+	sidx_tris_unique(t);
+	return (t->m_num > 0);
+} /* End of 'sidx_pattern_trigrams' function */
+
+/* Check if a sorted list contains a document */
+static bool_t sidx_posting_has( sidx_posting_t *p, guint32 id )
+{
+	int lo = 0, hi = p->m_num - 1;
+
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (p->m_ids[mid] == id)
+			return TRUE;
+		else if (p->m_ids[mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return FALSE;
+} /* End of 'sidx_posting_has' function */
+
+/* Compare posting lists by length */
+static int sidx_posting_cmp( const void *a, const void *b )
+{
+	return (*(sidx_posting_t * const *)a)->m_num -
+		(*(sidx_posting_t * const *)b)->m_num;
+} /* End of 'sidx_posting_cmp' function */
+
+/* Get songs which may match a pattern (basic regular expression).
+ * Returns NULL if index can't narrow the search */
+song_t **sidx_query( sidx_t *idx, const char *pattern, bool_t nocase,
+		int *num )
+{
+	sidx_tris_t t = { NULL, 0, 0 };
+	sidx_posting_t **lists;
+	song_t **songs = NULL;
+	int i, j;
+
+	*num = 0;
+	if (!sidx_pattern_trigrams(pattern, nocase, &t))
+	{
+		free(t.m_tris);
+		return NULL;
+	}
+
+	lists = (sidx_posting_t **)malloc(t.m_num * sizeof(*lists));
+	if (lists == NULL)
+	{
+		free(t.m_tris);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&idx->m_mutex);
+	sidx_apply_pending(idx);
+	for ( i = 0; i < t.m_num; i ++ )
+	{
+		lists[i] = (sidx_posting_t *)g_hash_table_lookup(idx->m_postings,
+				GUINT_TO_POINTER(t.m_tris[i]));
+
+		/* Nothing contains this trigram */
+		if (lists[i] == NULL)
+			break;
+	}
+
+	songs = (song_t **)malloc(sizeof(song_t *) *
+			(i < t.m_num ? 1 : lists[0]->m_num + 1));
+	if (songs != NULL && i == t.m_num)
+	{
+		/* Check the shortest list documents against the others */
+		qsort(lists, t.m_num, sizeof(*lists), sidx_posting_cmp);
+		for ( i = 0; i < lists[0]->m_num; i ++ )
+		{
+			guint32 id = lists[0]->m_ids[i];
+			if (idx->m_docs[id].m_refs == 0)
+				continue;
+			for ( j = 1; j < t.m_num; j ++ )
+			{
+				if (!sidx_posting_has(lists[j], id))
+					break;
+			}
+			if (j == t.m_num)
+				songs[(*num) ++] = idx->m_docs[id].m_song;
+		}
+	}
+	pthread_mutex_unlock(&idx->m_mutex);
+
+	free(lists);
+	free(t.m_tris);
+	return songs;
+} /* End of 'sidx_query' function */
+
+/* End of 'search_index.c' file */
@@ -0,0 +1,92 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Interface for play list search index.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#ifndef __SG_MPFC_SEARCH_INDEX_H__
+#define __SG_MPFC_SEARCH_INDEX_H__
+
+#include <pthread.h>
+#include <glib.h>
+#include "types.h"
+#include "main_types.h"
+
+/* Index is rebuilt when there are more dead documents than this and
+ * than the live ones */
+#define SIDX_MIN_DEAD 1024
+
+/* Songs containing a trigram. Document ids grow, so the list is sorted */
+typedef struct
+{
+	guint32 *m_ids;
+	int m_num, m_capacity;
+} sidx_posting_t;
+
+/* Indexed song. Document is dead when the song is no more in the list
+ * or has been indexed again */
+typedef struct
+{
+	song_t *m_song;
+
+	/* Number of times the song is in the list */
+	int m_refs;
+} sidx_doc_t;
+
+/* Trigram index over song titles, names, artists and albums */
+typedef struct tag_sidx_t
+{
+	sidx_doc_t *m_docs;
+	int m_num_docs, m_docs_capacity, m_num_dead;
+
+	/* Song -> document id + 1 */
+	GHashTable *m_song_docs;
+
+	/* Trigram -> posting list */
+	GHashTable *m_postings;
+
+	/* Songs whose title or info has changed (under the global lock) */
+	GHashTable *m_pending;
+
+	pthread_mutex_t m_mutex;
+} sidx_t;
+
+/* Create an index */
+sidx_t *sidx_new( void );
+
+/* Free index */
+void sidx_free( sidx_t *idx );
+
+/* Index songs added to the list */
+void sidx_add( sidx_t *idx, song_t **songs, int num );
+
+/* Forget songs removed from the list */
+void sidx_remove( sidx_t *idx, song_t **songs, int num );
+
+/* Note that song title or info has changed */
+void sidx_touch( song_t *song );
+
+/* Get songs which may match a pattern (basic regular expression).
+ * Returns NULL if index can't narrow the search */
+song_t **sidx_query( sidx_t *idx, const char *pattern, bool_t nocase,
+		int *num );
+
+#endif
+
+/* End of 'search_index.h' file */
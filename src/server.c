@@ -66,6 +66,7 @@ server_conn_desc_t *server_conn_desc_new( int sock )
 
 	conn_desc->m_socket = sock;
 	conn_desc->m_buf[0] = 0;
+	conn_desc->m_want_time = FALSE;
 	conn_desc->m_cur_cmd = str_new("");
 	if (!conn_desc->m_cur_cmd)
 	{
@@ -330,6 +331,8 @@ static void server_hook_handler( char *hook )
 		nv = SERVER_NOTIFY_PLAYLIST;
 	else if (!strcmp(hook, "player-status"))
 		nv = SERVER_NOTIFY_STATUS;
+	else if (!strcmp(hook, "player-time"))
+		nv = SERVER_NOTIFY_TIME;
 	else
 		return;
 
@@ -337,6 +340,9 @@ static void server_hook_handler( char *hook )
 	pthread_mutex_lock(&server_mutex);
 	for ( conn = server_conns; conn; conn = conn->m_next )
 	{
+		/* Time notifications are sent only to those who asked */
+		if (nv == SERVER_NOTIFY_TIME && !conn->m_want_time)
+			continue;
 		server_conn_notify(conn, nv);
 	}
 	pthread_mutex_unlock(&server_mutex);
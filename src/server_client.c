@@ -31,6 +31,7 @@
 #include <json-glib/json-glib.h>
 #include "file_utils.h"
 #include "json_helpers.h"
+#include "latency.h"
 #include "player.h"
 #include "server_client.h"
 #include "util.h"
@@ -142,6 +143,9 @@ void server_conn_notification_msg(char nv, char *msg, int buf_size)
 		case SERVER_NOTIFY_STATUS:
 			strncpy(msg, "status", buf_size);
 			break;
+		case SERVER_NOTIFY_TIME:
+			strncpy(msg, "time", buf_size);
+			break;
 		default:
 			strncpy(msg, "", buf_size);
 			break;
@@ -287,6 +291,15 @@ bool_t server_conn_exec_command(server_conn_desc_t *d)
 		int song = (param_kind == PARAM_NUMBER ? param.num_param : 0);
 		player_start_play(song, 0);
 	}
+	else if (!strcmp(cmd_name, "play_id"))
+	{
+		if (param_kind == PARAM_NUMBER)
+		{
+			int pos = plist_find_id(player_plist, (song_id_t)param.num_param);
+			if (pos >= 0)
+				player_start_play(pos, 0);
+		}
+	}
 	else if (!strcmp(cmd_name, "resume"))
 	{
 		player_pause_resume();
@@ -311,6 +324,14 @@ bool_t server_conn_exec_command(server_conn_desc_t *d)
 	{
 		player_time_back();
 	}
+	else if (!strcmp(cmd_name, "subscribe_time"))
+	{
+		d->m_want_time = TRUE;
+	}
+	else if (!strcmp(cmd_name, "unsubscribe_time"))
+	{
+		d->m_want_time = FALSE;
+	}
 	else if (!strcmp(cmd_name, "get_cur_song"))
 	{
 		JsonObject *js = json_object_new();
@@ -321,6 +342,7 @@ bool_t server_conn_exec_command(server_conn_desc_t *d)
 		{
 			const char *status = "";
 			song_t *s = player_plist->m_list[cur_song];
+			json_object_set_int_member(js, "id", s->m_id);
 			json_object_set_string_member(js, "title", STR_TO_CPTR(s->m_title));
 			json_object_set_int_member(js, "time", player_context->m_cur_time);
 			json_object_set_int_member(js, "length", s->m_len);
@@ -344,6 +366,7 @@ bool_t server_conn_exec_command(server_conn_desc_t *d)
 		{
 			JsonObject *js_child = json_object_new();
 			song_t *s = player_plist->m_list[i];
+			json_object_set_int_member(js_child, "id", s->m_id);
 			json_object_set_string_member(js_child, "title", STR_TO_CPTR(s->m_title));
 			json_object_set_int_member(js_child, "length", s->m_len);
 
@@ -358,6 +381,33 @@ bool_t server_conn_exec_command(server_conn_desc_t *d)
 		json_object_set_double_member(js, "volume", player_context->m_volume);
 		server_conn_response(d, js_make_node(js));
 	}
+	else if (!strcmp(cmd_name, "get_latency"))
+	{
+		JsonObject *js = json_object_new(), *js_auto = json_object_new();
+		int r, i;
+
+		/* User requests are at the top, track advances under 'auto' */
+		for ( r = 0; r < LAT_NUM_REQS; r ++ )
+			for ( i = 0; i < LAT_NUM_EVENTS; i ++ )
+			{
+				JsonObject *js_ev = json_object_new();
+				lat_stats_t st;
+
+				lat_get_stats(r, i, &st);
+				json_object_set_int_member(js_ev, "count", st.m_count);
+				json_object_set_int_member(js_ev, "min", st.m_min);
+				json_object_set_int_member(js_ev, "mean", 
+						st.m_count ? st.m_sum / (gint64)st.m_count : 0);
+				json_object_set_int_member(js_ev, "p50", st.m_p50);
+				json_object_set_int_member(js_ev, "p95", st.m_p95);
+				json_object_set_int_member(js_ev, "max", st.m_max);
+				json_object_set_object_member(
+						(r == LAT_REQ_USER) ? js : js_auto, 
+						lat_event_name(i), js_ev);
+			}
+		json_object_set_object_member(js, lat_req_name(LAT_REQ_AUTO), js_auto);
+		server_conn_response(d, js_make_node(js));
+	}
 	else if (!strcmp(cmd_name, "set_volume"))
 	{
 		if (param_kind == PARAM_NUMBER)
@@ -391,6 +441,20 @@ bool_t server_conn_exec_command(server_conn_desc_t *d)
 			plist_rem(player_plist);
 		}
 	}
+	else if (!strcmp(cmd_name, "remove_id"))
+	{
+		if (param_kind == PARAM_NUMBER)
+		{
+			int pos = plist_find_id(player_plist, (song_id_t)param.num_param);
+			if (pos >= 0)
+			{
+				/* Position may be out of the filtered view, so the
+				 * selection is set directly */
+				player_plist->m_sel_start = player_plist->m_sel_end = pos;
+				plist_rem(player_plist);
+			}
+		}
+	}
 	else if (!strcmp(cmd_name, "queue"))
 	{
 		if (param_kind == PARAM_NUMBER)
@@ -400,6 +464,15 @@ bool_t server_conn_exec_command(server_conn_desc_t *d)
 			player_queue_song();
 		}
 	}
+	else if (!strcmp(cmd_name, "queue_id"))
+	{
+		if (param_kind == PARAM_NUMBER)
+		{
+			song_id_t id = (song_id_t)param.num_param;
+			if (plist_find_id(player_plist, id) >= 0)
+				pq_push(player_queue, id);
+		}
+	}
 	else if (!strcmp(cmd_name, "seek"))
 	{
 		if (param_kind == PARAM_NUMBER)
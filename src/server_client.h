@@ -38,6 +38,9 @@ typedef struct tag_server_conn_desc_t
 	int m_buf_pos;
 	str_t *m_cur_cmd;
 
+	/* Client has asked for play time notifications */
+	volatile bool_t m_want_time;
+
 	struct tag_server_conn_desc_t *m_next, *m_prev;
 } server_conn_desc_t;
 
@@ -47,6 +50,7 @@ enum
 	SERVER_NOTIFY_EXIT = 0,
 	SERVER_NOTIFY_PLAYLIST,
 	SERVER_NOTIFY_STATUS,
+	SERVER_NOTIFY_TIME,
 };
 
 /* Send a notification to client */
@@ -25,14 +25,21 @@
 #include <gst/gst.h>
 #include "types.h"
 #include "cfg.h"
+#include "md_cache.h"
 #include "metadata_io.h"
 #include "mystring.h"
 #include "player.h"
+#include "plist.h"
 #include "pmng.h"
+#include "search_index.h"
 #include "song.h"
 #include "song_info.h"
 #include "util.h"
 
+/* Last song id given */
+static song_id_t song_last_id = 0;
+static pthread_mutex_t song_id_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static void song_set_sliced_len( song_t *song )
 {
 	song->m_len = (song->m_end_time > -1) ? 
@@ -48,6 +55,11 @@ static song_t *song_new( song_metadata_t *metadata )
 		return NULL;
 	memset(song, 0, sizeof(*song));
 
+	/* Songs are created by the directory walkers concurrently */
+	pthread_mutex_lock(&song_id_mutex);
+	song->m_id = ++ song_last_id;
+	pthread_mutex_unlock(&song_id_mutex);
+
 	song->m_start_time = song->m_end_time = -1;
 	song->m_len = song->m_full_len = metadata->m_len;
 	pthread_mutex_init(&song->m_mutex, NULL);
@@ -96,7 +108,16 @@ song_t *song_new_from_file( const char *filename, song_metadata_t *metadata )
 		ext++;
 	if (!pmng_search_format(player_pmng, filename, ext))
 		return NULL;
-	
+	return song_new_from_media(filename, metadata);
+} /* End of 'song_new_from_file' function */
+
+/* Create a new song from a file of a format already known to be
+ * supported */
+song_t *song_new_from_media( const char *filename, song_metadata_t *metadata )
+{
+	/* Must be an absolute path */
+	assert((*filename) == '/');
+
 	song_t *song = song_new(metadata);
 
 	/* Set various types of file name */
@@ -111,7 +132,7 @@ song_t *song_new_from_file( const char *filename, song_metadata_t *metadata )
 	song_set_title(song, metadata);
 
 	return song_add_ref(song);
-} /* End of 'song_new_from_file' function */
+} /* End of 'song_new_from_media' function */
 
 /* Create a new song from an URI */
 song_t *song_new_from_uri( const char *uri, song_metadata_t *metadata )
@@ -171,7 +192,10 @@ void song_set_info( song_t *song, song_info_t *si )
 		si_free(song->m_info);
 	song->m_info = si;
 
+	/* Index and filter views are told only when the new title is set */
 	song_update_title(song);
+	sidx_touch(song);
+	plist_song_title_changed(song);
 
 	song_unlock(song);
 }
@@ -201,9 +225,11 @@ void song_update_info( song_t *song )
 	{
 		song_set_sliced_len(song);
 	}
+	plist_song_len_changed(song);
 
 	song_update_title(song);
-	song->m_flags &= (~SONG_INFO_READ);
+	sidx_touch(song);
+	plist_song_title_changed(song);
 	song_unlock(song);
 } /* End of 'song_update_info' function */
 
@@ -329,13 +355,16 @@ void song_write_info( song_t *s )
 {
 	char *name = s->m_filename;
 	bool_t is_sliced = s->m_start_time > 0 || s->m_end_time >= 0;
+
+	/* Cached info is stale as soon as the file is touched */
+	if (name != NULL)
+		mdc_invalidate(name);
 	if (!name || is_sliced || !md_save_info(name, s->m_info))
 	{
 		song_update_info(s);
 		logger_error(player_log, 0, _("Failed to save info to file %s"),
 				s->m_fullname);
 	}
-	s->m_flags &= ~(SONG_INFO_READ | SONG_INFO_WRITE);
 } /* End of 'song_write_info' function */
 
 /* End of 'song.c' file */
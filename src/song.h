@@ -32,6 +32,10 @@
 /* Create a new song */
 song_t *song_new_from_file( const char *file, song_metadata_t *metadata );
 
+/* Create a new song from a file of a format already known to be
+ * supported */
+song_t *song_new_from_media( const char *file, song_metadata_t *metadata );
+
 /* Create a new song */
 song_t *song_new_from_uri( const char *uri, song_metadata_t *metadata);
 
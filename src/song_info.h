@@ -79,6 +79,9 @@ void si_set_genre( song_info_t *si, const char *genre );
 /* Set own data */
 void si_set_own_data( song_info_t *si, const char *own_data );
 
+/* Estimate amount of memory held by song info */
+size_t si_size( song_info_t *si );
+
 #endif
 
 /* End of 'song_info.h' file */
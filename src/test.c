@@ -21,11 +21,45 @@
  */
 
 #include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gst/gst.h>
 #include "types.h"
+#include "dsp.h"
 #include "player.h"
+#include "plist.h"
+#include "song.h"
 #include "test.h"
 #include "wnd_root.h"
 
+/* Decode benchmark measurements of a track (times are in us). Track is
+ * started when its URI is given to the pipeline, opened when the source
+ * for it is set up and takes over when its stream reaches the sink */
+typedef struct
+{
+	song_t *m_song;
+	gint64 m_start, m_open, m_take, m_first_buf, m_last_buf, m_end;
+	guint64 m_media_time;
+	bool_t m_failed;
+} test_bench_track_t;
+
+/* Decode benchmark state */
+typedef struct
+{
+	GstElement *m_pipeline;
+	test_bench_track_t *m_tracks;
+	int m_num_tracks;
+
+	/* Track being started by the bench loop and the one whose data
+	 * reaches the sink */
+	int m_started;
+	int m_sink_track;
+	bool_t m_gapless;
+
+	pthread_mutex_t m_mutex;
+} test_bench_t;
+
 /* Test thread data */
 pthread_t test_pid;
 bool_t test_stop_job = FALSE;
@@ -66,6 +100,12 @@ void *test_thread( void *arg )
 	case TEST_WNDLIB_PERFOMANCE:
 		test_wndlib_perfomance();
 		break;
+	case TEST_DSP_PERFOMANCE:
+		test_dsp_perfomance();
+		break;
+	case TEST_SORT_PERFOMANCE:
+		test_sort_perfomance();
+		break;
 	}
 	test_job = TEST_NO_JOB;
 	return NULL;
@@ -92,5 +132,434 @@ void test_wndlib_perfomance( void )
 	}
 } /* End of 'test_wndlib_perfomance' function */
 
+/* Effects benchmark buffer size (in frames) and number of passes */
+#define TEST_DSP_FRAMES 4096
+#define TEST_DSP_PASSES 2000
+
+/* Measure the built-in effects speed */
+void test_dsp_perfomance( void )
+{
+	dsp_t settings;
+	dsp_stream_t *s;
+	float *src, *buf;
+	int channels = 2, n = TEST_DSP_FRAMES * channels, effect, i;
+	gint64 start, copy_time;
+	double samples = (double)n * TEST_DSP_PASSES;
+
+	/* Every effect is set to do some real work */
+	memset(&settings, 0, sizeof(settings));
+	pthread_mutex_init(&settings.m_mutex, NULL);
+	for ( i = 0; i < DSP_EQ_BANDS; i ++ )
+		settings.m_eq_gains[i] = (i % 2) ? -6.f : 6.f;
+	settings.m_preamp = 2.f;
+	settings.m_limit = 0.9f;
+	s = dsp_stream_new(&settings);
+	src = (float *)malloc(n * sizeof(float));
+	buf = (float *)malloc(n * sizeof(float));
+	if (s == NULL || src == NULL || buf == NULL)
+		goto finally;
+	for ( i = 0; i < n; i ++ )
+		src[i] = ((rand() % 20001) - 10000) / 10000.f;
+
+	/* Processing nothing makes the stream pick up the settings */
+	dsp_process(s, buf, 0);
+	dsp_stream_set_format(s, 44100, channels);
+
+	/* Data is restored before every pass, so measure that separately */
+	start = g_get_monotonic_time();
+	for ( i = 0; i < TEST_DSP_PASSES; i ++ )
+		memcpy(buf, src, n * sizeof(float));
+	copy_time = g_get_monotonic_time() - start;
+
+	for ( effect = 0; effect < DSP_NUM_EFFECTS && !test_stop_job; effect ++ )
+	{
+		gint64 t;
+
+		start = g_get_monotonic_time();
+		for ( i = 0; i < TEST_DSP_PASSES && !test_stop_job; i ++ )
+		{
+			memcpy(buf, src, n * sizeof(float));
+			dsp_apply_effect(s, effect, buf, TEST_DSP_FRAMES);
+		}
+		t = g_get_monotonic_time() - start - copy_time;
+		logger_message(player_log, 1, _("Effect %s: %.2f ns per sample"),
+				dsp_effect_name(effect), (t > 0 ? t : 0) * 1000. / samples);
+	}
+
+finally:
+	free(src);
+	free(buf);
+	free(s);
+	pthread_mutex_destroy(&settings.m_mutex);
+} /* End of 'test_dsp_perfomance' function */
+
+/* Sort benchmark list sizes and the number of distinct songs (larger
+ * lists repeat them to keep memory usage sane) */
+static const int test_sort_sizes[] = { 10000, 100000, 1000000 };
+#define TEST_SORT_POOL 100000
+
+/* Create a song for the sort benchmark */
+static song_t *test_sort_song_new( int i )
+{
+	song_metadata_t metadata = SONG_METADATA_EMPTY;
+	char name[256], title[128], track[16];
+	song_t *s;
+
+	snprintf(name, sizeof(name), "file:///music/Artist %d/Album %d/%02d - Song %d.ogg",
+			(i / 120) % 500, i / 12, i % 12 + 1, rand());
+	snprintf(title, sizeof(title), "Artist %d - Song %d", rand() % 1000, rand());
+	snprintf(track, sizeof(track), "%d", i % 12 + 1);
+	metadata.m_title = title;
+	metadata.m_song_info = si_new();
+	if (metadata.m_song_info == NULL)
+		return NULL;
+	si_set_track(metadata.m_song_info, track);
+	s = song_new_from_uri(name, &metadata);
+	if (s == NULL)
+		si_free(metadata.m_song_info);
+	return s;
+} /* End of 'test_sort_song_new' function */
+
+/* Measure play list sorting speed */
+void test_sort_perfomance( void )
+{
+	static const int criteria[] = { PLIST_SORT_BY_TITLE, PLIST_SORT_BY_PATH,
+		PLIST_SORT_BY_TRACK };
+	static const char *criteria_names[] = { "title", "path", "path and track" };
+	int max = test_sort_sizes[G_N_ELEMENTS(test_sort_sizes) - 1];
+	int pool_size = 0, i, j, c;
+	song_t **pool, **list;
+
+	pool = (song_t **)malloc(sizeof(song_t *) * TEST_SORT_POOL);
+	list = (song_t **)malloc(sizeof(song_t *) * max);
+	if (pool == NULL || list == NULL)
+		goto finally;
+	for ( ; pool_size < TEST_SORT_POOL && !test_stop_job; pool_size ++ )
+	{
+		pool[pool_size] = test_sort_song_new(pool_size);
+		if (pool[pool_size] == NULL)
+			goto finally;
+	}
+
+	for ( i = 0; i < (int)G_N_ELEMENTS(test_sort_sizes) && !test_stop_job; i ++ )
+	{
+		int num = test_sort_sizes[i];
+
+		for ( c = 0; c < (int)G_N_ELEMENTS(criteria) && !test_stop_job; c ++ )
+		{
+			gint64 start;
+			bool_t ok;
+
+			for ( j = 0; j < num; j ++ )
+				list[j] = pool[rand() % pool_size];
+			start = g_get_monotonic_time();
+			ok = plist_sort_songs(list, num, criteria[c], NULL);
+			logger_message(player_log, 1, ok ? 
+					_("Sort by %s of %d songs: %.1f ms") :
+					_("Sort by %s of %d songs: out of memory"),
+					criteria_names[c], num, 
+					(g_get_monotonic_time() - start) / 1000.);
+		}
+	}
+
+finally:
+	for ( i = 0; i < pool_size; i ++ )
+		if (pool[i] != NULL)
+			song_free(pool[i]);
+	free(pool);
+	free(list);
+} /* End of 'test_sort_perfomance' function */
+
+/* Watch data reaching the benchmark sink */
+static GstPadProbeReturn test_bench_probe( GstPad *pad, GstPadProbeInfo *info,
+		gpointer data )
+{
+	test_bench_t *b = (test_bench_t *)data;
+	gint64 now = g_get_monotonic_time();
+	test_bench_track_t *t;
+
+	pthread_mutex_lock(&b->m_mutex);
+	if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM)
+	{
+		GstEvent *ev = GST_PAD_PROBE_INFO_EVENT(info);
+
+		/* New stream starts: previous one is over */
+		if (GST_EVENT_TYPE(ev) == GST_EVENT_STREAM_START &&
+				b->m_sink_track + 1 < b->m_num_tracks)
+		{
+			if (b->m_sink_track >= 0 && b->m_tracks[b->m_sink_track].m_end == 0)
+				b->m_tracks[b->m_sink_track].m_end = now;
+			t = &b->m_tracks[++ b->m_sink_track];
+			t->m_take = now;
+		}
+		else if (GST_EVENT_TYPE(ev) == GST_EVENT_EOS && b->m_sink_track >= 0)
+			b->m_tracks[b->m_sink_track].m_end = now;
+	}
+	else if (b->m_sink_track >= 0)
+	{
+		GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+
+		t = &b->m_tracks[b->m_sink_track];
+		if (t->m_first_buf == 0)
+			t->m_first_buf = now;
+		t->m_last_buf = now;
+		if (GST_BUFFER_DURATION_IS_VALID(buf))
+			t->m_media_time += GST_BUFFER_DURATION(buf);
+	}
+	pthread_mutex_unlock(&b->m_mutex);
+	return GST_PAD_PROBE_OK;
+} /* End of 'test_bench_probe' function */
+
+/* Queue the next track for gapless playback (called from a streaming thread) */
+static void test_bench_about_to_finish( GstElement *playbin, gpointer data )
+{
+	test_bench_t *b = (test_bench_t *)data;
+
+	pthread_mutex_lock(&b->m_mutex);
+	if (b->m_started + 1 < b->m_num_tracks)
+	{
+		test_bench_track_t *t = &b->m_tracks[++ b->m_started];
+		t->m_start = g_get_monotonic_time();
+		g_object_set(G_OBJECT(playbin), "uri", t->m_song->m_fullname, NULL);
+	}
+	pthread_mutex_unlock(&b->m_mutex);
+} /* End of 'test_bench_about_to_finish' function */
+
+/* Source for the track being started is created */
+static void test_bench_source_setup( GstElement *playbin, GstElement *source,
+		gpointer data )
+{
+	test_bench_t *b = (test_bench_t *)data;
+	test_bench_track_t *t;
+
+	pthread_mutex_lock(&b->m_mutex);
+	t = &b->m_tracks[b->m_started];
+	if (t->m_open == 0)
+		t->m_open = g_get_monotonic_time();
+	pthread_mutex_unlock(&b->m_mutex);
+} /* End of 'test_bench_source_setup' function */
+
+/* Run pipeline until the end of stream. Returns FALSE on error */
+static bool_t test_bench_run_pipeline( test_bench_t *b )
+{
+	GstBus *bus = gst_pipeline_get_bus(GST_PIPELINE(b->m_pipeline));
+	bool_t ok = TRUE;
+
+	if (gst_element_set_state(b->m_pipeline, GST_STATE_PLAYING) ==
+			GST_STATE_CHANGE_FAILURE)
+		ok = FALSE;
+	else
+	{
+		GstMessage *msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE,
+				GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+		if (GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR)
+		{
+			GError *error;
+			gchar *debug;
+
+			gst_message_parse_error(msg, &error, &debug);
+			fprintf(stderr, "%s\n", error->message);
+			g_error_free(error);
+			g_free(debug);
+			ok = FALSE;
+		}
+		gst_message_unref(msg);
+	}
+	gst_object_unref(bus);
+	gst_element_set_state(b->m_pipeline, GST_STATE_READY);
+	return ok;
+} /* End of 'test_bench_run_pipeline' function */
+
+/* Create benchmark audio sink */
+static GstElement *test_bench_sink( void )
+{
+	char *name = cfg_get_var(cfg_list, "bench-sink");
+	GstElement *sink;
+
+	if (name == NULL || *name == 0)
+		name = "fakesink";
+	sink = gst_element_factory_make(name, NULL);
+	if (sink == NULL)
+	{
+		fprintf(stderr, _("Audio sink %s could not be created\n"), name);
+		return NULL;
+	}
+
+	/* Decode as fast as possible */
+	if (g_object_class_find_property(G_OBJECT_GET_CLASS(sink), "sync"))
+		g_object_set(G_OBJECT(sink), "sync", FALSE, NULL);
+	return sink;
+} /* End of 'test_bench_sink' function */
+
+/* Print benchmark results */
+static void test_bench_report( test_bench_t *b, gint64 total_time )
+{
+	guint64 media = 0;
+	double open_sum = 0, ttfb_sum = 0, take_sum = 0;
+	int i, num_ok = 0, num_take = 0;
+
+	printf("%4s %10s %10s %10s %10s  %s\n", "#", "open, ms", "ttfb, ms",
+			"take, ms", "speed, x", "file");
+	for ( i = 0; i < b->m_num_tracks; i ++ )
+	{
+		test_bench_track_t *t = &b->m_tracks[i];
+		test_bench_track_t *prev = (i > 0) ? &b->m_tracks[i - 1] : NULL;
+		double open, ttfb, take = -1, speed;
+		gint64 from;
+		char take_str[32];
+
+		if (t->m_failed || t->m_open == 0 || t->m_take == 0 ||
+				t->m_first_buf == 0 || t->m_end == 0)
+		{
+			printf("%4d %10s %10s %10s %10s  %s\n", i + 1, "-", "-", "-", "-",
+					t->m_song->m_fullname);
+			continue;
+		}
+
+		/* Gapless track is opened while the previous one still plays,
+		 * so it is timed from the moment it takes over. Takeover is the
+		 * gap between the last buffer of the previous track and the
+		 * first buffer of this one */
+		from = t->m_start;
+		if (b->m_gapless && prev != NULL)
+		{
+			from = t->m_take;
+			if (prev->m_last_buf != 0)
+				take = (t->m_first_buf - prev->m_last_buf) / 1000.;
+		}
+		open = (t->m_open - t->m_start) / 1000.;
+		ttfb = (t->m_first_buf - from) / 1000.;
+		speed = (t->m_end > from) ?
+			(t->m_media_time / 1000.) / (t->m_end - from) : 0;
+		if (take >= 0)
+			snprintf(take_str, sizeof(take_str), "%.1f", take);
+		else
+			strcpy(take_str, "-");
+		printf("%4d %10.1f %10.1f %10s %10.1f  %s\n", i + 1, open, ttfb, 
+				take_str, speed, t->m_song->m_fullname);
+		open_sum += open;
+		ttfb_sum += ttfb;
+		if (take >= 0)
+		{
+			take_sum += take;
+			num_take ++;
+		}
+		media += t->m_media_time;
+		num_ok ++;
+	}
+
+	printf(_("\n%d of %d tracks decoded (%s mode) in %.2f s\n"), num_ok,
+			b->m_num_tracks, b->m_gapless ? "gapless" : "non-gapless",
+			total_time / (double)G_USEC_PER_SEC);
+	if (num_ok > 0 && total_time > 0)
+	{
+		printf(_("Average open latency %.1f ms, time to first buffer %.1f ms\n"),
+				open_sum / num_ok, ttfb_sum / num_ok);
+		if (num_take > 0)
+			printf(_("Average takeover time %.1f ms\n"), take_sum / num_take);
+		printf(_("Throughput %.1fx realtime, %.2f tracks/s\n"),
+				(media / 1000.) / total_time,
+				num_ok * (double)G_USEC_PER_SEC / total_time);
+	}
+} /* End of 'test_bench_report' function */
+
+/* Run play list songs through the player pipeline with a non-syncing 
+ * sink and report decoding speed. Works without the interface */
+bool_t test_decode_benchmark( plist_t *pl )
+{
+	test_bench_t b;
+	GstElement *sink;
+	GstPad *pad;
+	gint64 start;
+	int i;
+
+	/* Take each file once (slices of a file are decoded together) */
+	memset(&b, 0, sizeof(b));
+	b.m_tracks = (test_bench_track_t *)calloc(pl->m_len + 1, sizeof(*b.m_tracks));
+	if (b.m_tracks == NULL)
+		return FALSE;
+	for ( i = 0; i < pl->m_len; i ++ )
+	{
+		song_t *s = pl->m_list[i];
+		if (b.m_num_tracks > 0 && 
+				!strcmp(b.m_tracks[b.m_num_tracks - 1].m_song->m_fullname, s->m_fullname))
+			continue;
+		b.m_tracks[b.m_num_tracks ++].m_song = s;
+	}
+	if (b.m_num_tracks == 0)
+	{
+		fprintf(stderr, _("Nothing to decode\n"));
+		free(b.m_tracks);
+		return FALSE;
+	}
+
+	/* Build the pipeline the way the player does */
+	sink = test_bench_sink();
+	if (sink == NULL)
+	{
+		free(b.m_tracks);
+		return FALSE;
+	}
+	pad = gst_element_get_static_pad(sink, "sink");
+	b.m_pipeline = player_playbin_new(sink);
+	if (b.m_pipeline == NULL)
+	{
+		gst_object_unref(pad);
+		free(b.m_tracks);
+		return FALSE;
+	}
+	pthread_mutex_init(&b.m_mutex, NULL);
+	b.m_gapless = cfg_get_var_bool(cfg_list, "gapless-play");
+	b.m_sink_track = -1;
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | 
+			GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, test_bench_probe, &b, NULL);
+	gst_object_unref(pad);
+	g_signal_connect(b.m_pipeline, "source-setup", 
+			(GCallback)test_bench_source_setup, &b);
+	if (b.m_gapless)
+		g_signal_connect(b.m_pipeline, "about-to-finish", 
+				(GCallback)test_bench_about_to_finish, &b);
+
+	start = g_get_monotonic_time();
+	if (b.m_gapless)
+	{
+		/* All the tracks run in a single stream of the pipeline */
+		b.m_tracks[0].m_start = start;
+		g_object_set(G_OBJECT(b.m_pipeline), "uri", 
+				b.m_tracks[0].m_song->m_fullname, NULL);
+		if (!test_bench_run_pipeline(&b))
+		{
+			pthread_mutex_lock(&b.m_mutex);
+			for ( i = b.m_sink_track; i < b.m_num_tracks; i ++ )
+				if (i >= 0)
+					b.m_tracks[i].m_failed = TRUE;
+			pthread_mutex_unlock(&b.m_mutex);
+		}
+	}
+	else
+	{
+		/* Pipeline is reused, but each track is started anew */
+		for ( i = 0; i < b.m_num_tracks; i ++ )
+		{
+			test_bench_track_t *t = &b.m_tracks[i];
+
+			pthread_mutex_lock(&b.m_mutex);
+			b.m_sink_track = i - 1;
+			b.m_started = i;
+			t->m_start = g_get_monotonic_time();
+			pthread_mutex_unlock(&b.m_mutex);
+			g_object_set(G_OBJECT(b.m_pipeline), "uri", t->m_song->m_fullname, NULL);
+			t->m_failed = !test_bench_run_pipeline(&b);
+		}
+	}
+	test_bench_report(&b, g_get_monotonic_time() - start);
+
+	gst_element_set_state(b.m_pipeline, GST_STATE_NULL);
+	gst_object_unref(b.m_pipeline);
+	pthread_mutex_destroy(&b.m_mutex);
+	free(b.m_tracks);
+	return TRUE;
+} /* End of 'test_decode_benchmark' function */
+
 /* End of 'test.c' file */
 
@@ -24,12 +24,15 @@
 #define __SG_MPFC_TEST_H__
 
 #include "types.h"
+#include "plist.h"
 
 /* Tests */
 enum
 {
 	TEST_NO_JOB = -1,
 	TEST_WNDLIB_PERFOMANCE,
+	TEST_DSP_PERFOMANCE,
+	TEST_SORT_PERFOMANCE,
 	TEST_NUMBER
 };
 
@@ -45,6 +48,16 @@ void *test_thread( void *arg );
 /* Test the window library perfomance */
 void test_wndlib_perfomance( void );
 
+/* Measure the built-in effects speed */
+void test_dsp_perfomance( void );
+
+/* Measure play list sorting speed */
+void test_sort_perfomance( void );
+
+/* Run play list songs through the player pipeline with a non-syncing 
+ * sink and report decoding speed. Works without the interface */
+bool_t test_decode_benchmark( plist_t *pl );
+
 #endif
 
 /* End of 'test.h' file */
@@ -23,8 +23,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include "types.h"
+#include "cfg.h"
 #include "player.h"
 #include "plist.h"
+#include "song.h"
 #include "undo.h"
 
 /* Initialize undo list */
@@ -39,6 +41,7 @@ undo_list_t *undo_new( void )
 
 	/* Fill memory */
 	ul->m_head = ul->m_tail = ul->m_cur = NULL;
+	ul->m_size = 0;
 	return ul;
 } /* End of 'undo_new' function */
 
@@ -52,15 +55,93 @@ void undo_free( undo_list_t *ul )
 	free(ul);
 } /* End of 'undo_free' function */
 
+/* Estimate amount of memory held by an item */
+static size_t undo_item_size( struct tag_undo_list_item_t *item )
+{
+	size_t size = sizeof(*item);
+	int i;
+
+	switch (item->m_type)
+	{
+	case UNDO_ADD:
+		if (item->m_data.m_add.m_set != NULL)
+		{
+			struct tag_plist_set_t *t;
+			for ( t = item->m_data.m_add.m_set->m_head; t != NULL; t = t->m_next )
+				size += sizeof(*t) + strlen(t->m_name) + 1;
+		}
+		break;
+	case UNDO_ADD_OBJ:
+		if (item->m_data.m_add_obj.m_obj_name != NULL)
+			size += strlen(item->m_data.m_add_obj.m_obj_name) + 1;
+		break;
+	case UNDO_REM:
+		/* Songs may be referenced by the item only. Info readers 
+		 * may still be filling them in */
+		for ( i = 0; i < item->m_data.m_rem.m_num_songs; i ++ )
+		{
+			song_t *s = item->m_data.m_rem.m_songs[i];
+			size += sizeof(song_t *) + sizeof(song_t) + strlen(s->m_fullname) + 1;
+			song_lock(s);
+			if (s->m_filename != NULL)
+				size += strlen(s->m_filename) + 1;
+			if (s->m_title != NULL)
+				size += sizeof(str_t) + s->m_title->m_allocated;
+			if (s->m_default_title != NULL)
+				size += strlen(s->m_default_title) + 1;
+			size += si_size(s->m_info);
+			song_unlock(s);
+		}
+		break;
+	case UNDO_SORT:
+		size += item->m_data.m_sort.m_len * sizeof(int);
+		break;
+	}
+	return size;
+} /* End of 'undo_item_size' function */
+
+/* Drop the oldest items while the list exceeds the memory budget.
+ * The newest item is always kept, so the last action may be undone */
+static void undo_shrink( undo_list_t *ul )
+{
+	size_t budget = (size_t)cfg_get_var_int(cfg_list, "undo-budget") << 20;
+
+	if (budget == 0)
+		return;
+	while (ul->m_head != NULL && ul->m_head != ul->m_tail && ul->m_size > budget)
+	{
+		struct tag_undo_list_item_t *item = ul->m_head;
+
+		ul->m_head = item->m_next;
+		if (ul->m_head != NULL)
+			ul->m_head->m_prev = NULL;
+		else
+			ul->m_tail = NULL;
+		if (ul->m_cur == item)
+			ul->m_cur = ul->m_head;
+		ul->m_size -= item->m_size;
+		item->m_next = NULL;
+		undo_free_list(item);
+	}
+	if (ul->m_size > budget)
+		logger_message(player_log, 1, 
+				_("Undo action takes %lu KB, which is over the undo budget"),
+				(unsigned long)(ul->m_size >> 10));
+} /* End of 'undo_shrink' function */
+
 /* Add an action to list */
 void undo_add( undo_list_t *ul, struct tag_undo_list_item_t *item )
 {
+	struct tag_undo_list_item_t *t;
+
 	if (ul == NULL || item == NULL)
 		return;
 
 	/* Free list tail */
 	if (ul->m_cur != NULL)
 		ul->m_tail = ul->m_cur->m_prev;
+	for ( t = ul->m_cur; t != NULL; t = t->m_next )
+		ul->m_size -= t->m_size;
 	undo_free_list(ul->m_cur);
 
 	/* Add */
@@ -77,6 +158,9 @@ void undo_add( undo_list_t *ul, struct tag_undo_list_item_t *item )
 		ul->m_tail = item;
 	}
 	ul->m_cur = NULL;
+	item->m_size = undo_item_size(item);
+	ul->m_size += item->m_size;
+	undo_shrink(ul);
 } /* End of 'undo_add' function */
 
 /* Move forward */
@@ -131,7 +215,7 @@ void undo_do( struct tag_undo_list_item_t *item )
 			was_end = player_plist->m_sel_end;
 		
 		player_plist->m_sel_start = data->m_start_pos;
-		player_plist->m_sel_end = data->m_start_pos + data->m_num_files - 1;
+		player_plist->m_sel_end = data->m_start_pos + data->m_num_songs - 1;
 		plist_rem(player_plist);
 		player_plist->m_sel_start = was_start;
 		player_plist->m_sel_end = was_end;
@@ -166,6 +250,8 @@ void undo_do( struct tag_undo_list_item_t *item )
 		if (player_plist->m_cur_song >= 0)
 			player_plist->m_cur_song = 
 				data->m_transform[player_plist->m_cur_song];
+		player_plist->m_gen ++;
+		plist_update_ids(player_plist, 0, player_plist->m_len - 1);
 		plist_unlock(player_plist);
 		free(list);
 	}
@@ -215,16 +301,12 @@ void undo_undo( struct tag_undo_list_item_t *item )
 	{
 		struct tag_undo_list_rem_t *data = &item->m_data.m_rem;
 		int i;
-		for ( i = 0; i < data->m_num_files; i ++ )
-		{
-			struct song_name *sn = &data->m_files[i];
-			song_t *song = (sn->m_filename ?
-					song_new_from_file(sn->m_filename, &sn->m_metadata) :
-					song_new_from_uri(sn->m_fullname, &sn->m_metadata));
-			
-			plist_add_song(player_plist, song, data->m_start_pos + i);
-		}
-		plist_flush_scheduled(player_plist);
+
+		/* Both the history and the play list hold the songs now */
+		for ( i = 0; i < data->m_num_songs; i ++ )
+			song_add_ref(data->m_songs[i]);
+		plist_add_songs(player_plist, data->m_songs, data->m_num_songs,
+				data->m_start_pos);
 	}
 	/* Move selection action */
 	else if (item->m_type == UNDO_MOVE)
@@ -255,6 +337,8 @@ void undo_undo( struct tag_undo_list_item_t *item )
 		for ( i = 0; i < player_plist->m_len; i ++ )
 			player_plist->m_list[i] = list[data->m_transform[i]];
 		player_plist->m_cur_song = data->m_was_song;
+		player_plist->m_gen ++;
+		plist_update_ids(player_plist, 0, player_plist->m_len - 1);
 		plist_unlock(player_plist);
 		free(list);
 	}
@@ -285,17 +369,11 @@ void undo_free_list( struct tag_undo_list_item_t *l )
 				free(t->m_data.m_add_obj.m_obj_name);
 			break;
 		case UNDO_REM:
-			if (t->m_data.m_rem.m_files != NULL)
+			if (t->m_data.m_rem.m_songs != NULL)
 			{
-				for ( i = 0; i < t->m_data.m_rem.m_num_files; i ++ )
-				{
-					struct song_name *sn = &t->m_data.m_rem.m_files[i];
-					if (sn->m_fullname)
-						free(sn->m_fullname);
-					if (sn->m_filename)
-						free(sn->m_filename);
-				}
-				free(t->m_data.m_rem.m_files);
+				for ( i = 0; i < t->m_data.m_rem.m_num_songs; i ++ )
+					song_free(t->m_data.m_rem.m_songs[i]);
+				free(t->m_data.m_rem.m_songs);
 			}
 			break;
 		case UNDO_SORT:
@@ -60,25 +60,28 @@ typedef struct tag_undo_list_t
 			} m_add_obj;
 			struct tag_undo_list_rem_t
 			{
-				struct song_name
-				{
-					char *m_fullname;
-					char *m_filename;
-					song_metadata_t m_metadata;
-				} *m_files;
-				int m_num_files;
+				/* Removed songs (references are held) */
+				song_t **m_songs;
+				int m_num_songs;
 				int m_start_pos;
 			} m_rem;
 			struct tag_undo_list_sort_t
 			{
 				int *m_transform;
+				int m_len;
 				int m_was_song;
 			} m_sort;
 		} m_data;
 
+		/* Estimated amount of memory held by the item */
+		size_t m_size;
+
 		/* Pointers to next and previous items */
 		struct tag_undo_list_item_t *m_next, *m_prev;
 	} *m_head, *m_tail, *m_cur;
+
+	/* Estimated amount of memory held by all the items */
+	size_t m_size;
 } undo_list_t;
 
 /* Fix manual selection update */
@@ -0,0 +1,733 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Crossfade mixing engine implementation.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include "types.h"
+#include "player.h"
+#include "xfade.h"
+
+/* Minimal time a late deck needs to get into the mixer */
+#define XFADE_LATE_MARGIN (50 * GST_MSECOND)
+
+/* Alive engines (only touched from the controlling thread) */
+static xfade_t *xfade_engines = NULL;
+
+/* Message passed from a streaming thread to the controlling one */
+typedef struct
+{
+	xfade_t *m_xfade;
+	guint m_deck_id;
+} xfade_msg_t;
+
+static void xfade_deck_free( xfade_deck_t *d );
+
+/* Get gain at the point 'x' (0..1) of a fade */
+static inline float xfade_gain( int curve, double x, bool_t in )
+{
+	if (x <= 0)
+		return in ? 0 : 1;
+	if (x >= 1)
+		return in ? 1 : 0;
+	switch (curve)
+	{
+	case XFADE_CURVE_EQUAL_POWER:
+		return in ? sin(x * M_PI_2) : cos(x * M_PI_2);
+	case XFADE_CURVE_S:
+		return in ? (1 - cos(x * M_PI)) / 2 : (1 + cos(x * M_PI)) / 2;
+	default:
+		return in ? x : 1 - x;
+	}
+} /* End of 'xfade_gain' function */
+
+/* Parse curve name */
+int xfade_curve_by_name( const char *name )
+{
+	if (name == NULL)
+		return XFADE_CURVE_EQUAL_POWER;
+	if (!strcasecmp(name, "linear"))
+		return XFADE_CURVE_LINEAR;
+	if (!strcasecmp(name, "s-curve"))
+		return XFADE_CURVE_S;
+	return XFADE_CURVE_EQUAL_POWER;
+} /* End of 'xfade_curve_by_name' function */
+
+/* Get current running time of the pipeline */
+static GstClockTime xfade_running_time( xfade_t *xf )
+{
+	GstClock *clock;
+	GstClockTime now;
+
+	if (!xf->m_running)
+		return GST_CLOCK_TIME_NONE;
+	clock = gst_element_get_clock(xf->m_pipeline);
+	if (clock == NULL)
+		return GST_CLOCK_TIME_NONE;
+	now = gst_clock_get_time(clock) - gst_element_get_base_time(xf->m_pipeline);
+	gst_object_unref(clock);
+	return now;
+} /* End of 'xfade_running_time' function */
+
+/* Find deck by ID */
+static xfade_deck_t *xfade_find_deck( xfade_t *xf, guint id )
+{
+	if (xf->m_prev != NULL && xf->m_prev->m_id == id)
+		return xf->m_prev;
+	if (xf->m_cur != NULL && xf->m_cur->m_id == id)
+		return xf->m_cur;
+	if (xf->m_next != NULL && xf->m_next->m_id == id)
+		return xf->m_next;
+	return NULL;
+} /* End of 'xfade_find_deck' function */
+
+/* Pass deck event handler to the controlling thread */
+static void xfade_invoke( xfade_deck_t *d, GSourceFunc func )
+{
+	xfade_msg_t *msg = (xfade_msg_t *)malloc(sizeof(*msg));
+	if (msg == NULL)
+		return;
+	msg->m_xfade = d->m_xfade;
+	msg->m_deck_id = d->m_id;
+	g_main_context_invoke(d->m_xfade->m_ctx, func, msg);
+} /* End of 'xfade_invoke' function */
+
+/* Get deck a message is addressed to and free message */
+static xfade_deck_t *xfade_msg_deck( gpointer data )
+{
+	xfade_msg_t *msg = (xfade_msg_t *)data;
+	xfade_t *xf;
+	guint id = msg->m_deck_id;
+
+	for ( xf = xfade_engines; xf != NULL; xf = xf->m_next_engine )
+		if (xf == msg->m_xfade)
+			break;
+	free(msg);
+	return (xf == NULL) ? NULL : xfade_find_deck(xf, id);
+} /* End of 'xfade_msg_deck' function */
+
+/* Log overlap statistics */
+static void xfade_overlap_done( xfade_t *xf, xfade_deck_t *prev )
+{
+	gint64 wall;
+	clock_t cpu;
+
+	if (xf->m_overlap_start == 0)
+		return;
+	wall = (g_get_monotonic_time() - xf->m_overlap_start) / 1000;
+	cpu = (clock() - xf->m_overlap_cpu) * 1000 / CLOCKS_PER_SEC;
+	logger_debug(player_log, "crossfade: overlap took %lld ms, %ld ms of CPU, "
+			"%llu frames faded, peak queue levels %llu/%llu ms",
+			(long long)wall, (long)cpu, (unsigned long long)xf->m_overlap_frames,
+			(unsigned long long)(prev->m_max_level / GST_MSECOND),
+			(unsigned long long)((xf->m_cur == NULL) ? 0 :
+				xf->m_cur->m_max_level / GST_MSECOND));
+	xf->m_overlap_start = 0;
+} /* End of 'xfade_overlap_done' function */
+
+/* Apply fades to a buffer entering the deck queue */
+static GstPadProbeReturn xfade_on_buffer( GstPad *pad, GstPadProbeInfo *info,
+		gpointer data )
+{
+	xfade_deck_t *d = (xfade_deck_t *)data;
+	GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER(info);
+	GstClockTime pts = GST_BUFFER_PTS(buf);
+	song_time_t out_start = d->m_fade_out_start;
+	bool_t need_in, need_out;
+	GstMapInfo map;
+	gsize frames, i;
+	double step, pos;
+
+	if (!GST_CLOCK_TIME_IS_VALID(pts))
+		return GST_PAD_PROBE_OK;
+
+	/* Get format on the first buffer */
+	if (d->m_rate == 0)
+	{
+		GstCaps *caps = gst_pad_get_current_caps(pad);
+		GstAudioInfo ai;
+
+		if (caps == NULL)
+			return GST_PAD_PROBE_OK;
+		gst_audio_info_init(&ai);
+		if (gst_audio_info_from_caps(&ai, caps))
+		{
+			d->m_channels = GST_AUDIO_INFO_CHANNELS(&ai);
+			d->m_rate = GST_AUDIO_INFO_RATE(&ai);
+		}
+		gst_caps_unref(caps);
+		if (d->m_rate == 0 || d->m_channels == 0)
+			return GST_PAD_PROBE_OK;
+	}
+
+	/* Most buffers are outside of the fades */
+	frames = gst_buffer_get_size(buf) / (sizeof(float) * d->m_channels);
+	step = (double)GST_SECOND / d->m_rate;
+	need_in = (d->m_fade_in_len > 0 && (song_time_t)pts < d->m_start + d->m_fade_in_len);
+	need_out = (out_start >= 0 && (song_time_t)(pts + frames * step) > out_start);
+	if (!need_in && !need_out)
+		return GST_PAD_PROBE_OK;
+
+	buf = gst_buffer_make_writable(buf);
+	GST_PAD_PROBE_INFO_DATA(info) = buf;
+	if (!gst_buffer_map(buf, &map, GST_MAP_READ | GST_MAP_WRITE))
+		return GST_PAD_PROBE_OK;
+	for ( i = 0, pos = pts; i < frames; i ++, pos += step )
+	{
+		float *frame = (float *)map.data + i * d->m_channels;
+		float g = 1;
+		int ch;
+
+		if (need_in)
+			g *= xfade_gain(d->m_curve, (pos - d->m_start) / d->m_fade_in_len, TRUE);
+		if (need_out)
+			g *= xfade_gain(d->m_curve, (pos - out_start) / d->m_fade_out_len, FALSE);
+		for ( ch = 0; ch < d->m_channels; ch ++ )
+			frame[ch] *= g;
+	}
+	gst_buffer_unmap(buf, &map);
+	d->m_xfade->m_overlap_frames += frames;
+	return GST_PAD_PROBE_OK;
+} /* End of 'xfade_on_buffer' function */
+
+/* Link ready deck to the mixer */
+static void xfade_deck_link( xfade_deck_t *d )
+{
+	xfade_t *xf = d->m_xfade;
+	GstClockTime now = xfade_running_time(xf);
+
+	/* Deck is late, so it will start as soon as possible */
+	if (d != xf->m_cur && GST_CLOCK_TIME_IS_VALID(now) &&
+			d->m_offset < now + XFADE_LATE_MARGIN)
+	{
+		logger_debug(player_log, "crossfade: deck is late by %lld ms",
+				(long long)(now + XFADE_LATE_MARGIN - d->m_offset) / 1000000LL);
+		d->m_base += now + XFADE_LATE_MARGIN - d->m_offset;
+		d->m_offset = now + XFADE_LATE_MARGIN;
+	}
+
+	d->m_mixer_pad = gst_element_get_request_pad(xf->m_mixer, "sink_%u");
+	if (d->m_mixer_pad == NULL)
+	{
+		logger_error(player_log, 1, _("crossfade: unable to get mixer pad"));
+		return;
+	}
+	gst_pad_set_offset(d->m_mixer_pad, d->m_offset);
+	if (GST_PAD_LINK_FAILED(gst_pad_link(d->m_src_pad, d->m_mixer_pad)))
+	{
+		logger_error(player_log, 1, _("crossfade: unable to link deck to mixer"));
+		return;
+	}
+	d->m_state = XFADE_DECK_LINKED;
+	gst_pad_remove_probe(d->m_queue_src, d->m_block_probe);
+	d->m_block_probe = 0;
+
+	if (d == xf->m_next || xf->m_prev != NULL)
+	{
+		xf->m_overlap_start = g_get_monotonic_time();
+		xf->m_overlap_cpu = clock();
+		xf->m_overlap_frames = 0;
+	}
+} /* End of 'xfade_deck_link' function */
+
+/* Seek deck to its start */
+static void xfade_deck_seek( xfade_deck_t *d )
+{
+	GstEvent *ev;
+
+	logger_debug(player_log, "crossfade: seeking deck to %lld", d->m_start);
+	d->m_state = XFADE_DECK_SEEKING;
+	ev = gst_event_new_seek(1.0, GST_FORMAT_TIME,
+			GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE,
+			GST_SEEK_TYPE_SET, d->m_start,
+			(d->m_stop >= 0) ? GST_SEEK_TYPE_SET : GST_SEEK_TYPE_NONE,
+			(d->m_stop >= 0) ? d->m_stop : GST_CLOCK_TIME_NONE);
+	if (!gst_pad_send_event(d->m_queue_src, ev))
+	{
+		logger_error(player_log, 1, _("crossfade: deck seek failed"));
+		d->m_state = XFADE_DECK_READY;
+	}
+} /* End of 'xfade_deck_seek' function */
+
+/* Move deck preparation forward (in the controlling thread) */
+static gboolean xfade_deck_progress( gpointer data )
+{
+	xfade_deck_t *d = xfade_msg_deck(data);
+
+	if (d == NULL)
+		return G_SOURCE_REMOVE;
+	if (d->m_state == XFADE_DECK_SEEK)
+		xfade_deck_seek(d);
+	else if (d->m_state == XFADE_DECK_READY)
+		xfade_deck_link(d);
+	return G_SOURCE_REMOVE;
+} /* End of 'xfade_deck_progress' function */
+
+/* Handle data blocked at the deck output */
+static GstPadProbeReturn xfade_on_block( GstPad *pad, GstPadProbeInfo *info,
+		gpointer data )
+{
+	xfade_deck_t *d = (xfade_deck_t *)data;
+
+	if (d->m_state == XFADE_DECK_WAITING)
+	{
+		d->m_state = (d->m_start > 0 || d->m_stop >= 0) ?
+			XFADE_DECK_SEEK : XFADE_DECK_READY;
+		xfade_invoke(d, xfade_deck_progress);
+	}
+	else if (d->m_state == XFADE_DECK_SEEKING)
+	{
+		d->m_state = XFADE_DECK_READY;
+		xfade_invoke(d, xfade_deck_progress);
+	}
+	return GST_PAD_PROBE_OK;
+} /* End of 'xfade_on_block' function */
+
+/* Handle deck end of stream (in the controlling thread) */
+static gboolean xfade_deck_finished( gpointer data )
+{
+	xfade_deck_t *d = xfade_msg_deck(data);
+	xfade_t *xf;
+
+	if (d == NULL)
+		return G_SOURCE_REMOVE;
+
+	/* Last deck is finished by the mixer EOS */
+	xf = d->m_xfade;
+	if (d == xf->m_cur && xf->m_next == NULL)
+	{
+		if (d->m_mixer_pad != NULL)
+		{
+			gst_pad_send_event(d->m_mixer_pad, gst_event_new_eos());
+			return G_SOURCE_REMOVE;
+		}
+
+		/* Deck ended before reaching the mixer */
+		gst_element_post_message(xf->m_pipeline,
+				gst_message_new_eos(GST_OBJECT(xf->m_pipeline)));
+		return G_SOURCE_REMOVE;
+	}
+
+	/* Releasing the mixer pad lets the other decks go on, and the
+	 * mixer never sees EOS while the next deck is still preparing */
+	logger_debug(player_log, "crossfade: deck %u finished", d->m_id);
+	xfade_overlap_done(xf, d);
+	if (d == xf->m_prev)
+		xf->m_prev = NULL;
+	else if (d == xf->m_cur)
+		xf->m_cur = NULL;
+	xfade_deck_free(d);
+	return G_SOURCE_REMOVE;
+} /* End of 'xfade_deck_finished' function */
+
+/* Handle events leaving the deck (only the deck itself may be touched
+ * here, since the other ones are freed in the controlling thread) */
+static GstPadProbeReturn xfade_on_event( GstPad *pad, GstPadProbeInfo *info,
+		gpointer data )
+{
+	xfade_deck_t *d = (xfade_deck_t *)data;
+
+	if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) != GST_EVENT_EOS)
+		return GST_PAD_PROBE_OK;
+
+	/* Whether the mixer gets EOS is decided in the controlling thread */
+	d->m_eos = TRUE;
+	xfade_invoke(d, xfade_deck_finished);
+	return GST_PAD_PROBE_DROP;
+} /* End of 'xfade_on_event' function */
+
+/* Link decoder output to the deck chain */
+static void xfade_on_pad_added( GstElement *dec, GstPad *pad, gpointer data )
+{
+	xfade_deck_t *d = (xfade_deck_t *)data;
+	GstPad *sink = gst_element_get_static_pad(d->m_convert, "sink");
+
+	if (!gst_pad_is_linked(sink))
+		gst_pad_link(pad, sink);
+	gst_object_unref(sink);
+} /* End of 'xfade_on_pad_added' function */
+
+/* Create a new deck */
+static xfade_deck_t *xfade_deck_new( xfade_t *xf, const char *uri,
+		song_time_t start, song_time_t stop )
+{
+	xfade_deck_t *d;
+	GstElement *dec, *resample, *filter;
+	GstCaps *caps;
+	GstPad *pad;
+
+	d = (xfade_deck_t *)malloc(sizeof(*d));
+	if (d == NULL)
+		return NULL;
+	memset(d, 0, sizeof(*d));
+	d->m_xfade = xf;
+	d->m_id = ++ xf->m_last_id;
+	d->m_start = d->m_base = (start > 0) ? start : 0;
+	d->m_stop = stop;
+	d->m_fade_out_start = -1;
+	d->m_state = XFADE_DECK_WAITING;
+
+	/* Create elements */
+	d->m_bin = gst_bin_new(NULL);
+	dec = gst_element_factory_make("uridecodebin", NULL);
+	d->m_convert = gst_element_factory_make("audioconvert", NULL);
+	resample = gst_element_factory_make("audioresample", NULL);
+	filter = gst_element_factory_make("capsfilter", NULL);
+	d->m_queue = gst_element_factory_make("queue", NULL);
+	if (d->m_bin == NULL || dec == NULL || d->m_convert == NULL ||
+			resample == NULL || filter == NULL || d->m_queue == NULL)
+	{
+		logger_error(player_log, 1, _("crossfade: unable to create deck elements"));
+		if (dec)
+			gst_object_unref(dec);
+		if (d->m_convert)
+			gst_object_unref(d->m_convert);
+		if (resample)
+			gst_object_unref(resample);
+		if (filter)
+			gst_object_unref(filter);
+		if (d->m_queue)
+			gst_object_unref(d->m_queue);
+		if (d->m_bin)
+			gst_object_unref(d->m_bin);
+		free(d);
+		return NULL;
+	}
+
+	/* Fades are applied to float samples; queue keeps memory bounded */
+	caps = gst_caps_from_string("audio/x-raw,format=F32LE,layout=interleaved");
+	g_object_set(G_OBJECT(filter), "caps", caps, NULL);
+	gst_caps_unref(caps);
+	caps = gst_caps_from_string("audio/x-raw");
+	g_object_set(G_OBJECT(dec), "uri", uri, "caps", caps, NULL);
+	gst_caps_unref(caps);
+	g_object_set(G_OBJECT(d->m_queue),
+			"max-size-time", (guint64)xf->m_queue_ms * GST_MSECOND,
+			"max-size-buffers", 0, "max-size-bytes", 0, NULL);
+
+	gst_bin_add_many(GST_BIN(d->m_bin), dec, d->m_convert, resample, filter,
+			d->m_queue, NULL);
+	gst_element_link_many(d->m_convert, resample, filter, d->m_queue, NULL);
+	g_signal_connect(dec, "pad-added", (GCallback)xfade_on_pad_added, d);
+
+	/* Set up probes */
+	pad = gst_element_get_static_pad(d->m_queue, "sink");
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, xfade_on_buffer, d, NULL);
+	gst_object_unref(pad);
+	d->m_queue_src = gst_element_get_static_pad(d->m_queue, "src");
+	d->m_block_probe = gst_pad_add_probe(d->m_queue_src,
+			GST_PAD_PROBE_TYPE_BLOCK | GST_PAD_PROBE_TYPE_BUFFER,
+			xfade_on_block, d, NULL);
+	gst_pad_add_probe(d->m_queue_src, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+			xfade_on_event, d, NULL);
+	d->m_src_pad = gst_ghost_pad_new("src", d->m_queue_src);
+	gst_element_add_pad(d->m_bin, d->m_src_pad);
+
+	logger_debug(player_log, "crossfade: deck %u for %s", d->m_id, uri);
+	gst_bin_add(GST_BIN(xf->m_pipeline), d->m_bin);
+	gst_element_sync_state_with_parent(d->m_bin);
+	return d;
+} /* End of 'xfade_deck_new' function */
+
+/* Free deck */
+static void xfade_deck_free( xfade_deck_t *d )
+{
+	xfade_t *xf = d->m_xfade;
+
+	gst_element_set_locked_state(d->m_bin, TRUE);
+	gst_element_set_state(d->m_bin, GST_STATE_NULL);
+	if (d->m_mixer_pad != NULL)
+	{
+		gst_element_release_request_pad(xf->m_mixer, d->m_mixer_pad);
+		gst_object_unref(d->m_mixer_pad);
+	}
+	gst_object_unref(d->m_queue_src);
+	gst_bin_remove(GST_BIN(xf->m_pipeline), d->m_bin);
+	free(d);
+} /* End of 'xfade_deck_free' function */
+
+/* Free all decks */
+static void xfade_drop_decks( xfade_t *xf )
+{
+	if (xf->m_prev != NULL)
+		xfade_deck_free(xf->m_prev);
+	if (xf->m_cur != NULL)
+		xfade_deck_free(xf->m_cur);
+	if (xf->m_next != NULL)
+		xfade_deck_free(xf->m_next);
+	xf->m_prev = xf->m_cur = xf->m_next = NULL;
+	xf->m_overlap_start = 0;
+} /* End of 'xfade_drop_decks' function */
+
+/* Create engine with a given audio sink */
+xfade_t *xfade_new( GstElement *sink, GMainContext *ctx, int queue_ms )
+{
+	xfade_t *xf;
+	GstElement *convert;
+
+	xf = (xfade_t *)malloc(sizeof(*xf));
+	if (xf == NULL)
+		return NULL;
+	memset(xf, 0, sizeof(*xf));
+	xf->m_ctx = ctx;
+	xf->m_queue_ms = (queue_ms > 0) ? queue_ms : 1000;
+
+	if (sink == NULL)
+		sink = gst_element_factory_make("autoaudiosink", NULL);
+	xf->m_pipeline = gst_pipeline_new("xfade");
+	xf->m_mixer = gst_element_factory_make("audiomixer", NULL);
+	convert = gst_element_factory_make("audioconvert", NULL);
+	xf->m_volume = gst_element_factory_make("volume", NULL);
+	if (xf->m_pipeline == NULL || xf->m_mixer == NULL || convert == NULL ||
+			xf->m_volume == NULL || sink == NULL)
+	{
+		logger_error(player_log, 1, _("crossfade: unable to create mixing pipeline"));
+		if (xf->m_mixer)
+			gst_object_unref(xf->m_mixer);
+		if (convert)
+			gst_object_unref(convert);
+		if (xf->m_volume)
+			gst_object_unref(xf->m_volume);
+		if (sink)
+			gst_object_unref(sink);
+		if (xf->m_pipeline)
+			gst_object_unref(xf->m_pipeline);
+		free(xf);
+		return NULL;
+	}
+	gst_bin_add_many(GST_BIN(xf->m_pipeline), xf->m_mixer, convert, xf->m_volume,
+			sink, NULL);
+	gst_element_link_many(xf->m_mixer, convert, xf->m_volume, sink, NULL);
+
+	xf->m_next_engine = xfade_engines;
+	xfade_engines = xf;
+	return xf;
+} /* End of 'xfade_new' function */
+
+/* Free engine */
+void xfade_free( xfade_t *xf )
+{
+	xfade_t **p;
+
+	for ( p = &xfade_engines; *p != NULL; p = &(*p)->m_next_engine )
+		if (*p == xf)
+		{
+			*p = xf->m_next_engine;
+			break;
+		}
+	gst_element_set_state(xf->m_pipeline, GST_STATE_NULL);
+	xfade_drop_decks(xf);
+	gst_object_unref(xf->m_pipeline);
+	free(xf);
+} /* End of 'xfade_free' function */
+
+/* Start playing a song from scratch */
+bool_t xfade_play( xfade_t *xf, const char *uri, song_time_t start,
+		song_time_t stop )
+{
+	gst_element_set_state(xf->m_pipeline, GST_STATE_READY);
+	xf->m_running = FALSE;
+	xfade_drop_decks(xf);
+
+	xf->m_cur = xfade_deck_new(xf, uri, start, stop);
+	if (xf->m_cur == NULL)
+		return FALSE;
+	xf->m_cur->m_offset = 0;
+	xf->m_frozen_pos = xf->m_cur->m_base;
+	return TRUE;
+} /* End of 'xfade_play' function */
+
+/* Prepare the next song to fade in */
+song_time_t xfade_queue_next( xfade_t *xf, const char *uri, song_time_t start,
+		song_time_t stop, song_time_t fade_at, song_time_t fade_len, int curve )
+{
+	xfade_deck_t *cur = xf->m_cur, *d;
+	GstClockTime now = xfade_running_time(xf);
+	GstClockTime at;
+
+	if (cur == NULL || cur->m_state != XFADE_DECK_LINKED ||
+			!GST_CLOCK_TIME_IS_VALID(now))
+		return -1;
+	if (xf->m_next != NULL)
+	{
+		xfade_deck_free(xf->m_next);
+		xf->m_next = NULL;
+	}
+
+	/* Running time of the fade start is known exactly from the current
+	 * deck placement */
+	at = cur->m_offset + (fade_at - cur->m_base);
+	d = xfade_deck_new(xf, uri, start, stop);
+	if (d == NULL)
+		return -1;
+	d->m_offset = at;
+	d->m_fade_in_len = fade_len;
+	d->m_curve = curve;
+	xf->m_next = d;
+
+	if (fade_len > 0)
+	{
+		cur->m_curve = curve;
+		cur->m_fade_out_len = fade_len;
+		cur->m_fade_out_start = fade_at;
+	}
+	logger_debug(player_log, "crossfade: next deck due in %lld ms, fade is %lld ms",
+			(long long)(at - now) / 1000000LL, (long long)fade_len / 1000000LL);
+	return (at > now) ? (song_time_t)(at - now) : 0;
+} /* End of 'xfade_queue_next' function */
+
+/* Make the next deck current */
+void xfade_switch( xfade_t *xf )
+{
+	if (xf->m_next == NULL)
+		return;
+	if (xf->m_prev != NULL)
+		xfade_deck_free(xf->m_prev);
+	xf->m_prev = xf->m_cur;
+	xf->m_cur = xf->m_next;
+	xf->m_next = NULL;
+} /* End of 'xfade_switch' function */
+
+/* Seek current song */
+bool_t xfade_seek( xfade_t *xf, song_time_t pos, GstSeekFlags flags )
+{
+	xfade_deck_t *cur = xf->m_cur;
+
+	if (cur == NULL)
+		return FALSE;
+
+	/* Overlap is cancelled */
+	if (xf->m_next != NULL)
+		xfade_deck_free(xf->m_next);
+	if (xf->m_prev != NULL)
+		xfade_deck_free(xf->m_prev);
+	xf->m_prev = xf->m_next = NULL;
+	xf->m_overlap_start = 0;
+	cur->m_fade_in_len = 0;
+	cur->m_fade_out_start = -1;
+	xf->m_frozen_pos = pos;
+
+	/* Deck has not reached the mixer yet */
+	if (cur->m_state != XFADE_DECK_LINKED)
+	{
+		cur->m_start = cur->m_base = pos;
+		if (cur->m_state != XFADE_DECK_WAITING)
+			xfade_deck_seek(cur);
+		return TRUE;
+	}
+
+	/* Flushing seek restarts running time from zero */
+	xf->m_running = FALSE;
+	cur->m_offset = 0;
+	cur->m_base = pos;
+	gst_pad_set_offset(cur->m_mixer_pad, 0);
+	return gst_element_seek(xf->m_pipeline, 1.0, GST_FORMAT_TIME,
+			GST_SEEK_FLAG_FLUSH | flags, GST_SEEK_TYPE_SET, pos,
+			(cur->m_stop >= 0) ? GST_SEEK_TYPE_SET : GST_SEEK_TYPE_NONE,
+			(cur->m_stop >= 0) ? cur->m_stop : GST_CLOCK_TIME_NONE);
+} /* End of 'xfade_seek' function */
+
+/* Get current song position in the file time */
+song_time_t xfade_get_position( xfade_t *xf )
+{
+	xfade_deck_t *cur = xf->m_cur, *decks[3];
+	GstClockTime now = xfade_running_time(xf);
+	song_time_t pos;
+	int i;
+
+	if (cur == NULL || !GST_CLOCK_TIME_IS_VALID(now))
+		return xf->m_frozen_pos;
+
+	pos = cur->m_base;
+	if (now > cur->m_offset)
+		pos += now - cur->m_offset;
+	if (cur->m_stop >= 0 && pos > cur->m_stop)
+		pos = cur->m_stop;
+
+	/* Track queue fill levels */
+	decks[0] = xf->m_prev;
+	decks[1] = cur;
+	decks[2] = xf->m_next;
+	for ( i = 0; i < 3; i ++ )
+	{
+		guint64 level;
+
+		if (decks[i] == NULL)
+			continue;
+		g_object_get(G_OBJECT(decks[i]->m_queue), "current-level-time", &level, NULL);
+		if (level > decks[i]->m_max_level)
+			decks[i]->m_max_level = level;
+	}
+	return pos;
+} /* End of 'xfade_get_position' function */
+
+/* Set output volume */
+void xfade_set_volume( xfade_t *xf, double vol )
+{
+	g_object_set(G_OBJECT(xf->m_volume), "volume", vol, NULL);
+} /* End of 'xfade_set_volume' function */
+
+/* Set pipeline state */
+void xfade_set_state( xfade_t *xf, GstState state )
+{
+	if (xf->m_running)
+		xf->m_frozen_pos = xfade_get_position(xf);
+	xf->m_running = FALSE;
+	xf->m_playing = (state == GST_STATE_PLAYING);
+
+	/* Running time is available immediately if already pre-rolled */
+	if (gst_element_set_state(xf->m_pipeline, state) == GST_STATE_CHANGE_SUCCESS &&
+			xf->m_playing)
+		xf->m_running = TRUE;
+} /* End of 'xfade_set_state' function */
+
+/* Handle pipeline ASYNC_DONE message */
+void xfade_on_async_done( xfade_t *xf )
+{
+	if (xf->m_playing)
+		xf->m_running = TRUE;
+} /* End of 'xfade_on_async_done' function */
+
+/* Handle error posted by 'src' */
+bool_t xfade_on_error( xfade_t *xf, GstObject *src )
+{
+	xfade_deck_t **decks[3] = { &xf->m_prev, &xf->m_cur, &xf->m_next };
+	int i;
+
+	for ( i = 0; i < 3; i ++ )
+	{
+		xfade_deck_t *d = *decks[i];
+		if (d == NULL || !gst_object_has_as_ancestor(src, GST_OBJECT(d->m_bin)))
+			continue;
+
+		logger_debug(player_log, "crossfade: dropping failed deck %u", d->m_id);
+		*decks[i] = NULL;
+		xfade_deck_free(d);
+		return (xf->m_prev == NULL && xf->m_cur == NULL && xf->m_next == NULL);
+	}
+	return FALSE;
+} /* End of 'xfade_on_error' function */
+
+/* End of 'xfade.c' file */
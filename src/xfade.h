@@ -0,0 +1,153 @@
+/******************************************************************
+ * Copyright (C) 2003 - 2013 by SG Software.
+ *
+ * SG MPFC. Interface for crossfade mixing engine.
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+ * MA 02111-1307, USA.
+ */
+
+#ifndef __SG_MPFC_XFADE_H__
+#define __SG_MPFC_XFADE_H__
+
+#include <time.h>
+#include <gst/gst.h>
+#include "types.h"
+#include "main_types.h"
+
+/* Fade curves */
+#define XFADE_CURVE_LINEAR		0
+#define XFADE_CURVE_EQUAL_POWER	1
+#define XFADE_CURVE_S			2
+
+/* Deck states */
+#define XFADE_DECK_WAITING		0
+#define XFADE_DECK_SEEK			1
+#define XFADE_DECK_SEEKING		2
+#define XFADE_DECK_READY		3
+#define XFADE_DECK_LINKED		4
+
+/* A decoding chain feeding the mixer. Every deck is a bin of
+ * uridecodebin ! audioconvert ! audioresample ! capsfilter ! queue */
+typedef struct tag_xfade_deck_t
+{
+	/* Engine we belong to and deck ID within it */
+	struct tag_xfade_t *m_xfade;
+	guint m_id;
+
+	/* Elements */
+	GstElement *m_bin, *m_convert, *m_queue;
+
+	/* Queue source pad, bin source pad and mixer pad it is linked to */
+	GstPad *m_queue_src, *m_src_pad, *m_mixer_pad;
+
+	/* Blocking probe holding data until the deck is due */
+	gulong m_block_probe;
+
+	/* Deck state */
+	volatile int m_state;
+	volatile bool_t m_eos;
+
+	/* Song bounds in the file time (stop is -1 for the file end) */
+	song_time_t m_start, m_stop;
+
+	/* Running time at which file time 'm_base' is played */
+	GstClockTime m_offset;
+	song_time_t m_base;
+
+	/* Fade windows in the file time (fade-out start is -1 if none) */
+	song_time_t m_fade_in_len;
+	song_time_t m_fade_out_start, m_fade_out_len;
+	int m_curve;
+
+	/* Audio format */
+	int m_rate, m_channels;
+
+	/* Peak queue fill level */
+	guint64 m_max_level;
+} xfade_deck_t;
+
+/* Crossfade engine: decks are mixed with audiomixer into a single sink */
+typedef struct tag_xfade_t
+{
+	/* Pipeline and its common part */
+	GstElement *m_pipeline, *m_mixer, *m_volume;
+
+	/* Main context of the thread controlling us */
+	GMainContext *m_ctx;
+
+	/* Deck fading out, current deck and the one to fade in */
+	xfade_deck_t *m_prev, *m_cur, *m_next;
+	guint m_last_id;
+
+	/* Position used while running time is not available */
+	song_time_t m_frozen_pos;
+	bool_t m_running, m_playing;
+
+	/* Queue size limit of a deck (in ms) */
+	int m_queue_ms;
+
+	/* Overlap measurement */
+	gint64 m_overlap_start;
+	clock_t m_overlap_cpu;
+	volatile guint64 m_overlap_frames;
+
+	/* Next engine in the list of alive ones */
+	struct tag_xfade_t *m_next_engine;
+} xfade_t;
+
+/* Create engine with a given audio sink */
+xfade_t *xfade_new( GstElement *sink, GMainContext *ctx, int queue_ms );
+
+/* Free engine */
+void xfade_free( xfade_t *xf );
+
+/* Start playing a song from scratch. Times are in the file time */
+bool_t xfade_play( xfade_t *xf, const char *uri, song_time_t start,
+		song_time_t stop );
+
+/* Prepare the next song to fade in when the current one reaches
+ * 'fade_at'. Returns time (in ns) left until that moment or -1 on error */
+song_time_t xfade_queue_next( xfade_t *xf, const char *uri, song_time_t start,
+		song_time_t stop, song_time_t fade_at, song_time_t fade_len, int curve );
+
+/* Make the next deck current */
+void xfade_switch( xfade_t *xf );
+
+/* Seek current song (next deck is dropped). 'flags' select seek accuracy */
+bool_t xfade_seek( xfade_t *xf, song_time_t pos, GstSeekFlags flags );
+
+/* Get current song position in the file time */
+song_time_t xfade_get_position( xfade_t *xf );
+
+/* Set output volume */
+void xfade_set_volume( xfade_t *xf, double vol );
+
+/* Set pipeline state */
+void xfade_set_state( xfade_t *xf, GstState state );
+
+/* Handle pipeline ASYNC_DONE message */
+void xfade_on_async_done( xfade_t *xf );
+
+/* Handle error posted by 'src'. Returns TRUE if nothing is left to play */
+bool_t xfade_on_error( xfade_t *xf, GstObject *src );
+
+/* Parse curve name */
+int xfade_curve_by_name( const char *name );
+
+#endif
+
+/* End of 'xfade.h' file */